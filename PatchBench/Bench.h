@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+// 各个基准的入口，argv[0] 是子命令名
+int run_receive_bench(int argc, char* argv[]);
+int run_checksum_bench(int argc, char* argv[]);
+int run_sink_bench(int argc, char* argv[]);
+int run_parser_bench(int argc, char* argv[]);
+
+// 进程当前和启动以来峰值的常驻内存，字节，取不到时为 0
+uint64_t current_rss();
+uint64_t peak_rss();
+
+double megabytes(uint64_t bytes);
@@ -0,0 +1,116 @@
+#include "Bench.h"
+#include "Checksum.h"
+#include "Protocol.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+    void print_usage() {
+        std::cout <<
+            "用法: PatchBench checksum [选项]\n"
+            "  --size-mb <MB>      每次计算的数据量（默认 256）\n"
+            "  --repeat <次数>     每种算法重复的次数，取最快一次（默认 5）\n"
+            "在内存中的随机数据上测 CRC32C（自动选择、查表）和 XXH64（一次计算、按数据块流式计算）的速度，\n"
+            "同时检查不同实现的结果是否一致。\n";
+    }
+
+    // 数据在内存里，只测算法本身，结果和磁盘读取速度比较就知道校验是不是瓶颈
+    double best_gb_per_second(const std::vector<char>& data, size_t repeat, const std::function<uint64_t()>& run,
+                              uint64_t& result) {
+        double best = 0;
+        for (size_t i = 0; i < repeat; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            result = run();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (seconds > 0) {
+                best = std::max(best, data.size() / seconds / 1e9);
+            }
+        }
+        return best;
+    }
+
+    // 中文名称的显示宽度和字节数不同，速度放在前面对齐
+    void print_row(const char* name, double rate, uint64_t result) {
+        std::cout << std::fixed << std::setprecision(2) << std::setw(8) << rate << " GB/s  " << name
+                  << "  " << std::hex << result << std::dec << "\n";
+    }
+}
+
+int run_checksum_bench(int argc, char* argv[]) {
+    size_t size_mb = 256;
+    size_t repeat = 5;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (option == "--help" || option == "-h") {
+            print_usage();
+            return 0;
+        } else if (has_value && option == "--size-mb") {
+            size_mb = std::strtoul(argv[++i], nullptr, 10);
+        } else if (has_value && option == "--repeat") {
+            repeat = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            std::cout << "未知选项: " << option << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+    if (size_mb == 0 || repeat == 0) {
+        print_usage();
+        return 1;
+    }
+
+    // xorshift 填充，避免全零数据让某些实现走捷径
+    std::vector<char> data(size_mb * 1024 * 1024);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i + 8 <= data.size(); i += 8) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        std::memcpy(&data[i], &state, 8);
+    }
+
+    std::cout << "数据 " << size_mb << " MB，重复 " << repeat << " 次取最快，CRC32C 硬件指令: "
+              << (crc32c_hardware_available() ? "可用" : "不可用") << "\n";
+
+    uint64_t crc_auto = 0;
+    double rate = best_gb_per_second(data, repeat,
+        [&data]() -> uint64_t { return crc32c(0, data.data(), data.size()); }, crc_auto);
+    print_row(crc32c_hardware_available() ? "CRC32C 硬件" : "CRC32C 自动（查表）", rate, crc_auto);
+
+    uint64_t crc_software = 0;
+    rate = best_gb_per_second(data, repeat,
+        [&data]() -> uint64_t { return crc32c_software(0, data.data(), data.size()); }, crc_software);
+    print_row("CRC32C 查表", rate, crc_software);
+
+    uint64_t hash = 0;
+    rate = best_gb_per_second(data, repeat,
+        [&data]() -> uint64_t { return fast_hash64(data.data(), data.size()); }, hash);
+    print_row("XXH64", rate, hash);
+
+    // 和下载时一样按 FILE_CHUNK_SIZE 分块传入
+    uint64_t hash_stream = 0;
+    rate = best_gb_per_second(data, repeat,
+        [&data]() -> uint64_t {
+            FastHash64 hasher;
+            for (size_t offset = 0; offset < data.size(); offset += FILE_CHUNK_SIZE) {
+                hasher.update(data.data() + offset, std::min<size_t>(FILE_CHUNK_SIZE, data.size() - offset));
+            }
+            return hasher.digest();
+        }, hash_stream);
+    print_row("XXH64 分块", rate, hash_stream);
+
+    if (crc_auto != crc_software || hash != hash_stream) {
+        std::cout << "不同实现的结果不一致" << std::endl;
+        return 2;
+    }
+    return 0;
+}
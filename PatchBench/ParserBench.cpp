@@ -0,0 +1,246 @@
+#include "Bench.h"
+#include "AllocationCounter.h"
+#include "CommandParser.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+namespace {
+    void print_usage() {
+        std::cout <<
+            "用法: PatchBench parser [选项]\n"
+            "  --messages <数量>   每种消息解析的次数（默认 1000000）\n"
+            "  --files <数量>      DOWNLOAD_FILES / DELETE_FILES 中的文件数（默认 16）\n"
+            "对登录器收到的各种文本命令，分别用旧的解析方式（逐个比较命令前缀、拆成 vector、stoull）\n"
+            "和现在的 parse_command + FieldTokenizer 解析，输出每秒消息数和每个消息的堆分配次数。\n";
+    }
+
+    // 旧版登录器的解析方式，只保留解析本身，用来和现在的实现比较
+    namespace legacy {
+        const std::string SERVER_INFO = "SERVER_INFO|";
+        const std::string CHECK_PATCHES = "CHECK_PATCHES|";
+        const std::string DELETE_FILES = "DELETE_FILES|";
+        const std::string UPDATE_FILES = "UPDATE_FILES|";
+        const std::string DOWNLOAD_FILES = "DOWNLOAD_FILES|";
+        const std::string REPAIR_FILES = "REPAIR_FILES|";
+
+        std::vector<std::string_view> parse_message(std::string_view message) {
+            std::vector<std::string_view> parts;
+            size_t pos = 0;
+            size_t prev = 0;
+            while ((pos = message.find('|', prev)) != std::string_view::npos) {
+                parts.push_back(message.substr(prev, pos - prev));
+                prev = pos + 1;
+            }
+            parts.push_back(message.substr(prev));
+            return parts;
+        }
+
+        uint64_t process_message(std::string_view message) {
+            uint64_t result = 0;
+            if (message.compare(0, SERVER_INFO.size(), SERVER_INFO) == 0) {
+                std::vector<std::string_view> parts = parse_message(message);
+                if (parts.size() >= 5) {
+                    std::string ip(parts[1]);
+                    std::string port(parts[2]);
+                    std::string name(parts[3]);
+                    std::string notice(parts[4]);
+                    std::string::size_type pos = 0;
+                    while ((pos = notice.find("\\n", pos)) != std::string::npos) {
+                        notice.replace(pos, 2, "\n");
+                        pos += 1;
+                    }
+                    result = ip.size() + port.size() + name.size() + notice.size();
+                }
+            } else if (message.compare(0, CHECK_PATCHES.size(), CHECK_PATCHES) == 0) {
+                result = 1;
+            } else if (message.compare(0, DELETE_FILES.size(), DELETE_FILES) == 0) {
+                std::vector<std::string_view> parts = parse_message(message);
+                parts.erase(parts.begin());
+                for (const auto& filename : parts) {
+                    result += std::string(filename).size();
+                }
+            } else if (message.compare(0, DOWNLOAD_FILES.size(), DOWNLOAD_FILES) == 0) {
+                std::vector<std::string_view> parts = parse_message(message);
+                for (size_t i = 1; i + 1 < parts.size(); i += 2) {
+                    std::string filename(parts[i]);
+                    try {
+                        result += std::stoull(std::string(parts[i + 1])) + filename.size();
+                    }
+                    catch (const std::exception&) {
+                    }
+                }
+            } else if (message.compare(0, REPAIR_FILES.size(), REPAIR_FILES) == 0) {
+                std::vector<std::string_view> parts = parse_message(message);
+                for (size_t i = 1; i < parts.size(); ++i) {
+                    result += parts[i].size();
+                }
+            } else if (message.compare(0, UPDATE_FILES.size(), UPDATE_FILES) == 0) {
+                size_t first_sep = UPDATE_FILES.size() - 1;
+                size_t second_sep = message.find('|', first_sep + 1);
+                size_t third_sep = second_sep == std::string_view::npos ? second_sep : message.find('|', second_sep + 1);
+                if (third_sep != std::string_view::npos) {
+                    try {
+                        uint64_t filesize = std::stoull(std::string(message.substr(second_sep + 1, third_sep - second_sep - 1)));
+                        result = filesize + message.size() - third_sep - 1;
+                    }
+                    catch (const std::exception&) {
+                    }
+                }
+            }
+            return result;
+        }
+    }
+
+    // 和 GameManager.cpp 中 process_message 及各个 handle_* 的解析部分相同
+    uint64_t process_message(std::string_view message) {
+        uint64_t result = 0;
+        std::string_view args;
+        switch (parse_command(message, args)) {
+        case CommandType::SERVER_INFO: {
+            FieldTokenizer fields(args);
+            std::string_view ip, port, name, notice;
+            if (fields.next(ip) && fields.next(port) && fields.next(name) && fields.next(notice)) {
+                result = ip.size() + port.size() + name.size() + unescape_newlines(notice).size();
+            }
+            break;
+        }
+        case CommandType::CHECK_PATCHES:
+            result = 1;
+            break;
+        case CommandType::DELETE_FILES: {
+            FieldTokenizer fields(args);
+            std::string_view filename;
+            while (fields.next(filename)) {
+                result += std::string(filename).size();
+            }
+            break;
+        }
+        case CommandType::DOWNLOAD_FILES: {
+            FieldTokenizer fields(args);
+            std::string_view name_field, size_field;
+            while (fields.next(name_field) && fields.next(size_field)) {
+                uint64_t filesize = 0;
+                if (parse_uint64(size_field, filesize)) {
+                    std::string filename(name_field);
+                    result += filesize + filename.size();
+                }
+            }
+            break;
+        }
+        case CommandType::REPAIR_FILES: {
+            FieldTokenizer fields(args);
+            std::string_view filename;
+            while (fields.next(filename)) {
+                result += filename.size();
+            }
+            break;
+        }
+        case CommandType::UPDATE_FILES: {
+            FieldTokenizer fields(args);
+            std::string_view filename, size_field;
+            uint64_t filesize = 0;
+            if (fields.next(filename) && fields.next(size_field) && fields.has_remainder() &&
+                parse_uint64(size_field, filesize)) {
+                result = filesize + fields.remainder().size();
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        return result;
+    }
+
+    struct ParserResult {
+        double messages_per_second = 0;
+        double allocations_per_message = 0;
+        uint64_t checksum = 0;
+    };
+
+    template <typename Parse>
+    ParserResult measure(const std::string& message, size_t count, Parse parse) {
+        ParserResult result;
+        uint64_t allocations = allocation_count();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; ++i) {
+            result.checksum += parse(message);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.allocations_per_message = static_cast<double>(allocation_count() - allocations) / count;
+        result.messages_per_second = seconds > 0 ? count / seconds : 0;
+        return result;
+    }
+
+    void print_result(const char* name, const ParserResult& result) {
+        std::cout << "  " << name << std::fixed << std::setprecision(2) << std::setw(12)
+                  << result.messages_per_second / 1e6 << " M 消息/秒  " << std::setprecision(1) << std::setw(6)
+                  << result.allocations_per_message << " 次分配/消息\n";
+    }
+}
+
+int run_parser_bench(int argc, char* argv[]) {
+    size_t count = 1000000;
+    size_t files = 16;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (option == "--help" || option == "-h") {
+            print_usage();
+            return 0;
+        } else if (has_value && option == "--messages") {
+            count = std::strtoul(argv[++i], nullptr, 10);
+        } else if (has_value && option == "--files") {
+            files = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            std::cout << "未知选项: " << option << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+    if (count == 0) {
+        print_usage();
+        return 1;
+    }
+
+    // 文件名用补丁的命名方式，长度超过短字符串优化的范围，和实际一样需要分配
+    std::string download = "DOWNLOAD_FILES";
+    std::string remove = "DELETE_FILES";
+    std::string repair = "REPAIR_FILES";
+    for (size_t i = 0; i < files; ++i) {
+        std::string filename = "patch-zhCN-" + std::to_string(i) + "-interface.mpq";
+        download += "|" + filename + "|" + std::to_string(1048576 * (i + 1));
+        remove += "|" + filename;
+        repair += "|" + filename;
+    }
+    std::string content(4096, 'x');
+    const std::vector<std::pair<const char*, std::string>> messages = {
+        { "SERVER_INFO", "SERVER_INFO|203.0.113.10|12345|Patch Server|欢迎\\n今晚 20:00 维护\\n请提前下载补丁|MUX" },
+        { "DOWNLOAD_FILES", download },
+        { "DELETE_FILES", remove },
+        { "REPAIR_FILES", repair },
+        { "UPDATE_FILES", "UPDATE_FILES|realmlist.wtf|" + std::to_string(content.size()) + "|" + content },
+    };
+
+    std::cout << "每种消息解析 " << count << " 次，文件列表 " << files << " 个文件\n";
+    bool mismatch = false;
+    for (const auto& [name, message] : messages) {
+        std::cout << name << "（" << message.size() << " 字节）\n";
+        ParserResult old_result = measure(message, count, legacy::process_message);
+        ParserResult new_result = measure(message, count, process_message);
+        print_result("旧解析", old_result);
+        print_result("新解析", new_result);
+        mismatch = mismatch || old_result.checksum != new_result.checksum;
+    }
+
+    if (mismatch) {
+        std::cout << "新旧解析的结果不一致" << std::endl;
+        return 2;
+    }
+    return 0;
+}
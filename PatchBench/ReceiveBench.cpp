@@ -0,0 +1,204 @@
+#include "Bench.h"
+#include "GameManager.h"
+#include "AllocationCounter.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <filesystem>
+
+namespace {
+    void print_usage() {
+        std::cout <<
+            "用法: PatchBench receive --file <文件名> [选项]\n"
+            "  --server <地址>         服务器地址（默认 127.0.0.1）\n"
+            "  --port <端口>           服务器端口（默认 12345）\n"
+            "  --timeout <秒>          最长等待时间（默认 600）\n"
+            "  --max-growth-mb <MB>    接收期间峰值内存比开始前增长超过这个值时返回非零\n"
+            "  --coroutine             主连接用协程收发（需要 C++20 编译，默认和登录器一样用回调链）\n"
+            "用登录器的 Client 向 PatchServer 请求补丁目录中的一个文件，经过和登录器完全相同的\n"
+            "FILE_BEGIN / FILE_CHUNK / FILE_END 接收和写盘路径。文件写到当前目录的 Data 下，\n"
+            "开始前删除同名的文件和续传记录。峰值内存应当与文件大小无关，请用几 GB 的文件测试。\n"
+            "分别用 --coroutine 和默认方式各运行一次，比较两种收发方式的吞吐量、每秒消息数和每个消息的\n"
+            "堆分配次数。分配次数包括网络线程和写盘线程，从发出请求到文件写完为止。\n"
+            "预热之后到收到 FILE_END 之前的一段单独统计，这段时间里有堆分配时返回非零。\n";
+    }
+
+    // 前这么多字节用于预热：连接、打开文件、缓冲池和各个 HandlerMemory 在这期间到位
+    const uint64_t RECEIVE_WARMUP_BYTES = 32 * 1024 * 1024;
+
+    // 轮询时记录的一次采样，先读分配次数再读统计
+    struct AllocationSample {
+        uint64_t allocations;
+        uint64_t messages;
+        uint64_t bytes;
+    };
+
+    // 下载完成后文件会出现在统计的已完成列表中
+    bool find_finished(const std::string& filename, FileTiming& timing) {
+        StatsSnapshot snap = g_transfer_stats.snapshot();
+        for (const auto& finished : snap.finished_files) {
+            if (finished.filename == filename) {
+                timing = finished;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t drain_errors() {
+        size_t errors = 0;
+        ClientEvent event;
+        while (poll_client_event(event)) {
+            if (event.type == ClientEventType::ERROR_MESSAGE) {
+                std::cout << "  错误: " << event.text << "\n";
+                ++errors;
+            }
+        }
+        return errors;
+    }
+}
+
+int run_receive_bench(int argc, char* argv[]) {
+    std::string server = "127.0.0.1";
+    std::string port = "12345";
+    std::string filename;
+    double timeout_seconds = 600;
+    double max_growth_mb = 0;
+    bool coroutine_io = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (option == "--help" || option == "-h") {
+            print_usage();
+            return 0;
+        } else if (option == "--coroutine") {
+            if (!CLIENT_HAS_COROUTINE_IO) {
+                std::cout << "这个版本不是用 C++20 编译的，不支持协程收发\n";
+                return 1;
+            }
+            coroutine_io = true;
+        } else if (has_value && option == "--server") {
+            server = argv[++i];
+        } else if (has_value && option == "--port") {
+            port = argv[++i];
+        } else if (has_value && option == "--file") {
+            filename = argv[++i];
+        } else if (has_value && option == "--timeout") {
+            timeout_seconds = std::strtod(argv[++i], nullptr);
+        } else if (has_value && option == "--max-growth-mb") {
+            max_growth_mb = std::strtod(argv[++i], nullptr);
+        } else {
+            std::cout << "未知选项: " << option << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+    if (filename.empty()) {
+        print_usage();
+        return 1;
+    }
+
+    // 本地有旧文件或续传记录时登录器会走差量或续传，这里只测整个文件的分块接收
+    std::error_code ec;
+    std::filesystem::remove(data_file_path(filename), ec);
+    discard_part_file(filename);
+
+    auto work = asio::make_work_guard(global_io_context);
+    std::thread network_thread([]() { global_io_context.run(); });
+
+    uint64_t baseline = peak_rss();
+    uint64_t allocations = allocation_count();
+    auto client = std::make_shared<Client>();
+    client->set_coroutine_io(coroutine_io);
+    client->start(server, port);
+    asio::post(global_io_context, [client, filename]() { client->request_file(filename, 0); });
+    // 之后只统计网络线程和写盘线程，轮询统计、输出进度时的分配不算
+    exclude_thread_from_allocation_count();
+    std::vector<AllocationSample> samples;
+
+    auto started = std::chrono::steady_clock::now();
+    auto last_report = started;
+    size_t errors = 0;
+    FileTiming timing;
+    bool finished = false;
+    while (!finished && errors == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        errors += drain_errors();
+        finished = find_finished(filename, timing);
+        uint64_t sample_allocations = allocation_count();
+        StatsSnapshot snap = g_transfer_stats.snapshot();
+        samples.push_back({ sample_allocations, snap.messages_received, snap.bytes_received });
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_report >= std::chrono::seconds(1)) {
+            last_report = now;
+            std::cout << "  已接收 " << std::fixed << std::setprecision(1)
+                      << megabytes(g_transfer_stats.snapshot().bytes_received) << " MB  内存 "
+                      << megabytes(current_rss()) << " MB" << std::endl;
+        }
+        if (std::chrono::duration<double>(now - started).count() > timeout_seconds) {
+            std::cout << "  超时" << std::endl;
+            break;
+        }
+    }
+    uint64_t peak = peak_rss();
+    allocations = allocation_count() - allocations;
+
+    work.reset();
+    global_io_context.stop();
+    network_thread.join();
+
+    if (!finished) {
+        return 1;
+    }
+
+    // 预热后的区间：从第一次超过预热字节数的采样，到最后一次还没收到 FILE_END 的采样。
+    // 收到的字节数在处理消息之前累计，采样时字节数小于最终值就说明 FILE_END 还没处理，不包括完成文件时的分配
+    uint64_t final_bytes = g_transfer_stats.snapshot().bytes_received;
+    const AllocationSample* window_begin = nullptr;
+    const AllocationSample* window_end = nullptr;
+    for (const auto& sample : samples) {
+        if (sample.bytes < RECEIVE_WARMUP_BYTES || sample.bytes >= final_bytes) {
+            continue;
+        }
+        if (!window_begin) {
+            window_begin = &sample;
+        }
+        window_end = &sample;
+    }
+    uint64_t warm_messages = window_begin ? window_end->messages - window_begin->messages : 0;
+    uint64_t warm_allocations = window_begin ? window_end->allocations - window_begin->allocations : 0;
+
+    double seconds = timing.complete_ms / 1000.0;
+    double growth = megabytes(peak > baseline ? peak - baseline : 0);
+    ChunkPoolStats pool = g_chunk_pool.stats();
+    uint64_t messages = g_transfer_stats.snapshot().messages_received;
+    std::cout << filename << "（" << (coroutine_io ? "协程" : "回调") << "）: " << std::fixed << std::setprecision(1)
+              << megabytes(timing.bytes) << " MB  " << std::setprecision(2) << seconds << " s  "
+              << (seconds > 0 ? megabytes(timing.bytes) / seconds : 0.0) << " MB/s  " << std::setprecision(0)
+              << (seconds > 0 ? messages / seconds : 0.0) << " 消息/s  " << std::setprecision(2)
+              << (messages > 0 ? static_cast<double>(allocations) / messages : 0.0) << " 次分配/消息\n"
+              << "峰值内存: 开始前 " << std::setprecision(1) << megabytes(baseline) << " MB  接收后 "
+              << megabytes(peak) << " MB  增长 " << growth << " MB\n"
+              << "数据块缓冲池: 峰值 " << pool.high_water << " 块  等待 " << pool.stalls << " 次" << std::endl;
+    if (warm_messages > 0) {
+        std::cout << "预热后: " << warm_messages << " 个消息  " << warm_allocations << " 次分配" << std::endl;
+    } else {
+        std::cout << "预热后: 文件太小或接收太快，没有采到预热后的区间，请用更大的文件" << std::endl;
+    }
+
+    if (warm_allocations > 0) {
+        std::cout << "预热后收包和写盘路径上仍有堆分配" << std::endl;
+        return 3;
+    }
+
+    if (max_growth_mb > 0 && growth > max_growth_mb) {
+        std::cout << "峰值内存增长超过 " << max_growth_mb << " MB" << std::endl;
+        return 2;
+    }
+    return 0;
+}
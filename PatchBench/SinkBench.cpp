@@ -0,0 +1,171 @@
+#include "Bench.h"
+#include "FileSink.h"
+#include <asio.hpp>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+
+namespace {
+    void print_usage() {
+        std::cout <<
+            "用法: PatchBench sink [选项]\n"
+            "  --size-mb <MB>         每次写入的文件大小（默认 512）\n"
+            "  --path <文件>          测试文件路径（默认当前目录的 sink_bench.tmp），结束后删除\n"
+            "  --chunk-kb <列表>      每次写入的大小，逗号分隔（默认 64,256,1024）\n"
+            "  --depth <列表>         AsyncFileSink 的队列深度，逗号分隔（默认 1,4,16,32）\n"
+            "对每种写入大小先用 std::ofstream 顺序写一遍作为基准，再用登录器的 AsyncFileSink 按偏移写，\n"
+            "最多同时在途“队列深度”个写入。写入方式取决于编译：Windows 上是 IOCP，Linux 上定义\n"
+            "ASIO_HAS_IO_URING 时是 io_uring，否则是同步的 positional。超过 FILE_SINK_SLOT_SIZE 的写入\n"
+            "不走注册缓冲区。数据写进系统缓存就算完成，测的是提交路径的开销，不是磁盘速度。\n";
+    }
+
+    std::vector<size_t> parse_list(const std::string& text) {
+        std::vector<size_t> values;
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            size_t value = std::strtoul(item.c_str(), nullptr, 10);
+            if (value > 0) {
+                values.push_back(value);
+            }
+        }
+        return values;
+    }
+
+    // 每次都从不存在的文件开始，避免截断上一次的大文件的耗时算进来
+    void remove_file(const std::string& path) {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+
+    double ofstream_seconds(const std::string& path, const std::vector<char>& chunk, uint64_t total) {
+        remove_file(path);
+        auto start = std::chrono::steady_clock::now();
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        for (uint64_t written = 0; written < total && file; written += chunk.size()) {
+            file.write(chunk.data(), static_cast<std::streamsize>(std::min<uint64_t>(chunk.size(), total - written)));
+        }
+        file.close();
+        if (file.fail()) {
+            return -1;
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // 和 FileReceiver 一样在 io_context 所在线程上提交，在途写入达到 depth 时先处理完成回调
+    double sink_seconds(const std::string& path, const std::vector<char>& chunk, uint64_t total, size_t depth) {
+        remove_file(path);
+
+        // 没有未完成的任务时 io_context 会自行停止，之后的 run_one 直接返回
+        asio::io_context io_context;
+        auto work = asio::make_work_guard(io_context);
+        auto sink = std::make_shared<AsyncFileSink>(io_context, depth);
+
+        auto start = std::chrono::steady_clock::now();
+        if (!sink->open(path, true) || !sink->resize(total)) {
+            return -1;
+        }
+
+        size_t failed = 0;
+        for (uint64_t offset = 0; offset < total; offset += chunk.size()) {
+            while (sink->in_flight() >= depth) {
+                io_context.run_one();
+            }
+            size_t size = static_cast<size_t>(std::min<uint64_t>(chunk.size(), total - offset));
+            sink->async_write_at(offset, std::string_view(chunk.data(), size), [&failed](bool ok) {
+                if (!ok) {
+                    ++failed;
+                }
+            });
+        }
+        while (sink->in_flight() > 0) {
+            io_context.run_one();
+        }
+        sink->close();
+        work.reset();
+        io_context.run();
+
+        if (failed > 0) {
+            return -1;
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void print_row(const std::string& name, uint64_t total, double seconds) {
+        if (seconds < 0) {
+            std::cout << "  " << name << " 写入失败\n";
+            return;
+        }
+        std::cout << std::fixed << std::setprecision(1) << std::setw(10)
+                  << (seconds > 0 ? megabytes(total) / seconds : 0.0) << " MB/s  " << name << "\n";
+    }
+}
+
+int run_sink_bench(int argc, char* argv[]) {
+    uint64_t size_mb = 512;
+    std::string path = "sink_bench.tmp";
+    std::vector<size_t> chunk_kbs = { 64, 256, 1024 };
+    std::vector<size_t> depths = { 1, 4, 16, 32 };
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (option == "--help" || option == "-h") {
+            print_usage();
+            return 0;
+        } else if (has_value && option == "--size-mb") {
+            size_mb = std::strtoull(argv[++i], nullptr, 10);
+        } else if (has_value && option == "--path") {
+            path = argv[++i];
+        } else if (has_value && option == "--chunk-kb") {
+            chunk_kbs = parse_list(argv[++i]);
+        } else if (has_value && option == "--depth") {
+            depths = parse_list(argv[++i]);
+        } else {
+            std::cout << "未知选项: " << option << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+    if (size_mb == 0 || chunk_kbs.empty() || depths.empty()) {
+        print_usage();
+        return 1;
+    }
+
+    uint64_t total = size_mb * 1024 * 1024;
+    std::cout << "文件 " << size_mb << " MB，AsyncFileSink 写入方式: " << AsyncFileSink::backend_name() << "\n";
+
+    bool failed = false;
+    for (size_t chunk_kb : chunk_kbs) {
+        // 内容不影响写入速度，填充非零数据避免文件系统对全零块做特殊处理
+        std::vector<char> chunk(chunk_kb * 1024);
+        for (size_t i = 0; i < chunk.size(); ++i) {
+            chunk[i] = static_cast<char>(i * 131 + 7);
+        }
+
+        std::cout << "写入大小 " << chunk_kb << " KB"
+                  << (chunk.size() > FILE_SINK_SLOT_SIZE ? "（超过注册缓冲区）" : "") << "\n";
+
+        double seconds = ofstream_seconds(path, chunk, total);
+        failed = failed || seconds < 0;
+        print_row("ofstream", total, seconds);
+
+        for (size_t depth : depths) {
+            seconds = sink_seconds(path, chunk, total, depth);
+            failed = failed || seconds < 0;
+            print_row("sink 深度 " + std::to_string(depth), total, seconds);
+        }
+    }
+
+    remove_file(path);
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,108 @@
+#include "Bench.h"
+#include <iostream>
+#include <string>
+#include <fstream>
+
+// Compression.cpp 的解压用到了 stb_image 自带的 zlib 解码器。
+// 定义 PATCHBENCH_NO_RECEIVE 时不编译依赖登录器 Client 的 receive 基准，
+// 只需要 FileSink、Checksum 等跨平台的文件，PatchBenchLinux 用它在 Linux 上编译 io_uring 版本
+#ifndef PATCHBENCH_NO_RECEIVE
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    void print_usage() {
+        std::cout <<
+            "用法: PatchBench <基准> [选项]\n"
+#ifndef PATCHBENCH_NO_RECEIVE
+            "  receive     从 PatchServer 分块接收一个文件，报告吞吐量和峰值内存\n"
+#endif
+            "  checksum    CRC32C（硬件、查表）和 XXH64 的速度，GB/s\n"
+            "  sink        AsyncFileSink（IOCP / io_uring）和 ofstream 在不同写入大小、队列深度下的写入速度\n"
+            "  parser      新旧文本命令解析的每秒消息数和每个消息的堆分配次数\n"
+            "每个基准加 --help 查看各自的选项。\n";
+    }
+}
+
+uint64_t current_rss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.WorkingSetSize;
+    }
+    return 0;
+#else
+    // statm 的第二项是常驻页数
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0;
+    uint64_t resident = 0;
+    if (statm >> size >> resident) {
+        return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    }
+    return 0;
+#endif
+}
+
+uint64_t peak_rss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    // Linux 上 ru_maxrss 的单位是 KB
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+    }
+    return 0;
+#endif
+}
+
+double megabytes(uint64_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+
+    std::string bench = argv[1];
+#ifndef PATCHBENCH_NO_RECEIVE
+    if (bench == "receive") {
+        return run_receive_bench(argc - 1, argv + 1);
+    }
+#endif
+    if (bench == "checksum") {
+        return run_checksum_bench(argc - 1, argv + 1);
+    }
+    if (bench == "sink") {
+        return run_sink_bench(argc - 1, argv + 1);
+    }
+    if (bench == "parser") {
+        return run_parser_bench(argc - 1, argv + 1);
+    }
+
+    if (bench != "--help" && bench != "-h") {
+        std::cout << "未知基准: " << bench << "\n";
+    }
+    print_usage();
+    return 1;
+}
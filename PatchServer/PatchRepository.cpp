@@ -0,0 +1,143 @@
+#include "PatchRepository.h"
+#include "Checksum.h"
+#include <filesystem>
+#include <fstream>
+
+namespace {
+    // 计算 CRC 时每次读取的大小
+    const size_t CRC_READ_SIZE = 1024 * 1024;
+}
+
+bool is_managed_patch(const std::string& filename) {
+    if (filename.find("patch-") != 0 || filename.find(".mpq") == std::string::npos) {
+        return false;
+    }
+    // patch-1.mpq 到 patch-9.mpq 是客户端自带的基础补丁
+    return !(filename.length() == 10 && filename[6] >= '1' && filename[6] <= '9');
+}
+
+bool file_crc32c(const std::string& path, uint32_t& crc) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    std::vector<char> buffer(CRC_READ_SIZE);
+    crc = 0;
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        std::streamsize count = file.gcount();
+        if (count <= 0) break;
+        crc = crc32c(crc, buffer.data(), static_cast<size_t>(count));
+    }
+    return !file.bad();
+}
+
+PatchRepository::PatchRepository(const std::string& root, size_t chunk_cache_bytes)
+    : root_(root), chunk_cache_(chunk_cache_bytes) {}
+
+size_t PatchRepository::refresh() {
+    std::lock_guard<std::mutex> refresh_lock(refresh_mutex_);
+    return scan();
+}
+
+void PatchRepository::refresh_if_stale(std::chrono::steady_clock::duration interval) {
+    std::unique_lock<std::mutex> refresh_lock(refresh_mutex_, std::try_to_lock);
+    if (!refresh_lock.owns_lock()) {
+        return;
+    }
+    if (std::chrono::steady_clock::now() - last_refresh_ < interval) {
+        return;
+    }
+    scan();
+}
+
+size_t PatchRepository::scan() {
+    std::map<std::string, PatchFile> previous;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        previous = files_;
+    }
+
+    // 计算 CRC 在锁外进行，扫描期间会话仍然可以按旧索引下载
+    std::map<std::string, PatchFile> scanned;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(root_, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (!it->is_regular_file(ec)) {
+            continue;
+        }
+
+        PatchFile file;
+        file.path = it->path().string();
+        file.name = it->path().lexically_relative(root_).generic_string();
+        if (file.name.empty() || !read_file_meta(file.path, file.meta)) {
+            continue;
+        }
+
+        auto old = previous.find(file.name);
+        if (old != previous.end() && old->second.meta.size == file.meta.size &&
+            old->second.meta.mtime == file.meta.mtime && old->second.meta.file_id == file.meta.file_id) {
+            file.crc = old->second.crc;
+        } else if (!file_crc32c(file.path, file.crc)) {
+            continue;
+        }
+        scanned.emplace(file.name, std::move(file));
+    }
+
+    // 从扫描结束时开始计算间隔，大目录扫描本身的耗时不占用间隔
+    last_refresh_ = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    files_.swap(scanned);
+
+    // 已删除或已变化的文件不再保留旧的清单
+    for (auto it = trees_.begin(); it != trees_.end();) {
+        auto file = files_.find(it->first);
+        if (file == files_.end() || file->second.version() != it->second.version) {
+            it = trees_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return files_.size();
+}
+
+bool PatchRepository::find(const std::string& name, PatchFile& file) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(name);
+    if (it == files_.end()) {
+        return false;
+    }
+    file = it->second;
+    return true;
+}
+
+std::vector<PatchFile> PatchRepository::managed_patches() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<PatchFile> patches;
+    for (const auto& entry : files_) {
+        // 客户端只校验 Data 目录第一层的补丁
+        if (entry.first.find('/') == std::string::npos && is_managed_patch(entry.first)) {
+            patches.push_back(entry.second);
+        }
+    }
+    return patches;
+}
+
+std::shared_ptr<const MerkleTree> PatchRepository::merkle_tree(const PatchFile& file) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = trees_.find(file.name);
+        if (it != trees_.end() && it->second.version == file.version()) {
+            return it->second.tree;
+        }
+    }
+
+    auto tree = std::make_shared<MerkleTree>();
+    if (!build_merkle_tree(file.path, MERKLE_CHUNK_SIZE, *tree)) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    trees_[file.name] = { file.version(), tree };
+    return tree;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include "HashCache.h"
+#include "MerkleManifest.h"
+#include "Compression.h"
+
+// 单个文件的索引信息
+struct PatchFile {
+    std::string name;        // 相对补丁根目录的路径，分隔符统一为 '/'
+    std::string path;        // 磁盘上的完整路径
+    FileMeta meta;
+    uint32_t crc = 0;        // 整个文件的 CRC32C，与客户端 CHECK_PATCHES 上报的值比较
+
+    // 压缩缓存和清单缓存用修改时间区分同一个文件的不同版本
+    uint64_t version() const { return static_cast<uint64_t>(meta.mtime); }
+};
+
+// 与客户端 check_and_start_game 的规则相同: patch-*.mpq，但不包括 patch-1.mpq 到 patch-9.mpq
+bool is_managed_patch(const std::string& filename);
+
+// 计算整个文件的 CRC32C
+bool file_crc32c(const std::string& path, uint32_t& crc);
+
+// 补丁目录
+// 扫描整个目录树并记录每个文件的 CRC32C，refresh() 只重新计算元数据变化过的文件。
+// 所有会话线程共享同一个实例，只有索引中的文件可以被下载，请求中的 .. 之类的路径自然找不到。
+class PatchRepository {
+public:
+    PatchRepository(const std::string& root, size_t chunk_cache_bytes);
+
+    // 重新扫描目录，返回文件数。同一时间只有一次扫描，其他调用者等待它完成
+    size_t refresh();
+    // 距离上次扫描超过 interval 时重新扫描。已经有扫描在进行或者间隔未到时直接返回，
+    // 调用者使用当前的索引，CHECK_PATCHES 不会因为大量客户端同时连接而反复遍历目录
+    void refresh_if_stale(std::chrono::steady_clock::duration interval);
+
+    bool find(const std::string& name, PatchFile& file) const;
+    // 根目录下受管理的补丁文件，也就是客户端会在 CHECK_PATCHES 中上报的那些
+    std::vector<PatchFile> managed_patches() const;
+
+    // 文件的 Merkle 树，按文件版本缓存，构造失败时返回空指针
+    std::shared_ptr<const MerkleTree> merkle_tree(const PatchFile& file);
+
+    CompressedChunkCache& chunk_cache() { return chunk_cache_; }
+    const std::string& root() const { return root_; }
+
+private:
+    // 调用者必须持有 refresh_mutex_
+    size_t scan();
+
+    struct CachedTree {
+        uint64_t version;
+        std::shared_ptr<const MerkleTree> tree;
+    };
+
+    std::string root_;
+    std::map<std::string, PatchFile> files_;
+    std::map<std::string, CachedTree> trees_;
+    CompressedChunkCache chunk_cache_;
+    mutable std::mutex mutex_;
+    std::mutex refresh_mutex_;
+    std::chrono::steady_clock::time_point last_refresh_;   // 受 refresh_mutex_ 保护
+};
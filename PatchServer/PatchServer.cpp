@@ -0,0 +1,137 @@
+#include "PatchServer.h"
+#include "PatchSession.h"
+#include <iostream>
+#include <filesystem>
+#include <mutex>
+#include <ctime>
+
+void server_log(const std::string& text) {
+    static std::mutex mutex;
+
+    std::time_t now = std::time(nullptr);
+    std::tm local = {};
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout << "[" << stamp << "] " << text << std::endl;
+}
+
+namespace {
+    size_t thread_count(const ServerConfig& config) {
+        if (config.threads > 0) {
+            return config.threads;
+        }
+        size_t cores = std::thread::hardware_concurrency();
+        return cores > 0 ? cores : 1;
+    }
+
+    std::vector<std::unique_ptr<asio::io_context>> make_contexts(size_t count) {
+        std::vector<std::unique_ptr<asio::io_context>> contexts;
+        for (size_t i = 0; i < count; ++i) {
+            // 每个 io_context 只由一个线程运行
+            contexts.push_back(std::make_unique<asio::io_context>(1));
+        }
+        return contexts;
+    }
+}
+
+PatchServer::PatchServer(const ServerConfig& config)
+    : config_(config), repository_(config.root, config.chunk_cache_bytes),
+      contexts_(make_contexts(thread_count(config))), blocking_pool_(thread_count(config)),
+      acceptor_(*contexts_[0]), signals_(*contexts_[0], SIGINT, SIGTERM), next_context_(0) {}
+
+bool PatchServer::start(std::string& error) {
+    std::error_code fs_error;
+    if (!std::filesystem::is_directory(config_.root, fs_error)) {
+        error = "补丁目录不存在: " + config_.root;
+        return false;
+    }
+
+    server_log("正在扫描补丁目录: " + config_.root);
+    size_t files = repository_.refresh();
+    server_log("共 " + std::to_string(files) + " 个文件，其中 " +
+               std::to_string(repository_.managed_patches().size()) + " 个补丁");
+
+    try {
+        asio::ip::tcp::resolver resolver(*contexts_[0]);
+        asio::ip::tcp::endpoint endpoint = *resolver.resolve(config_.listen_address, config_.port).begin();
+
+        acceptor_.open(endpoint.protocol());
+        acceptor_.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+        acceptor_.bind(endpoint);
+        acceptor_.listen();
+    }
+    catch (const std::system_error& e) {
+        error = "无法监听 " + config_.listen_address + ":" + config_.port + ": " + e.what();
+        return false;
+    }
+
+    for (auto& context : contexts_) {
+        work_guards_.push_back(asio::make_work_guard(*context));
+    }
+
+    signals_.async_wait([this](const asio::error_code& error, int /*signal*/) {
+        if (!error) {
+            stop();
+        }
+    });
+
+    do_accept();
+    server_log("开始监听 " + config_.listen_address + ":" + config_.port + "，" +
+               std::to_string(contexts_.size()) + " 个网络线程");
+    return true;
+}
+
+void PatchServer::run() {
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < contexts_.size(); ++i) {
+        threads.emplace_back([context = contexts_[i].get()]() { context->run(); });
+    }
+
+    // 第一个 io_context 同时负责接受连接，在调用线程上运行
+    contexts_[0]->run();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    blocking_pool_.join();
+    server_log("服务器已停止");
+}
+
+void PatchServer::stop() {
+    work_guards_.clear();
+    for (auto& context : contexts_) {
+        context->stop();
+    }
+    blocking_pool_.stop();
+}
+
+void PatchServer::do_accept() {
+    // 新连接直接绑定到下一个 io_context，之后的读写都在那个线程上完成
+    acceptor_.async_accept(next_context(), [this](const asio::error_code& error, asio::ip::tcp::socket socket) {
+        if (error) {
+            if (error != asio::error::operation_aborted) {
+                server_log("接受连接失败: " + error.message());
+                do_accept();
+            }
+            return;
+        }
+
+        // 会话的第一个操作也要在它自己的线程上发起
+        auto session = std::make_shared<PatchSession>(std::move(socket), repository_, config_, blocking_pool_);
+        asio::post(session->executor(), [session]() { session->start(); });
+        do_accept();
+    });
+}
+
+asio::io_context& PatchServer::next_context() {
+    asio::io_context& context = *contexts_[next_context_];
+    next_context_ = (next_context_ + 1) % contexts_.size();
+    return context;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <asio.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include "ServerConfig.h"
+#include "PatchRepository.h"
+
+// 补丁服务器
+// 每个 CPU 核心一个 io_context 和一个线程，新连接轮流分配到各个 io_context，
+// 同一个连接的所有处理都在同一个线程上进行，不需要加锁。
+// 阻塞的磁盘扫描和差量计算放在单独的线程池中，不占用网络线程。
+class PatchServer {
+public:
+    explicit PatchServer(const ServerConfig& config);
+
+    // 扫描补丁目录并开始监听
+    bool start(std::string& error);
+    // 运行到 stop() 被调用或收到退出信号为止
+    void run();
+    void stop();
+
+private:
+    void do_accept();
+    asio::io_context& next_context();
+
+    ServerConfig config_;
+    PatchRepository repository_;
+    std::vector<std::unique_ptr<asio::io_context>> contexts_;
+    std::vector<asio::executor_work_guard<asio::io_context::executor_type>> work_guards_;
+    asio::thread_pool blocking_pool_;
+    asio::ip::tcp::acceptor acceptor_;
+    asio::signal_set signals_;
+    size_t next_context_;
+};
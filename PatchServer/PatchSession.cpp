@@ -0,0 +1,655 @@
+#include "PatchSession.h"
+#include "CommandParser.h"
+#include "Compression.h"
+#include "DeltaSync.h"
+#include "MerkleManifest.h"
+#include <map>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // 最多保留的空闲发送缓冲区个数
+    const size_t SESSION_MAX_FREE_BUFFERS = 8;
+
+    // 通知中的换行转义成 "\n"，客户端用 unescape_newlines 还原
+    std::string escape_newlines(std::string_view text) {
+        std::string result;
+        result.reserve(text.size());
+        for (char c : text) {
+            if (c == '\n') {
+                result += "\\n";
+            } else if (c != '\r') {
+                result.push_back(c);
+            }
+        }
+        return result;
+    }
+
+    std::string_view trim(std::string_view text) {
+        const char* whitespace = " \t\r\n";
+        size_t begin = text.find_first_not_of(whitespace);
+        if (begin == std::string_view::npos) {
+            return std::string_view();
+        }
+        size_t end = text.find_last_not_of(whitespace);
+        return text.substr(begin, end - begin + 1);
+    }
+
+    bool read_whole_file(const std::string& path, std::string& content) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return !file.bad();
+    }
+}
+
+PatchSession::PatchSession(asio::ip::tcp::socket socket, PatchRepository& repository, const ServerConfig& config,
+                           asio::thread_pool& blocking_pool)
+    : socket_(std::move(socket)), repository_(repository), config_(config), blocking_pool_(blocking_pool),
+      reading_paused_(false), next_stream_(0), queued_bytes_(0), closed_(false) {
+    asio::error_code ec;
+    auto endpoint = socket_.remote_endpoint(ec);
+    peer_ = ec ? "unknown" : endpoint.address().to_string() + ":" + std::to_string(endpoint.port());
+}
+
+void PatchSession::start() {
+    asio::error_code ec;
+    socket_.set_option(asio::ip::tcp::no_delay(true), ec);
+    server_log("客户端已连接: " + peer_);
+    do_read();
+}
+
+void PatchSession::do_read() {
+    asio::async_read(socket_, asio::buffer(&header_, PACKET_HEADER_SIZE), bind_handler_memory(handler_memory_,
+        [self = shared_from_this()](const asio::error_code& error, size_t /*bytes_transferred*/) {
+            self->handle_read_header(error);
+        }));
+}
+
+void PatchSession::handle_read_header(const asio::error_code& error) {
+    if (error) {
+        close();
+        return;
+    }
+
+    // 请求体在认证之前就要分配内存，按最长的合法请求限制，而不是按响应的上限
+    if (header_.bodyLength > MAX_REQUEST_BODY_LENGTH || header_.version != PROTOCOL_VERSION) {
+        server_log("非法的数据包，断开连接: " + peer_);
+        close();
+        return;
+    }
+
+    body_.resize(header_.bodyLength);
+    asio::async_read(socket_, asio::buffer(body_.data(), body_.size()), bind_handler_memory(handler_memory_,
+        [self = shared_from_this()](const asio::error_code& error, size_t /*bytes_transferred*/) {
+            self->handle_read(error);
+        }));
+}
+
+void PatchSession::handle_read(const asio::error_code& error) {
+    if (error) {
+        close();
+        return;
+    }
+
+    handle_message(static_cast<MessageType>(header_.messageType), std::string_view(body_.data(), body_.size()));
+    if (closed_) {
+        return;
+    }
+
+    // 客户端一次发来大量请求时先把已排队的响应发出去，由 pump() 恢复读取
+    if (responses_.size() >= SESSION_MAX_PENDING_RESPONSES) {
+        reading_paused_ = true;
+        return;
+    }
+    do_read();
+}
+
+void PatchSession::handle_message(MessageType type, std::string_view body) {
+    switch (type) {
+    case MessageType::TEXT_COMMAND:
+        handle_text_command(body);
+        break;
+    case MessageType::GET_NOTICE:
+        add_response().packets.push_back(make_packet(MessageType::NOTICE_RESPONSE, config_.notice));
+        break;
+    case MessageType::GET_FILE:
+        handle_get_file(body);
+        break;
+    case MessageType::DELTA_REQUEST:
+        handle_delta_request(body);
+        break;
+    case MessageType::GET_MANIFEST:
+        handle_get_manifest(body);
+        break;
+    case MessageType::STREAM_GET:
+        handle_stream_get(body);
+        break;
+    case MessageType::WINDOW_UPDATE:
+        handle_window_update(body);
+        break;
+    default:
+        send_error("不支持的消息类型: " + std::to_string(header_.messageType));
+        break;
+    }
+    pump();
+}
+
+void PatchSession::handle_text_command(std::string_view message) {
+    std::string_view args;
+    switch (parse_command(message, args)) {
+    case CommandType::INIT_SERVER_INFO: {
+        std::string info = "SERVER_INFO|" + config_.public_ip + "|" + config_.port + "|" + config_.name + "|" +
+                           escape_newlines(config_.notice);
+        // 镜像列表跟在能力字段后面，不支持多路复用时能力字段留空
+        if (config_.multiplex || !config_.mirrors.empty()) {
+            info += "|";
+            if (config_.multiplex) {
+                info += CAPABILITY_MULTIPLEX;
+            }
+        }
+        if (!config_.mirrors.empty()) {
+            info += "|";
+            for (size_t i = 0; i < config_.mirrors.size(); ++i) {
+                if (i > 0) {
+                    info += ",";
+                }
+                info += config_.mirrors[i];
+            }
+        }
+        add_response().packets.push_back(make_packet(MessageType::TEXT_COMMAND, info));
+        break;
+    }
+    case CommandType::CHECK_PATCHES:
+        handle_check_patches(args);
+        break;
+    default:
+        send_error("未知命令");
+        break;
+    }
+}
+
+// 客户端上报格式: CHECK_PATCHES|\n 文件名|CRC|\n 文件名|CRC|\n ...
+// 回复顺序: DELETE_FILES、每个小文件一条 UPDATE_FILES、DOWNLOAD_FILES，
+// 最后是 CHECK_PATCHES|删除数|更新数|下载数 作为本次校验的结束标记
+void PatchSession::handle_check_patches(std::string_view args) {
+    run_blocking([&repository = repository_, interval = std::chrono::seconds(config_.refresh_seconds),
+                  report = std::string(args)](std::deque<std::string>& packets) {
+        repository.refresh_if_stale(interval);
+
+        std::map<std::string, uint32_t, std::less<>> reported;
+        FieldTokenizer fields(report);
+        std::string_view name_field, crc_field;
+        while (fields.next(name_field) && fields.next(crc_field)) {
+            std::string_view name = trim(name_field);
+            uint64_t crc = 0;
+            if (!name.empty() && parse_uint64(trim(crc_field), crc)) {
+                reported[std::string(name)] = static_cast<uint32_t>(crc);
+            }
+        }
+
+        std::vector<PatchFile> patches = repository.managed_patches();
+        std::map<std::string_view, const PatchFile*> available;
+        for (const auto& patch : patches) {
+            available[patch.name] = &patch;
+        }
+
+        std::string delete_list = "DELETE_FILES";
+        std::string download_list = "DOWNLOAD_FILES";
+        size_t deleted = 0, updated = 0, downloads = 0;
+
+        for (const auto& entry : reported) {
+            if (is_managed_patch(entry.first) && available.find(entry.first) == available.end()) {
+                delete_list += "|" + entry.first;
+                ++deleted;
+            }
+        }
+        if (deleted > 0) {
+            packets.push_back(make_packet(MessageType::TEXT_COMMAND, delete_list));
+        }
+
+        for (const auto& patch : patches) {
+            auto it = reported.find(patch.name);
+            if (it != reported.end() && it->second == patch.crc) {
+                continue;
+            }
+
+            std::string content;
+            if (patch.meta.size <= UPDATE_INLINE_LIMIT && read_whole_file(patch.path, content)) {
+                std::string message = "UPDATE_FILES|" + patch.name + "|" + std::to_string(content.size()) + "|";
+                message += content;
+                packets.push_back(make_packet(MessageType::TEXT_COMMAND, message));
+                ++updated;
+                continue;
+            }
+
+            download_list += "|" + patch.name + "|" + std::to_string(patch.meta.size);
+            ++downloads;
+        }
+        if (downloads > 0) {
+            packets.push_back(make_packet(MessageType::TEXT_COMMAND, download_list));
+        }
+
+        packets.push_back(make_packet(MessageType::TEXT_COMMAND, "CHECK_PATCHES|" + std::to_string(deleted) + "|" +
+                                      std::to_string(updated) + "|" + std::to_string(downloads)));
+    });
+}
+
+bool PatchSession::open_file_stream(std::string_view request, FileStream& stream, std::string& error) {
+    FieldTokenizer fields(request);
+    std::string_view name, offset_field, length_field;
+    uint64_t offset = 0;
+    uint64_t length = UINT64_MAX;
+    if (!fields.next(name) || !fields.next(offset_field) || !parse_uint64(offset_field, offset) ||
+        (fields.next(length_field) && !parse_uint64(length_field, length))) {
+        error = "请求格式错误";
+        return false;
+    }
+
+    if (!repository_.find(std::string(name), stream.file)) {
+        error = "文件不存在: " + std::string(name);
+        return false;
+    }
+
+    uint64_t filesize = stream.file.meta.size;
+    if (offset > filesize) {
+        error = "起始偏移超出文件大小: " + std::string(name);
+        return false;
+    }
+    stream.position = offset;
+    stream.end = offset + std::min(length, filesize - offset);
+    return true;
+}
+
+// 消息体格式: 文件名|起始偏移[|长度]，回复 FILE_BEGIN、若干 FILE_CHUNK / FILE_CHUNK_Z、FILE_END
+void PatchSession::handle_get_file(std::string_view body) {
+    auto stream = std::make_unique<FileStream>();
+    std::string error;
+    if (!open_file_stream(body, *stream, error)) {
+        send_error("GET_FILE " + error);
+        return;
+    }
+
+    Response& response = add_response();
+    response.packets.push_back(make_packet(MessageType::FILE_BEGIN,
+        stream->file.name + "|" + std::to_string(stream->file.meta.size) + "|" + std::to_string(stream->position) + "|" +
+        std::to_string(stream->file.crc)));
+    response.stream = std::move(stream);
+}
+
+// 消息体: StreamFrameHeader 后接 文件名|起始偏移[|长度]
+// 流不进响应队列，错误也直接发送，不必等前面的响应
+void PatchSession::handle_stream_get(std::string_view body) {
+    uint32_t id = 0;
+    std::string_view request;
+    if (!config_.multiplex || !split_stream_frame(body, id, request)) {
+        send_error("STREAM_GET 格式错误");
+        return;
+    }
+
+    std::string error;
+    auto stream = std::make_unique<MuxStream>();
+    stream->id = id;
+    stream->window = STREAM_INITIAL_WINDOW;
+    bool duplicate = std::any_of(streams_.begin(), streams_.end(),
+                                 [id](const std::unique_ptr<MuxStream>& other) { return other->id == id; });
+    if (duplicate) {
+        error = "流 ID 重复";
+    } else if (streams_.size() >= MUX_MAX_STREAMS) {
+        error = "同时进行的流过多";
+    } else if (open_file_stream(request, stream->file, error)) {
+        streams_.push_back(std::move(stream));
+        return;
+    }
+
+    std::string packet;
+    append_stream_packet(packet, MessageType::STREAM_ERROR, id, error);
+    enqueue(std::move(packet));
+}
+
+// 消息体: StreamFrameHeader 后接 uint32 增量，已经结束的流直接忽略
+void PatchSession::handle_window_update(std::string_view body) {
+    uint32_t id = 0;
+    std::string_view payload;
+    uint32_t increment = 0;
+    if (!split_stream_frame(body, id, payload) || payload.size() != sizeof(increment)) {
+        send_error("WINDOW_UPDATE 格式错误");
+        return;
+    }
+    std::memcpy(&increment, payload.data(), sizeof(increment));
+
+    for (auto& stream : streams_) {
+        if (stream->id == id) {
+            stream->window += increment;
+            break;
+        }
+    }
+}
+
+// 消息体格式: 文件名|分块大小| 后接 BlockSignature 数组
+void PatchSession::handle_delta_request(std::string_view body) {
+    FieldTokenizer fields(body);
+    std::string_view name, block_field;
+    uint64_t block_size = 0;
+    if (!fields.next(name) || !fields.next(block_field) || !parse_uint64(block_field, block_size) ||
+        block_size == 0 || block_size > DELTA_MAX_BLOCK_SIZE || fields.remainder().size() % sizeof(BlockSignature) != 0) {
+        send_error("DELTA_REQUEST 格式错误");
+        return;
+    }
+
+    PatchFile file;
+    if (!repository_.find(std::string(name), file)) {
+        send_error("文件不存在: " + std::string(name));
+        return;
+    }
+
+    std::string_view data = fields.remainder();
+    std::vector<BlockSignature> signatures(data.size() / sizeof(BlockSignature));
+    if (!signatures.empty()) {
+        std::memcpy(signatures.data(), data.data(), data.size());
+    }
+
+    // 在发送 DELTA_BEGIN 之前打开文件，打不开时客户端只会收到一个错误
+    auto delta = std::make_shared<DeltaGenerator>(file.path, std::move(signatures),
+                                                  static_cast<uint32_t>(block_size), FILE_CHUNK_SIZE);
+    if (!delta->open()) {
+        send_error("生成差量失败: " + file.name);
+        return;
+    }
+
+    Response& response = add_response();
+    response.packets.push_back(make_packet(MessageType::DELTA_BEGIN,
+        file.name + "|" + std::to_string(file.meta.size) + "|" + std::to_string(block_size) + "|" +
+        std::to_string(file.crc)));
+    response.delta = std::move(delta);
+}
+
+// 消息体为文件名，回复 MANIFEST|文件名| 后接序列化的清单
+void PatchSession::handle_get_manifest(std::string_view body) {
+    PatchFile file;
+    if (!repository_.find(std::string(body), file)) {
+        send_error("文件不存在: " + std::string(body));
+        return;
+    }
+
+    run_blocking([&repository = repository_, file](std::deque<std::string>& packets) {
+        auto tree = repository.merkle_tree(file);
+        if (!tree) {
+            packets.push_back(make_packet(MessageType::ERROR_RESPONSE, "无法生成清单: " + file.name));
+            return;
+        }
+        packets.push_back(make_packet(MessageType::MANIFEST, file.name + "|" + serialize_merkle_manifest(*tree)));
+    });
+}
+
+PatchSession::Response& PatchSession::add_response() {
+    responses_.push_back(std::make_unique<Response>());
+    return *responses_.back();
+}
+
+void PatchSession::run_blocking(std::function<void(std::deque<std::string>&)> job) {
+    Response* response = &add_response();
+    response->ready = false;
+
+    asio::post(blocking_pool_, [self = shared_from_this(), response, job = std::move(job)]() {
+        std::deque<std::string> packets;
+        job(packets);
+
+        asio::post(self->socket_.get_executor(), [self, response, packets = std::move(packets)]() mutable {
+            if (self->closed_) {
+                return;
+            }
+            response->packets = std::move(packets);
+            response->ready = true;
+            self->pump();
+        });
+    });
+}
+
+// 每批输出不超过发送队列的上限，这一批发完后 pump_response 才会再调用，
+// 最坏情况（没有可复用的分块）下占用的内存也与文件大小无关
+void PatchSession::generate_delta_batch(Response& response) {
+    response.ready = false;
+
+    asio::post(blocking_pool_, [self = shared_from_this(), response = &response, delta = response.delta]() {
+        std::deque<std::string> packets;
+        bool ok = delta->generate(SESSION_MAX_QUEUED_BYTES,
+            [&packets](uint32_t first_block, uint32_t block_count) {
+                DeltaCopy copy = { first_block, block_count };
+                packets.push_back(make_packet(MessageType::DELTA_COPY,
+                    std::string_view(reinterpret_cast<const char*>(&copy), sizeof(copy))));
+            },
+            [&packets](std::string_view literal) {
+                packets.push_back(make_packet(MessageType::DELTA_LITERAL, literal));
+            });
+        if (ok && delta->done()) {
+            packets.push_back(make_packet(MessageType::DELTA_END, std::string_view()));
+        }
+
+        asio::post(self->socket_.get_executor(), [self, response, ok, packets = std::move(packets)]() mutable {
+            if (self->closed_) {
+                return;
+            }
+            // DELTA_BEGIN 已经发出，中途读取失败和 read_chunk 一样只能断开连接
+            if (!ok) {
+                server_log("生成差量时读取文件失败，断开连接: " + self->peer_);
+                self->close();
+                return;
+            }
+            response->packets = std::move(packets);
+            response->ready = true;
+            self->pump();
+        });
+    });
+}
+
+void PatchSession::send_error(const std::string& message) {
+    add_response().packets.push_back(make_packet(MessageType::ERROR_RESPONSE, message));
+}
+
+// 响应队列和各个流轮流把数据搬进发送队列，队列有积压时停下，等写完成后再继续
+void PatchSession::pump() {
+    while (!closed_ && queued_bytes_ < SESSION_MAX_QUEUED_BYTES) {
+        bool progressed = pump_response();
+        if (!closed_ && queued_bytes_ < SESSION_MAX_QUEUED_BYTES) {
+            progressed = pump_stream() || progressed;
+        }
+        if (!progressed) {
+            break;
+        }
+    }
+
+    if (closed_) {
+        return;
+    }
+
+    if (reading_paused_ && responses_.size() < SESSION_MAX_PENDING_RESPONSES / 2) {
+        reading_paused_ = false;
+        do_read();
+    }
+    do_write();
+}
+
+// 按顺序发送响应队列最前面的一个数据包或数据块，没有可发送的内容时返回 false
+bool PatchSession::pump_response() {
+    while (!responses_.empty()) {
+        Response& response = *responses_.front();
+        if (!response.ready) {
+            return false;
+        }
+
+        if (!response.packets.empty()) {
+            enqueue(std::move(response.packets.front()));
+            response.packets.pop_front();
+            return true;
+        }
+        if (response.delta && !response.delta->done()) {
+            generate_delta_batch(response);
+            return false;
+        }
+        if (response.stream) {
+            if (!stream_next_chunk(*response.stream)) {
+                response.stream.reset();
+            }
+            return true;
+        }
+        responses_.pop_front();
+    }
+    return false;
+}
+
+// 从上次的位置开始找下一个窗口还没用完的流，发送它的一个数据块
+bool PatchSession::pump_stream() {
+    for (size_t checked = 0; checked < streams_.size(); ++checked) {
+        size_t index = (next_stream_ + checked) % streams_.size();
+        MuxStream& stream = *streams_[index];
+        bool finished = stream.begun && stream.file.position >= stream.file.end;
+        // STREAM_BEGIN 和 STREAM_END 不占窗口
+        if (stream.window <= 0 && stream.begun && !finished) {
+            continue;
+        }
+
+        std::string packet;
+        if (!stream.begun) {
+            stream.begun = true;
+            append_stream_packet(packet, MessageType::STREAM_BEGIN, stream.id,
+                stream.file.file.name + "|" + std::to_string(stream.file.file.meta.size) + "|" +
+                std::to_string(stream.file.position) + "|" + std::to_string(stream.file.file.crc));
+            next_stream_ = index;
+        } else if (finished) {
+            append_stream_packet(packet, MessageType::STREAM_END, stream.id, std::string_view());
+            streams_.erase(streams_.begin() + index);
+            next_stream_ = index;
+        } else {
+            if (!read_chunk(stream.file, stream.id, packet)) {
+                return false;
+            }
+            stream.window -= static_cast<int64_t>(packet.size() - PACKET_HEADER_SIZE - sizeof(StreamFrameHeader));
+            next_stream_ = index + 1;
+        }
+        enqueue(std::move(packet));
+        return true;
+    }
+    return false;
+}
+
+// 读取并排队下一个数据块，区间发完时排队 FILE_END 并返回 false
+bool PatchSession::stream_next_chunk(FileStream& stream) {
+    if (stream.position >= stream.end) {
+        enqueue(make_packet(MessageType::FILE_END, std::string_view()));
+        return false;
+    }
+
+    std::string packet;
+    if (!read_chunk(stream, 0, packet)) {
+        return false;
+    }
+    enqueue(std::move(packet));
+    return true;
+}
+
+// 数据块按 FILE_CHUNK_SIZE 对齐：续传时第一个块较短，之后每个块都能命中压缩缓存
+bool PatchSession::read_chunk(FileStream& stream, uint32_t stream_id, std::string& packet) {
+    // 文件在第一次读取时才打开，排队的请求不会占用文件句柄
+    if (!stream.input.is_open()) {
+        stream.input.open(stream.file.path, std::ios::binary);
+        stream.input.seekg(static_cast<std::streamoff>(stream.position));
+    }
+
+    uint64_t chunk_index = stream.position / FILE_CHUNK_SIZE;
+    size_t length = static_cast<size_t>(std::min<uint64_t>((chunk_index + 1) * FILE_CHUNK_SIZE, stream.end) -
+                                        stream.position);
+    bool whole_chunk = stream.position % FILE_CHUNK_SIZE == 0 &&
+                       (length == FILE_CHUNK_SIZE || stream.position + length == stream.file.meta.size);
+
+    // 直接读到数据包的消息体位置，省去一次拷贝
+    size_t prefix = stream_id != 0 ? sizeof(StreamFrameHeader) : 0;
+    if (!free_buffers_.empty()) {
+        packet = std::move(free_buffers_.back());
+        free_buffers_.pop_back();
+    }
+    packet.resize(PACKET_HEADER_SIZE + prefix + length);
+    char* data = &packet[PACKET_HEADER_SIZE + prefix];
+    if (!stream.input.read(data, static_cast<std::streamsize>(length))) {
+        server_log("读取文件失败: " + stream.file.path);
+        close();
+        return false;
+    }
+
+    PacketHeader header;
+    header.messageType = static_cast<uint16_t>(stream_id != 0 ? MessageType::STREAM_DATA : MessageType::FILE_CHUNK);
+    header.bodyLength = static_cast<uint32_t>(prefix + length);
+    std::memcpy(&packet[0], &header, PACKET_HEADER_SIZE);
+    if (stream_id != 0) {
+        StreamFrameHeader frame = { stream_id };
+        std::memcpy(&packet[PACKET_HEADER_SIZE], &frame, sizeof(frame));
+    }
+
+    if (config_.compress && whole_chunk) {
+        auto compressed = repository_.chunk_cache().get(stream.file.name, stream.file.version(), chunk_index,
+                                                        std::string_view(data, length));
+        if (compressed) {
+            packet.clear();
+            if (stream_id != 0) {
+                append_stream_packet(packet, MessageType::STREAM_DATA_Z, stream_id, *compressed);
+            } else {
+                append_packet(packet, MessageType::FILE_CHUNK_Z, *compressed);
+            }
+        }
+    }
+
+    stream.position += length;
+    return true;
+}
+
+void PatchSession::enqueue(std::string packet) {
+    queued_bytes_ += packet.size();
+    write_queue_.push_back(std::move(packet));
+}
+
+// 把队列中的数据包一次性取出，用一个 gather 写发送出去
+void PatchSession::do_write() {
+    if (closed_ || !writing_.empty() || write_queue_.empty()) {
+        return;
+    }
+
+    while (!write_queue_.empty() && writing_.size() < SESSION_MAX_GATHER_PACKETS) {
+        writing_.push_back(std::move(write_queue_.front()));
+        write_queue_.pop_front();
+    }
+
+    write_buffers_.clear();
+    for (const auto& packet : writing_) {
+        write_buffers_.push_back(asio::buffer(packet));
+    }
+
+    asio::async_write(socket_, write_buffers_, bind_handler_memory(handler_memory_,
+        [self = shared_from_this()](const asio::error_code& error, size_t /*bytes_transferred*/) {
+            if (error) {
+                self->close();
+                return;
+            }
+
+            // 发送完的缓冲区留给下一个数据块使用
+            for (auto& packet : self->writing_) {
+                self->queued_bytes_ -= packet.size();
+                if (self->free_buffers_.size() < SESSION_MAX_FREE_BUFFERS) {
+                    packet.clear();
+                    self->free_buffers_.push_back(std::move(packet));
+                }
+            }
+            self->writing_.clear();
+            self->pump();
+        }));
+}
+
+void PatchSession::close() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+
+    asio::error_code ec;
+    socket_.close(ec);
+    server_log("客户端已断开: " + peer_);
+}
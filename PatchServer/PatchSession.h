@@ -0,0 +1,119 @@
+#pragma once
+
+#include <asio.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include "Protocol.h"
+#include "PatchRepository.h"
+#include "ServerConfig.h"
+#include "DeltaSync.h"
+#include "HandlerMemory.h"
+
+// 一次聚合写最多合并的数据包数
+const size_t SESSION_MAX_GATHER_PACKETS = 64;
+// 发送队列中的字节数低于这个值时才继续从文件读取下一个数据块
+const size_t SESSION_MAX_QUEUED_BYTES = 4 * FILE_CHUNK_SIZE;
+// 排队的响应超过这个数时暂停读取客户端请求
+const size_t SESSION_MAX_PENDING_RESPONSES = 256;
+// 不超过这个大小的补丁直接用 UPDATE_FILES 内联发送，省去一次 GET_FILE 往返
+const uint64_t UPDATE_INLINE_LIMIT = 64 * 1024;
+
+// 单个客户端连接
+// 请求按到达顺序排成响应队列，依次发送，保证 FILE_BEGIN 到 FILE_END 之间不会插入其他文件的数据。
+// STREAM_GET 打开的流不进响应队列，各个流和响应队列轮流发送一个数据块，大文件不会挡住后面的小文件，
+// 每个流只在客户端给的窗口内发送。
+// 文件内容按 FILE_CHUNK_SIZE 流式读取，发送队列有积压时停止读取，内存占用与文件大小无关。
+// 扫描目录、生成差量和构造清单会阻塞，放到后台线程池执行，完成后回到连接所在的线程；
+// 差量指令同样分批生成，一批发完再生成下一批。
+class PatchSession : public std::enable_shared_from_this<PatchSession> {
+public:
+    PatchSession(asio::ip::tcp::socket socket, PatchRepository& repository, const ServerConfig& config,
+                 asio::thread_pool& blocking_pool);
+
+    void start();
+    // 连接所在 io_context 的执行器，会话的所有处理都在它上面进行
+    asio::any_io_executor executor() { return socket_.get_executor(); }
+
+private:
+    // GET_FILE 请求的文件区间
+    struct FileStream {
+        PatchFile file;
+        std::ifstream input;
+        uint64_t position;
+        uint64_t end;
+    };
+
+    // STREAM_GET 打开的流
+    struct MuxStream {
+        uint32_t id;
+        FileStream file;
+        int64_t window;      // 还可以发送的字节数，窗口为正时才发送下一个数据块
+        bool begun = false;  // 已发送 STREAM_BEGIN
+    };
+
+    struct Response {
+        std::deque<std::string> packets;       // 已构造好的数据包，先于文件内容发送
+        std::unique_ptr<FileStream> stream;    // 之后流式发送的文件区间，发完时追加 FILE_END
+        std::shared_ptr<DeltaGenerator> delta; // 分批生成的差量指令，全部生成后追加 DELTA_END
+        bool ready = true;                     // 后台计算完成前为 false
+    };
+
+    void do_read();
+    void handle_read_header(const asio::error_code& error);
+    void handle_read(const asio::error_code& error);
+    void handle_message(MessageType type, std::string_view body);
+
+    void handle_text_command(std::string_view message);
+    void handle_check_patches(std::string_view args);
+    void handle_get_file(std::string_view body);
+    void handle_delta_request(std::string_view body);
+    void handle_get_manifest(std::string_view body);
+    void handle_stream_get(std::string_view body);
+    void handle_window_update(std::string_view body);
+    // 解析 文件名|起始偏移[|长度] 并定位文件区间，失败时返回错误信息
+    bool open_file_stream(std::string_view request, FileStream& stream, std::string& error);
+
+    Response& add_response();
+    // 在后台线程池中构造响应的数据包，完成后按原来的位置发送
+    void run_blocking(std::function<void(std::deque<std::string>&)> job);
+    // 在后台线程池中生成下一批差量指令，发送队列有空间时由 pump_response 调用
+    void generate_delta_batch(Response& response);
+    void send_error(const std::string& message);
+
+    void pump();
+    bool pump_response();
+    bool pump_stream();
+    bool stream_next_chunk(FileStream& stream);
+    // 读取下一个数据块，stream_id 为 0 时构造 FILE_CHUNK(_Z)，否则构造 STREAM_DATA(_Z)
+    bool read_chunk(FileStream& stream, uint32_t stream_id, std::string& packet);
+    void enqueue(std::string packet);
+    void do_write();
+    void close();
+
+    HandlerMemory handler_memory_;   // 收发操作的内存，放在最前面，最后析构
+    asio::ip::tcp::socket socket_;
+    PatchRepository& repository_;
+    const ServerConfig& config_;
+    asio::thread_pool& blocking_pool_;
+    std::string peer_;
+
+    PacketHeader header_;
+    std::vector<char> body_;
+    bool reading_paused_;
+
+    std::deque<std::unique_ptr<Response>> responses_;
+    std::vector<std::unique_ptr<MuxStream>> streams_;
+    size_t next_stream_;     // 下一次从哪个流开始找可以发送的
+    std::deque<std::string> write_queue_;
+    std::vector<std::string> writing_;
+    std::vector<asio::const_buffer> write_buffers_;
+    std::vector<std::string> free_buffers_;
+    size_t queued_bytes_;
+    bool closed_;
+};
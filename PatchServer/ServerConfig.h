@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// 服务器配置
+struct ServerConfig {
+    std::string listen_address = "0.0.0.0";
+    std::string port = "12345";
+    std::string root = "Data";                 // 补丁目录，结构与客户端的 Data 目录相同
+    std::string public_ip = "127.0.0.1";       // SERVER_INFO 中告诉客户端的地址
+    std::string name = "Patch Server";
+    std::string notice;
+    size_t threads = 0;                        // 0 表示每个 CPU 核心一个线程
+    size_t chunk_cache_bytes = 256ull * 1024 * 1024;
+    size_t refresh_seconds = 10;               // CHECK_PATCHES 最多每隔这么久重新扫描一次补丁目录
+    bool compress = true;                      // 是否发送 FILE_CHUNK_Z
+    bool multiplex = true;                     // 是否接受 STREAM_GET，在 SERVER_INFO 中告诉客户端
+    std::vector<std::string> mirrors;          // 镜像服务器的 host:port，在 SERVER_INFO 中告诉客户端
+};
+
+// 带时间戳输出一行日志，可以在任意线程调用
+void server_log(const std::string& text);
@@ -0,0 +1,86 @@
+#include "PatchServer.h"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+// Compression.cpp 的解压用到了 stb_image 自带的 zlib 解码器
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+namespace {
+    void print_usage() {
+        std::cout <<
+            "用法: PatchServer [选项]\n"
+            "  --root <目录>        补丁目录，结构与客户端的 Data 目录相同（默认 Data）\n"
+            "  --listen <地址>      监听地址（默认 0.0.0.0）\n"
+            "  --port <端口>        监听端口（默认 12345）\n"
+            "  --threads <数量>     网络线程数，0 表示每个 CPU 核心一个（默认 0）\n"
+            "  --public-ip <地址>   SERVER_INFO 中告诉客户端的地址（默认 127.0.0.1）\n"
+            "  --name <名称>        服务器名称\n"
+            "  --notice <文本>      服务器通知\n"
+            "  --mirror <地址:端口> 镜像服务器，可以重复，在 SERVER_INFO 中告诉登录器\n"
+            "  --cache-mb <大小>    压缩块缓存大小，单位 MB（默认 256）\n"
+            "  --refresh <秒>       CHECK_PATCHES 重新扫描补丁目录的最短间隔，0 表示每次都扫描（默认 10）\n"
+            "  --no-compress        不发送压缩数据块\n"
+            "  --no-mux             不支持多路复用，客户端按顺序用 GET_FILE 下载\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+
+    ServerConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (option == "--no-compress") {
+            config.compress = false;
+        } else if (option == "--no-mux") {
+            config.multiplex = false;
+        } else if (option == "--help" || option == "-h") {
+            print_usage();
+            return 0;
+        } else if (has_value && option == "--root") {
+            config.root = argv[++i];
+        } else if (has_value && option == "--listen") {
+            config.listen_address = argv[++i];
+        } else if (has_value && option == "--port") {
+            config.port = argv[++i];
+        } else if (has_value && option == "--threads") {
+            config.threads = std::strtoul(argv[++i], nullptr, 10);
+        } else if (has_value && option == "--public-ip") {
+            config.public_ip = argv[++i];
+        } else if (has_value && option == "--name") {
+            config.name = argv[++i];
+        } else if (has_value && option == "--notice") {
+            config.notice = argv[++i];
+        } else if (has_value && option == "--mirror") {
+            config.mirrors.push_back(argv[++i]);
+        } else if (has_value && option == "--cache-mb") {
+            config.chunk_cache_bytes = std::strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (has_value && option == "--refresh") {
+            config.refresh_seconds = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            std::cout << "未知选项: " << option << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+
+    PatchServer server(config);
+    std::string error;
+    if (!server.start(error)) {
+        server_log(error);
+        return 1;
+    }
+    server.run();
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    std::atomic<uint64_t> g_allocations{ 0 };
+    thread_local bool t_excluded = false;
+}
+
+uint64_t allocation_count() {
+    return g_allocations.load(std::memory_order_relaxed);
+}
+
+void exclude_thread_from_allocation_count() {
+    t_excluded = true;
+}
+
+// operator new[] 和 nothrow 版本默认都会调用这里
+void* operator new(std::size_t size) {
+    if (!t_excluded) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void* p = std::malloc(size != 0 ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t /*size*/) noexcept {
+    std::free(p);
+}
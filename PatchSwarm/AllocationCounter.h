@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+
+// 进程内 operator new 的调用次数
+// PatchSwarm 替换了全局 operator new，用来比较两种虚拟客户端处理每个消息时的堆分配次数。
+uint64_t allocation_count();
+// 之后当前线程上的分配不计入 allocation_count，基准测试用它排除自己轮询统计和输出时的分配
+void exclude_thread_from_allocation_count();
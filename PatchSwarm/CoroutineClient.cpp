@@ -0,0 +1,132 @@
+#include "CoroutineClient.h"
+
+#if defined(ASIO_HAS_CO_AWAIT)
+
+#include <asio/experimental/awaitable_operators.hpp>
+
+using namespace asio::experimental::awaitable_operators;
+
+namespace {
+    // 出错时返回错误码而不是抛异常，和回调版的处理方式一致
+    constexpr auto use_nothrow_awaitable = asio::as_tuple(asio::use_awaitable);
+}
+
+CoroutineClient::CoroutineClient(asio::io_context& io_context,
+                                 const asio::ip::tcp::resolver::results_type& endpoints,
+                                 const SwarmOptions& options, SwarmStats& stats)
+    : SwarmSession(options, stats), socket_(io_context), write_signal_(io_context), endpoints_(endpoints) {}
+
+void CoroutineClient::start(std::chrono::steady_clock::duration delay) {
+    asio::co_spawn(socket_.get_executor(), run(shared_from_this(), delay), asio::detached);
+}
+
+asio::awaitable<void> CoroutineClient::run(std::shared_ptr<CoroutineClient> /*self*/,
+                                           std::chrono::steady_clock::duration delay) {
+    asio::steady_timer timer(socket_.get_executor());
+    timer.expires_after(delay);
+    co_await timer.async_wait(bind_handler_memory(handler_memory_, use_nothrow_awaitable));
+
+    begin();
+    co_await (session() || watchdog());
+}
+
+asio::awaitable<void> CoroutineClient::session() {
+    auto [connect_error, endpoint] = co_await asio::async_connect(
+        socket_, endpoints_, bind_handler_memory(handler_memory_, use_nothrow_awaitable));
+    if (connect_error) {
+        fail(SwarmError::CONNECT);
+        co_return;
+    }
+
+    asio::error_code ec;
+    socket_.set_option(asio::ip::tcp::no_delay(true), ec);
+
+    asio::co_spawn(socket_.get_executor(), writer(shared_from_this()), asio::detached);
+    connected();
+
+    while (state_ != State::DONE) {
+        auto [header_error, header_length] =
+            co_await asio::async_read(socket_, asio::buffer(&header_, PACKET_HEADER_SIZE),
+                                      bind_handler_memory(handler_memory_, use_nothrow_awaitable));
+        if (header_error) {
+            fail(SwarmError::DISCONNECTED);
+            co_return;
+        }
+        if (header_.bodyLength > MAX_BODY_LENGTH) {
+            fail(SwarmError::PROTOCOL);
+            co_return;
+        }
+
+        body_.resize(header_.bodyLength);
+        auto [body_error, body_length] =
+            co_await asio::async_read(socket_, asio::buffer(body_.data(), body_.size()),
+                                      bind_handler_memory(handler_memory_, use_nothrow_awaitable));
+        if (body_error) {
+            fail(SwarmError::DISCONNECTED);
+            co_return;
+        }
+
+        if (!handle_message(static_cast<MessageType>(header_.messageType),
+                            std::string_view(body_.data(), body_.size()))) {
+            fail(SwarmError::PROTOCOL);
+            co_return;
+        }
+    }
+}
+
+// 只检查最近一次收到数据的时间，超时后返回，|| 会取消还在进行的会话
+asio::awaitable<void> CoroutineClient::watchdog() {
+    asio::steady_timer timer(socket_.get_executor());
+    while (state_ != State::DONE) {
+        timer.expires_at(last_activity_ + options_.idle_timeout);
+        auto [error] = co_await timer.async_wait(bind_handler_memory(handler_memory_, use_nothrow_awaitable));
+        if (error || state_ == State::DONE) {
+            co_return;
+        }
+        if (std::chrono::steady_clock::now() - last_activity_ >= options_.idle_timeout) {
+            fail(state_ == State::CONNECTING ? SwarmError::CONNECT : SwarmError::TIMEOUT);
+            co_return;
+        }
+    }
+}
+
+// 把排队的请求一次聚合写出，写的同时收包循环可以继续排队，请求自然形成流水线
+asio::awaitable<void> CoroutineClient::writer(std::shared_ptr<CoroutineClient> /*self*/) {
+    while (state_ != State::DONE) {
+        if (write_queue_.empty()) {
+            write_signal_.expires_at(std::chrono::steady_clock::time_point::max());
+            co_await write_signal_.async_wait(bind_handler_memory(handler_memory_, use_nothrow_awaitable));
+            continue;
+        }
+
+        writing_.clear();
+        write_buffers_.clear();
+        while (!write_queue_.empty()) {
+            writing_.push_back(std::move(write_queue_.front()));
+            write_queue_.pop_front();
+        }
+        for (const auto& packet : writing_) {
+            write_buffers_.push_back(asio::buffer(packet));
+        }
+
+        auto [error, length] = co_await asio::async_write(
+            socket_, write_buffers_, bind_handler_memory(handler_memory_, use_nothrow_awaitable));
+        if (error) {
+            fail(SwarmError::DISCONNECTED);
+            co_return;
+        }
+    }
+}
+
+void CoroutineClient::send_packet(MessageType type, std::string_view body) {
+    write_queue_.push_back(make_packet(type, body));
+    write_signal_.cancel();
+}
+
+void CoroutineClient::close_transport() {
+    asio::error_code ec;
+    socket_.close(ec);
+    write_signal_.cancel();
+}
+
+#endif
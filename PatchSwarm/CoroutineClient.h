@@ -0,0 +1,51 @@
+#pragma once
+
+#include <asio.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include "Protocol.h"
+#include "SwarmSession.h"
+#include "HandlerMemory.h"
+
+// 需要 C++20 协程，编译器不支持时 --coroutine 不可用
+#if defined(ASIO_HAS_CO_AWAIT)
+
+// 协程版的无界面虚拟登录器
+// 连接、收包循环和发送循环都写成顺序执行的协程，不需要 shared_from_this 的回调链。
+// 会话协程和看门狗协程用 awaitable_operators 的 || 组合，空闲超时时会话被取消，会话结束时看门狗被取消。
+class CoroutineClient : public SwarmSession, public std::enable_shared_from_this<CoroutineClient> {
+public:
+    CoroutineClient(asio::io_context& io_context, const asio::ip::tcp::resolver::results_type& endpoints,
+                    const SwarmOptions& options, SwarmStats& stats);
+
+    // delay 之后开始连接，用于控制连接速率
+    void start(std::chrono::steady_clock::duration delay);
+
+private:
+    // self 参数让协程帧持有客户端，协程结束前对象不会被释放
+    asio::awaitable<void> run(std::shared_ptr<CoroutineClient> self, std::chrono::steady_clock::duration delay);
+    asio::awaitable<void> session();
+    asio::awaitable<void> watchdog();
+    asio::awaitable<void> writer(std::shared_ptr<CoroutineClient> self);
+
+    void send_packet(MessageType type, std::string_view body) override;
+    void close_transport() override;
+
+    HandlerMemory handler_memory_;   // 放在最前面，最后析构
+    asio::ip::tcp::socket socket_;
+    asio::steady_timer write_signal_;    // 发送队列为空时 writer 在这里等待，有数据时取消等待
+    const asio::ip::tcp::resolver::results_type& endpoints_;
+
+    PacketHeader header_;
+    std::vector<char> body_;
+    std::deque<std::string> write_queue_;
+    std::vector<std::string> writing_;
+    std::vector<asio::const_buffer> write_buffers_;
+};
+
+#endif
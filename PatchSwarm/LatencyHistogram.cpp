@@ -0,0 +1,77 @@
+#include "LatencyHistogram.h"
+
+namespace {
+    int floor_log2(uint64_t value) {
+        int bits = 0;
+        while (value >>= 1) {
+            ++bits;
+        }
+        return bits;
+    }
+}
+
+LatencyHistogram::LatencyHistogram() : count_(0), sum_(0), max_(0) {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+// 小于 32 的值每个值一个桶，之后每个 2 的幂区间按最高 4 位之后的比特分成 16 个桶
+size_t LatencyHistogram::bucket_index(uint64_t micros) {
+    if (micros < LINEAR_BUCKETS) {
+        return static_cast<size_t>(micros);
+    }
+
+    int exponent = floor_log2(micros);
+    size_t index = LINEAR_BUCKETS + static_cast<size_t>(exponent - 5) * SUB_BUCKETS +
+                   static_cast<size_t>((micros >> (exponent - 4)) & (SUB_BUCKETS - 1));
+    return index < BUCKET_COUNT ? index : BUCKET_COUNT - 1;
+}
+
+uint64_t LatencyHistogram::bucket_value(size_t index) {
+    if (index < LINEAR_BUCKETS) {
+        return index;
+    }
+
+    int exponent = static_cast<int>((index - LINEAR_BUCKETS) / SUB_BUCKETS) + 5;
+    uint64_t sub = (index - LINEAR_BUCKETS) % SUB_BUCKETS;
+    uint64_t width = 1ull << (exponent - 4);
+    uint64_t lower = (1ull << exponent) + sub * width;
+    return lower + width / 2;
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+    buckets_[bucket_index(micros)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(micros, std::memory_order_relaxed);
+
+    uint64_t current = max_.load(std::memory_order_relaxed);
+    while (micros > current && !max_.compare_exchange_weak(current, micros, std::memory_order_relaxed)) {
+    }
+}
+
+double LatencyHistogram::mean() const {
+    uint64_t total = count();
+    return total == 0 ? 0.0 : static_cast<double>(sum_.load(std::memory_order_relaxed)) / total;
+}
+
+uint64_t LatencyHistogram::percentile(double quantile) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+
+    // 排名从 1 开始，p50 是第 ceil(total * 0.5) 个值
+    uint64_t rank = static_cast<uint64_t>(quantile * total + 0.999999);
+    if (rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t value = bucket_value(i);
+            return value < max() ? value : max();
+        }
+    }
+    return max();
+}
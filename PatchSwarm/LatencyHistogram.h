@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// 对数分桶的延迟直方图，单位微秒
+// 每个 2 的幂区间再分成 16 个子桶，相对误差约 6%，占用内存固定，记录只是一次原子加法，
+// 所有线程可以同时记录同一个直方图。
+class LatencyHistogram {
+public:
+    // 2^40 微秒约 12 天，足够覆盖任何一次测试
+    static const size_t SUB_BUCKETS = 16;
+    static const size_t LINEAR_BUCKETS = 32;
+    static const size_t BUCKET_COUNT = LINEAR_BUCKETS + (40 - 5) * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    void record(uint64_t micros);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    double mean() const;
+    // quantile 取 0 到 1，返回所在桶的中间值
+    uint64_t percentile(double quantile) const;
+
+private:
+    static size_t bucket_index(uint64_t micros);
+    static uint64_t bucket_value(size_t index);
+
+    std::atomic<uint64_t> buckets_[BUCKET_COUNT];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
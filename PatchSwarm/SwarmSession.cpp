@@ -0,0 +1,199 @@
+#include "SwarmSession.h"
+#include "CommandParser.h"
+#include "Compression.h"
+#include <cstring>
+
+namespace {
+    uint64_t micros_since(std::chrono::steady_clock::time_point since) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - since).count());
+    }
+}
+
+SwarmSession::SwarmSession(const SwarmOptions& options, SwarmStats& stats)
+    : options_(options), stats_(stats), state_(State::CONNECTING), downloading_(false), pending_files_(0),
+      file_expected_(0), file_received_(0) {}
+
+// 开始连接时调用
+void SwarmSession::begin() {
+    started_ = phase_started_ = last_activity_ = std::chrono::steady_clock::now();
+    ++stats_.started;
+}
+
+// 连接建立后发送 INIT_SERVER_INFO
+void SwarmSession::connected() {
+    ++stats_.connected;
+    finish_phase(SwarmPhase::CONNECT, phase_started_);
+
+    state_ = State::SERVER_INFO;
+    phase_started_ = last_activity_ = std::chrono::steady_clock::now();
+    send_packet(MessageType::TEXT_COMMAND, "INIT_SERVER_INFO| N/A ");
+}
+
+bool SwarmSession::handle_message(MessageType type, std::string_view body) {
+    stats_.messages.fetch_add(1, std::memory_order_relaxed);
+    stats_.wire_bytes.fetch_add(PACKET_HEADER_SIZE + body.size(), std::memory_order_relaxed);
+    last_activity_ = std::chrono::steady_clock::now();
+
+    switch (type) {
+    case MessageType::TEXT_COMMAND:
+        return handle_text_command(body);
+    case MessageType::FILE_BEGIN:
+        return handle_file_begin(body);
+    case MessageType::FILE_CHUNK:
+        file_received_ += body.size();
+        stats_.payload_bytes.fetch_add(body.size(), std::memory_order_relaxed);
+        return true;
+    case MessageType::FILE_CHUNK_Z: {
+        // 默认只读块头里的原始长度，压测机的 CPU 留给网络
+        uint64_t size = 0;
+        if (options_.inflate) {
+            if (!inflate_chunk(body, inflate_buffer_)) {
+                return false;
+            }
+            size = inflate_buffer_.size();
+        } else {
+            CompressedChunkHeader chunk_header;
+            if (body.size() < sizeof(chunk_header)) {
+                return false;
+            }
+            std::memcpy(&chunk_header, body.data(), sizeof(chunk_header));
+            size = chunk_header.rawLength;
+        }
+        file_received_ += size;
+        stats_.payload_bytes.fetch_add(size, std::memory_order_relaxed);
+        return true;
+    }
+    case MessageType::FILE_END:
+        return handle_file_end();
+    case MessageType::ERROR_RESPONSE:
+        return false;
+    default:
+        return true;
+    }
+}
+
+bool SwarmSession::handle_text_command(std::string_view message) {
+    std::string_view args;
+    switch (parse_command(message, args)) {
+    case CommandType::SERVER_INFO:
+        if (state_ == State::SERVER_INFO) {
+            finish_phase(SwarmPhase::SERVER_INFO, phase_started_);
+            state_ = State::CHECK_PATCHES;
+            phase_started_ = std::chrono::steady_clock::now();
+            send_packet(MessageType::TEXT_COMMAND, options_.check_request);
+        }
+        return true;
+    case CommandType::UPDATE_FILES: {
+        FieldTokenizer fields(args);
+        std::string_view filename, size_field;
+        uint64_t filesize = 0;
+        if (!fields.next(filename) || !fields.next(size_field) || !parse_uint64(size_field, filesize) ||
+            fields.remainder().size() != filesize) {
+            return false;
+        }
+        ++stats_.files;
+        stats_.payload_bytes.fetch_add(filesize, std::memory_order_relaxed);
+        return true;
+    }
+    case CommandType::DOWNLOAD_FILES:
+        return handle_download_files(args);
+    case CommandType::CHECK_PATCHES:
+        // PatchServer 在校验回复的最后发送 CHECK_PATCHES|删除数|更新数|下载数
+        if (state_ == State::CHECK_PATCHES) {
+            finish_phase(SwarmPhase::CHECK_PATCHES, phase_started_);
+            state_ = State::WAITING;
+            check_done();
+        }
+        return true;
+    default:
+        return true;
+    }
+}
+
+// 和 Client 一样把所有 GET_FILE 一次发出，服务器按顺序回复
+bool SwarmSession::handle_download_files(std::string_view args) {
+    if (!options_.download) {
+        return true;
+    }
+
+    FieldTokenizer fields(args);
+    std::string_view name_field, size_field;
+    while (fields.next(name_field) && fields.next(size_field)) {
+        uint64_t filesize = 0;
+        if (!parse_uint64(size_field, filesize)) {
+            return false;
+        }
+
+        if (!downloading_) {
+            downloading_ = true;
+            download_started_ = std::chrono::steady_clock::now();
+        }
+        std::string request(name_field);
+        request += "|0";
+        send_packet(MessageType::GET_FILE, request);
+        ++pending_files_;
+    }
+    return true;
+}
+
+// 消息体格式: 文件名|文件大小|起始偏移
+bool SwarmSession::handle_file_begin(std::string_view body) {
+    FieldTokenizer fields(body);
+    std::string_view name_field, size_field, offset_field;
+    uint64_t filesize = 0;
+    uint64_t offset = 0;
+    if (!fields.next(name_field) || !fields.next(size_field) || !parse_uint64(size_field, filesize) ||
+        (fields.next(offset_field) && !parse_uint64(offset_field, offset)) || offset > filesize) {
+        return false;
+    }
+
+    file_expected_ = filesize - offset;
+    file_received_ = 0;
+    return true;
+}
+
+bool SwarmSession::handle_file_end() {
+    if (pending_files_ == 0 || file_received_ != file_expected_) {
+        return false;
+    }
+
+    --pending_files_;
+    ++stats_.files;
+    check_done();
+    return true;
+}
+
+void SwarmSession::check_done() {
+    if (state_ != State::WAITING || pending_files_ > 0) {
+        return;
+    }
+    if (downloading_) {
+        finish_phase(SwarmPhase::DOWNLOAD, download_started_);
+    }
+    succeed();
+}
+
+void SwarmSession::finish_phase(SwarmPhase phase, std::chrono::steady_clock::time_point since) {
+    stats_.phase(phase).record(micros_since(since));
+}
+
+void SwarmSession::succeed() {
+    finish_phase(SwarmPhase::TOTAL, started_);
+    ++stats_.completed;
+    finish();
+}
+
+void SwarmSession::fail(SwarmError error) {
+    if (state_ == State::DONE) {
+        return;
+    }
+    ++stats_.error(error);
+    ++stats_.failed;
+    finish();
+}
+
+void SwarmSession::finish() {
+    state_ = State::DONE;
+    close_transport();
+}
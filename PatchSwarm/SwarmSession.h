@@ -0,0 +1,78 @@
+#pragma once
+
+#include <asio.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include "Protocol.h"
+#include "SwarmStats.h"
+
+// 压测参数
+struct SwarmOptions {
+    std::string host = "127.0.0.1";
+    std::string port = "12345";
+    size_t clients = 100;
+    size_t threads = 4;
+    double connect_rate = 0;                        // 每秒启动的客户端数，0 表示全部同时启动
+    std::string check_request = "CHECK_PATCHES|\n"; // 所有虚拟客户端上报同一份本地补丁状态
+    std::chrono::seconds idle_timeout{ 30 };        // 这么久没有收到数据视为超时
+    bool download = true;                           // 为 false 时校验完就结束
+    bool inflate = false;                           // 是否真正解压 FILE_CHUNK_Z，默认只按块头统计
+    bool coroutine = false;                         // 使用 CoroutineClient 代替 VirtualClient
+};
+
+// 虚拟登录器的协议流程，与收发方式无关
+// 按登录器的顺序走完 连接 → INIT_SERVER_INFO → CHECK_PATCHES → 下载 的流程，
+// 使用与 Client 相同的包格式、命令解析和分块解压，但收到的文件内容只计数不落盘。
+// 回调版的 VirtualClient 和协程版的 CoroutineClient 只负责收发，处理完全相同，压测结果可以直接比较。
+class SwarmSession {
+public:
+    virtual ~SwarmSession() = default;
+
+protected:
+    enum class State {
+        CONNECTING,
+        SERVER_INFO,
+        CHECK_PATCHES,
+        WAITING,         // 校验回复已全部收到，等待文件下载完成
+        DONE
+    };
+
+    SwarmSession(const SwarmOptions& options, SwarmStats& stats);
+
+    // 收发方式由派生类实现
+    virtual void send_packet(MessageType type, std::string_view body) = 0;
+    virtual void close_transport() = 0;
+
+    void begin();
+    void connected();
+    // 返回 false 表示协议错误
+    bool handle_message(MessageType type, std::string_view body);
+    void succeed();
+    void fail(SwarmError error);
+
+    const SwarmOptions& options_;
+    SwarmStats& stats_;
+    State state_;
+    std::chrono::steady_clock::time_point last_activity_;
+
+private:
+    bool handle_text_command(std::string_view message);
+    bool handle_download_files(std::string_view args);
+    bool handle_file_begin(std::string_view body);
+    bool handle_file_end();
+    void check_done();
+    void finish_phase(SwarmPhase phase, std::chrono::steady_clock::time_point since);
+    void finish();
+
+    std::vector<char> inflate_buffer_;
+    std::chrono::steady_clock::time_point started_;
+    std::chrono::steady_clock::time_point phase_started_;     // 连接、SERVER_INFO、CHECK_PATCHES 阶段的开始时间
+    std::chrono::steady_clock::time_point download_started_;
+    bool downloading_;           // 已发出 GET_FILE
+    size_t pending_files_;       // 已请求还没收到 FILE_END 的文件数
+    uint64_t file_expected_;     // 当前文件应收到的字节数
+    uint64_t file_received_;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include "LatencyHistogram.h"
+
+// 一个虚拟客户端依次经历的阶段
+enum class SwarmPhase : size_t {
+    CONNECT,          // TCP 连接
+    SERVER_INFO,      // INIT_SERVER_INFO 发出到收到 SERVER_INFO
+    CHECK_PATCHES,    // CHECK_PATCHES 发出到收到服务器的校验结果
+    DOWNLOAD,         // 第一个 GET_FILE 发出到最后一个 FILE_END
+    TOTAL,            // 开始连接到全部完成
+    COUNT
+};
+
+enum class SwarmError : size_t {
+    CONNECT,          // 无法连接
+    TIMEOUT,          // 超过空闲超时没有收到任何数据
+    DISCONNECTED,     // 服务器中途断开
+    PROTOCOL,         // ERROR_RESPONSE 或格式错误的消息
+    COUNT
+};
+
+inline const char* phase_name(SwarmPhase phase) {
+    switch (phase) {
+    case SwarmPhase::CONNECT: return "connect";
+    case SwarmPhase::SERVER_INFO: return "server_info";
+    case SwarmPhase::CHECK_PATCHES: return "check_patches";
+    case SwarmPhase::DOWNLOAD: return "download";
+    case SwarmPhase::TOTAL: return "total";
+    default: return "unknown";
+    }
+}
+
+inline const char* error_name(SwarmError error) {
+    switch (error) {
+    case SwarmError::CONNECT: return "connect";
+    case SwarmError::TIMEOUT: return "timeout";
+    case SwarmError::DISCONNECTED: return "disconnected";
+    case SwarmError::PROTOCOL: return "protocol";
+    default: return "unknown";
+    }
+}
+
+// 所有虚拟客户端共享的统计，各个网络线程直接用原子操作更新
+struct SwarmStats {
+    LatencyHistogram phases[static_cast<size_t>(SwarmPhase::COUNT)];
+    std::atomic<uint64_t> errors[static_cast<size_t>(SwarmError::COUNT)] = {};
+
+    std::atomic<uint64_t> started{ 0 };
+    std::atomic<uint64_t> connected{ 0 };
+    std::atomic<uint64_t> completed{ 0 };
+    std::atomic<uint64_t> failed{ 0 };
+    std::atomic<uint64_t> wire_bytes{ 0 };       // 收到的字节数，含包头，压缩块按压缩后计算
+    std::atomic<uint64_t> payload_bytes{ 0 };    // 文件内容字节数，压缩块按解压后计算
+    std::atomic<uint64_t> files{ 0 };            // 收到的文件数，含 UPDATE_FILES 内联的文件
+    std::atomic<uint64_t> messages{ 0 };         // 收到的数据包数
+
+    LatencyHistogram& phase(SwarmPhase phase) { return phases[static_cast<size_t>(phase)]; }
+    std::atomic<uint64_t>& error(SwarmError error) { return errors[static_cast<size_t>(error)]; }
+};
@@ -0,0 +1,129 @@
+#include "VirtualClient.h"
+
+VirtualClient::VirtualClient(asio::io_context& io_context, const asio::ip::tcp::resolver::results_type& endpoints,
+                             const SwarmOptions& options, SwarmStats& stats)
+    : SwarmSession(options, stats), socket_(io_context), timer_(io_context), endpoints_(endpoints),
+      writing_(false) {}
+
+void VirtualClient::start(std::chrono::steady_clock::duration delay) {
+    timer_.expires_after(delay);
+    timer_.async_wait([self = shared_from_this()](const asio::error_code& error) {
+        if (!error) {
+            self->connect();
+        }
+    });
+}
+
+void VirtualClient::connect() {
+    begin();
+    arm_idle_timer();
+
+    asio::async_connect(socket_, endpoints_,
+        [self = shared_from_this()](const asio::error_code& error, const asio::ip::tcp::endpoint& /*endpoint*/) {
+            if (self->state_ == State::DONE) {
+                return;
+            }
+            if (error) {
+                self->fail(SwarmError::CONNECT);
+                return;
+            }
+
+            asio::error_code ec;
+            self->socket_.set_option(asio::ip::tcp::no_delay(true), ec);
+
+            self->do_read();
+            self->connected();
+        });
+}
+
+void VirtualClient::do_read() {
+    asio::async_read(socket_, asio::buffer(&header_, PACKET_HEADER_SIZE), bind_handler_memory(handler_memory_,
+        [self = shared_from_this()](const asio::error_code& error, size_t /*bytes_transferred*/) {
+            self->handle_read_header(error);
+        }));
+}
+
+void VirtualClient::handle_read_header(const asio::error_code& error) {
+    if (state_ == State::DONE) {
+        return;
+    }
+    if (error) {
+        fail(SwarmError::DISCONNECTED);
+        return;
+    }
+    if (header_.bodyLength > MAX_BODY_LENGTH) {
+        fail(SwarmError::PROTOCOL);
+        return;
+    }
+
+    body_.resize(header_.bodyLength);
+    asio::async_read(socket_, asio::buffer(body_.data(), body_.size()), bind_handler_memory(handler_memory_,
+        [self = shared_from_this()](const asio::error_code& error, size_t /*bytes_transferred*/) {
+            self->handle_read(error);
+        }));
+}
+
+void VirtualClient::handle_read(const asio::error_code& error) {
+    if (state_ == State::DONE) {
+        return;
+    }
+    if (error) {
+        fail(SwarmError::DISCONNECTED);
+        return;
+    }
+
+    if (!handle_message(static_cast<MessageType>(header_.messageType), std::string_view(body_.data(), body_.size()))) {
+        fail(SwarmError::PROTOCOL);
+        return;
+    }
+    if (state_ != State::DONE) {
+        do_read();
+    }
+}
+
+void VirtualClient::send_packet(MessageType type, std::string_view body) {
+    write_queue_.push_back(make_packet(type, body));
+    do_write();
+}
+
+void VirtualClient::do_write() {
+    if (writing_ || write_queue_.empty() || state_ == State::DONE) {
+        return;
+    }
+
+    writing_ = true;
+    asio::async_write(socket_, asio::buffer(write_queue_.front()), bind_handler_memory(handler_memory_,
+        [self = shared_from_this()](const asio::error_code& error, size_t /*bytes_transferred*/) {
+            self->writing_ = false;
+            if (self->state_ == State::DONE) {
+                return;
+            }
+            if (error) {
+                self->fail(SwarmError::DISCONNECTED);
+                return;
+            }
+            self->write_queue_.pop_front();
+            self->do_write();
+        }));
+}
+
+// 只检查最近一次收到数据的时间，不必为每个消息重新设置定时器
+void VirtualClient::arm_idle_timer() {
+    timer_.expires_at(last_activity_ + options_.idle_timeout);
+    timer_.async_wait(bind_handler_memory(handler_memory_, [self = shared_from_this()](const asio::error_code& error) {
+        if (error || self->state_ == State::DONE) {
+            return;
+        }
+        if (std::chrono::steady_clock::now() - self->last_activity_ >= self->options_.idle_timeout) {
+            self->fail(self->state_ == State::CONNECTING ? SwarmError::CONNECT : SwarmError::TIMEOUT);
+            return;
+        }
+        self->arm_idle_timer();
+    }));
+}
+
+void VirtualClient::close_transport() {
+    asio::error_code ec;
+    socket_.close(ec);
+    timer_.cancel();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <asio.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include "Protocol.h"
+#include "SwarmSession.h"
+#include "HandlerMemory.h"
+
+// 回调版的无界面虚拟登录器
+// 每个连接也不启动写盘线程，一个网络线程可以承载成千上万个虚拟客户端。
+class VirtualClient : public SwarmSession, public std::enable_shared_from_this<VirtualClient> {
+public:
+    VirtualClient(asio::io_context& io_context, const asio::ip::tcp::resolver::results_type& endpoints,
+                  const SwarmOptions& options, SwarmStats& stats);
+
+    // delay 之后开始连接，用于控制连接速率
+    void start(std::chrono::steady_clock::duration delay);
+
+private:
+    void connect();
+    void do_read();
+    void handle_read_header(const asio::error_code& error);
+    void handle_read(const asio::error_code& error);
+
+    void send_packet(MessageType type, std::string_view body) override;
+    void close_transport() override;
+    void do_write();
+    void arm_idle_timer();
+
+    HandlerMemory handler_memory_;   // 放在最前面，最后析构
+    asio::ip::tcp::socket socket_;
+    asio::steady_timer timer_;
+    const asio::ip::tcp::resolver::results_type& endpoints_;
+
+    PacketHeader header_;
+    std::vector<char> body_;
+    std::deque<std::string> write_queue_;
+    bool writing_;
+};
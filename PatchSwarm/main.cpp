@@ -0,0 +1,243 @@
+#include "VirtualClient.h"
+#include "CoroutineClient.h"
+#include "AllocationCounter.h"
+#include "PatchRepository.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+
+// Compression.cpp 的解压用到了 stb_image 自带的 zlib 解码器
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+namespace {
+    void print_usage() {
+        std::cout <<
+            "用法: PatchSwarm [选项]\n"
+            "  --server <地址>      服务器地址（默认 127.0.0.1）\n"
+            "  --port <端口>        服务器端口（默认 12345）\n"
+            "  --clients <数量>     虚拟客户端数（默认 100）\n"
+            "  --threads <数量>     网络线程数（默认 4）\n"
+            "  --rate <每秒>        每秒启动的客户端数，0 表示同时启动（默认 0）\n"
+            "  --data <目录>        按这个目录中的补丁上报 CHECK_PATCHES，省略时模拟全新安装\n"
+            "  --timeout <秒>       空闲超时（默认 30）\n"
+            "  --no-download        收到校验结果后就结束，不下载文件\n"
+            "  --inflate            真正解压压缩块，而不只是统计块头中的长度\n"
+            "  --coroutine          使用协程版虚拟客户端，与默认的回调版比较消息速率和堆分配\n";
+    }
+
+    // 与登录器相同的上报格式: CHECK_PATCHES|\n 文件名|CRC|\n ...
+    std::string build_check_request(const std::string& data_dir) {
+        PatchRepository repository(data_dir, 0);
+        repository.refresh();
+
+        std::string request = "CHECK_PATCHES|\n";
+        for (const auto& patch : repository.managed_patches()) {
+            request += patch.name + "|" + std::to_string(patch.crc) + "|\n";
+        }
+        return request;
+    }
+
+    std::string format_millis(uint64_t micros) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2) << micros / 1000.0;
+        return out.str();
+    }
+
+    double megabytes(uint64_t bytes) {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    // 连接建立和关闭都会分配内存，只在没有客户端开始或结束的秒里统计收发消息本身的堆分配
+    struct WarmAllocations {
+        uint64_t messages = 0;
+        uint64_t allocations = 0;
+    };
+
+    void print_report(SwarmStats& stats, const SwarmOptions& options, double seconds, double peak_connect_rate,
+                      uint64_t allocations, const WarmAllocations& warm) {
+        std::cout << "\n== 压测结果（" << (options.coroutine ? "协程版" : "回调版") << "）==\n";
+        std::cout << "客户端: " << options.clients << "  完成: " << stats.completed
+                  << "  失败: " << stats.failed << "  用时: " << std::fixed << std::setprecision(1)
+                  << seconds << " s\n";
+        std::cout << "连接速率: 平均 " << std::setprecision(1) << (seconds > 0 ? stats.connected / seconds : 0.0)
+                  << "/s  峰值 " << peak_connect_rate << "/s\n";
+        std::cout << "吞吐量: " << std::setprecision(2) << (seconds > 0 ? megabytes(stats.wire_bytes) / seconds : 0.0)
+                  << " MB/s 网络  " << (seconds > 0 ? megabytes(stats.payload_bytes) / seconds : 0.0)
+                  << " MB/s 文件内容  共 " << stats.files << " 个文件\n";
+        uint64_t messages = stats.messages;
+        std::cout << "消息: " << messages << "  " << std::setprecision(0) << (seconds > 0 ? messages / seconds : 0.0)
+                  << "/s  堆分配: " << allocations << "  每个消息 " << std::setprecision(2)
+                  << (messages > 0 ? static_cast<double>(allocations) / messages : 0.0) << "\n";
+        std::cout << "稳定阶段: 消息 " << warm.messages << "  堆分配 " << warm.allocations << "  每个消息 "
+                  << (warm.messages > 0 ? static_cast<double>(warm.allocations) / warm.messages : 0.0) << "\n\n";
+
+        std::cout << std::left << std::setw(16) << "阶段(ms)" << std::right << std::setw(10) << "次数"
+                  << std::setw(12) << "p50" << std::setw(12) << "p99" << std::setw(12) << "p999"
+                  << std::setw(12) << "max" << "\n";
+        for (size_t i = 0; i < static_cast<size_t>(SwarmPhase::COUNT); ++i) {
+            const LatencyHistogram& histogram = stats.phases[i];
+            std::cout << std::left << std::setw(16) << phase_name(static_cast<SwarmPhase>(i))
+                      << std::right << std::setw(10) << histogram.count()
+                      << std::setw(12) << format_millis(histogram.percentile(0.50))
+                      << std::setw(12) << format_millis(histogram.percentile(0.99))
+                      << std::setw(12) << format_millis(histogram.percentile(0.999))
+                      << std::setw(12) << format_millis(histogram.max()) << "\n";
+        }
+
+        std::cout << "\n错误:";
+        for (size_t i = 0; i < static_cast<size_t>(SwarmError::COUNT); ++i) {
+            std::cout << " " << error_name(static_cast<SwarmError>(i)) << " " << stats.errors[i];
+        }
+        std::cout << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+
+    SwarmOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (option == "--no-download") {
+            options.download = false;
+        } else if (option == "--inflate") {
+            options.inflate = true;
+        } else if (option == "--coroutine") {
+#if defined(ASIO_HAS_CO_AWAIT)
+            options.coroutine = true;
+#else
+            std::cout << "这个版本编译时没有启用 C++20 协程，不支持 --coroutine" << std::endl;
+            return 1;
+#endif
+        } else if (option == "--help" || option == "-h") {
+            print_usage();
+            return 0;
+        } else if (has_value && option == "--server") {
+            options.host = argv[++i];
+        } else if (has_value && option == "--port") {
+            options.port = argv[++i];
+        } else if (has_value && option == "--clients") {
+            options.clients = std::strtoul(argv[++i], nullptr, 10);
+        } else if (has_value && option == "--threads") {
+            options.threads = std::strtoul(argv[++i], nullptr, 10);
+        } else if (has_value && option == "--rate") {
+            options.connect_rate = std::strtod(argv[++i], nullptr);
+        } else if (has_value && option == "--data") {
+            options.check_request = build_check_request(argv[++i]);
+        } else if (has_value && option == "--timeout") {
+            options.idle_timeout = std::chrono::seconds(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            std::cout << "未知选项: " << option << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+    if (options.clients == 0 || options.threads == 0) {
+        print_usage();
+        return 1;
+    }
+
+    asio::ip::tcp::resolver::results_type endpoints;
+    try {
+        asio::io_context resolve_context;
+        asio::ip::tcp::resolver resolver(resolve_context);
+        endpoints = resolver.resolve(options.host, options.port);
+    }
+    catch (const std::system_error& e) {
+        std::cout << "无法解析服务器地址: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // 和服务器一样每个线程一个 io_context，虚拟客户端轮流分配
+    SwarmStats stats;
+    std::vector<std::unique_ptr<asio::io_context>> contexts;
+    for (size_t i = 0; i < options.threads; ++i) {
+        contexts.push_back(std::make_unique<asio::io_context>(1));
+    }
+    // 从创建客户端开始统计堆分配，两种客户端的创建开销也计算在内
+    uint64_t allocations_before = allocation_count();
+    for (size_t i = 0; i < options.clients; ++i) {
+        auto delay = options.connect_rate > 0
+            ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                  std::chrono::duration<double>(i / options.connect_rate))
+            : std::chrono::steady_clock::duration::zero();
+        asio::io_context& context = *contexts[i % contexts.size()];
+#if defined(ASIO_HAS_CO_AWAIT)
+        if (options.coroutine) {
+            std::make_shared<CoroutineClient>(context, endpoints, options, stats)->start(delay);
+            continue;
+        }
+#endif
+        std::make_shared<VirtualClient>(context, endpoints, options, stats)->start(delay);
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (auto& context : contexts) {
+        threads.emplace_back([context = context.get()]() { context->run(); });
+    }
+
+    // 每秒输出一次进度
+    uint64_t last_connected = 0;
+    uint64_t last_wire_bytes = 0;
+    uint64_t last_started = 0;
+    uint64_t last_finished = 0;
+    uint64_t last_messages = 0;
+    uint64_t last_allocations = allocation_count();
+    WarmAllocations warm;
+    double peak_connect_rate = 0;
+    while (stats.completed + stats.failed < options.clients) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        uint64_t allocations = allocation_count();
+        uint64_t messages = stats.messages;
+        uint64_t started_clients = stats.started;
+        uint64_t finished = stats.completed + stats.failed;
+        if (started_clients == last_started && finished == last_finished) {
+            warm.messages += messages - last_messages;
+            warm.allocations += allocations - last_allocations;
+        }
+
+        uint64_t connected = stats.connected;
+        uint64_t wire_bytes = stats.wire_bytes;
+        double connect_rate = static_cast<double>(connected - last_connected);
+        peak_connect_rate = std::max(peak_connect_rate, connect_rate);
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::cout << std::fixed << std::setprecision(0) << "[" << elapsed << "s] 连接 " << connect_rate
+                  << "/s  进行中 " << stats.started - stats.completed - stats.failed
+                  << "  完成 " << stats.completed << "  失败 " << stats.failed
+                  << std::setprecision(2) << "  " << megabytes(wire_bytes - last_wire_bytes) << " MB/s" << std::endl;
+
+        last_connected = connected;
+        last_wire_bytes = wire_bytes;
+        last_started = started_clients;
+        last_finished = finished;
+        last_messages = messages;
+        // 输出进度本身的分配不算在下一秒里
+        last_allocations = allocation_count();
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    uint64_t allocations = allocation_count() - allocations_before;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    print_report(stats, options, seconds, peak_connect_rate, allocations, warm);
+    return stats.failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,150 @@
+#include "GameManager.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <future>
+#include <cstdlib>
+#include <filesystem>
+
+// Compression.cpp 的解压用到了 stb_image 自带的 zlib 解码器
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+namespace {
+    // 与 FileTransfer.cpp 中的补丁目录相同
+    const char* const DATA_PATH = ".\\Data";
+
+    void print_usage() {
+        std::cout <<
+            "用法: TraceReplay <轨迹文件> [选项]\n"
+            "  --paced              按录制时的间隔回放，默认尽快回放\n"
+            "  --repeat <次数>      重复回放的次数（默认 1），报告每次和最快一次的结果\n"
+            "回放会把文件写到当前目录的 Data 下，请在单独的空目录中运行，\n"
+            "每次回放前都会删除上一次写出的 Data 目录，保证本地状态和录制时一样。\n";
+    }
+
+    double megabytes(uint64_t bytes) {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    // 取出回放期间客户端发出的事件，只关心错误
+    size_t drain_errors() {
+        size_t errors = 0;
+        ClientEvent event;
+        while (poll_client_event(event)) {
+            if (event.type == ClientEventType::ERROR_MESSAGE) {
+                std::cout << "  错误: " << event.text << "\n";
+                ++errors;
+            }
+        }
+        return errors;
+    }
+
+    // 回放一次，事件队列容量有限，等待期间一直取出事件
+    ReplayResult run_once(const std::string& path, bool paced, size_t& errors) {
+        auto client = std::make_shared<Client>();
+        std::promise<ReplayResult> done;
+        auto future = done.get_future();
+        client->start_replay(path, paced, [&done](const ReplayResult& result) { done.set_value(result); });
+
+        while (future.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+            errors += drain_errors();
+        }
+        ReplayResult result = future.get();
+        errors += drain_errors();
+        return result;
+    }
+
+    void print_result(size_t run, const ReplayResult& result, size_t errors) {
+        double seconds = result.seconds > 0 ? result.seconds : 1e-9;
+        std::cout << "[" << run << "] " << result.packets << " 个数据包  " << std::fixed << std::setprecision(2)
+                  << megabytes(result.bytes) << " MB  " << std::setprecision(3) << result.seconds << " s  "
+                  << std::setprecision(2) << megabytes(result.bytes) / seconds << " MB/s  "
+                  << std::setprecision(0) << result.packets / seconds << " 包/s\n"
+                  << "    出站: 一致 " << result.outbound_matched << "  不一致 " << result.outbound_mismatched
+                  << "  缺少 " << result.outbound_missing << "  多出 " << result.outbound_extra
+                  << "  错误 " << errors << "\n"
+                  << "    跳过的分段下载: " << result.segmented_skipped << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+
+    std::string path;
+    bool paced = false;
+    size_t repeat = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (option == "--paced") {
+            paced = true;
+        } else if (option == "--help" || option == "-h") {
+            print_usage();
+            return 0;
+        } else if (has_value && option == "--repeat") {
+            repeat = std::strtoul(argv[++i], nullptr, 10);
+        } else if (path.empty() && option.rfind("--", 0) != 0) {
+            path = option;
+        } else {
+            std::cout << "未知选项: " << option << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+    if (path.empty() || repeat == 0) {
+        print_usage();
+        return 1;
+    }
+
+    // 本地已有文件时客户端会改走续传或差量更新，发出的请求就和录制时对不上了
+    if (std::filesystem::exists(DATA_PATH)) {
+        std::cout << "当前目录已有 Data 目录，请在空目录中运行" << std::endl;
+        return 1;
+    }
+
+    // 和登录器一样由一个网络线程运行 global_io_context，回放之间保持运行
+    auto work = asio::make_work_guard(global_io_context);
+    std::thread network_thread([]() { global_io_context.run(); });
+
+    bool diverged = false;
+    double best = 0;
+    for (size_t run = 1; run <= repeat; ++run) {
+        std::error_code ec;
+        std::filesystem::remove_all(DATA_PATH, ec);
+
+        size_t errors = 0;
+        ReplayResult result = run_once(path, paced, errors);
+        if (!result.error.empty()) {
+            std::cout << result.error << std::endl;
+            diverged = true;
+            break;
+        }
+
+        print_result(run, result, errors);
+        if (result.outbound_mismatched || result.outbound_missing || result.outbound_extra || errors) {
+            diverged = true;
+        }
+        if (best == 0 || result.seconds < best) {
+            best = result.seconds;
+        }
+    }
+    if (repeat > 1 && best > 0) {
+        std::cout << "最快一次: " << std::fixed << std::setprecision(3) << best << " s" << std::endl;
+    }
+
+    ChunkPoolStats pool = g_chunk_pool.stats();
+    std::cout << "数据块缓冲池: 申请 " << pool.allocated << "  峰值 " << pool.high_water << "  取块 " << pool.acquires
+              << "  等待 " << pool.stalls << " 次 " << std::setprecision(1) << pool.stall_us / 1000.0 << " ms" << std::endl;
+
+    work.reset();
+    global_io_context.stop();
+    network_thread.join();
+
+    // 出站数据包与录制时不一致说明协议处理的行为变了，返回非零便于在脚本中发现
+    return diverged ? 2 : 0;
+}
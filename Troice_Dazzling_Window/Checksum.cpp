@@ -0,0 +1,414 @@
+#include "Checksum.h"
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CHECKSUM_X86 1
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CHECKSUM_TARGET_SSE42
+#else
+#include <cpuid.h>
+#define CHECKSUM_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#endif
+
+namespace {
+    // ---------------------------------------------------------------------
+    // CRC32C
+
+    const uint32_t CRC32C_POLY = 0x82F63B78;   // 反射后的 Castagnoli 多项式
+
+    // slicing-by-8 查表，每次处理 8 个字节
+    struct Crc32cTable {
+        uint32_t table[8][256];
+
+        Crc32cTable() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int j = 0; j < 8; ++j) {
+                    crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+                }
+                table[0][i] = crc;
+            }
+            for (uint32_t i = 0; i < 256; ++i) {
+                for (int k = 1; k < 8; ++k) {
+                    table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+                }
+            }
+        }
+    };
+
+    const Crc32cTable& crc_table() {
+        static const Crc32cTable table;
+        return table;
+    }
+
+    // GF(2) 上的 32x32 矩阵运算，用于把 CRC 向后“平移”若干个零字节
+    uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec) {
+        uint32_t sum = 0;
+        while (vec) {
+            if (vec & 1) sum ^= *mat;
+            vec >>= 1;
+            ++mat;
+        }
+        return sum;
+    }
+
+    void gf2_matrix_square(uint32_t* square, const uint32_t* mat) {
+        for (int n = 0; n < 32; ++n) {
+            square[n] = gf2_matrix_times(mat, mat[n]);
+        }
+    }
+
+    // 构造“追加 len 个零字节”的线性算子，len 必须是 2 的幂
+    void crc32c_zeros_op(uint32_t* even, uint64_t len) {
+        uint32_t odd[32];
+
+        // 一个零比特
+        odd[0] = CRC32C_POLY;
+        uint32_t row = 1;
+        for (int n = 1; n < 32; ++n) {
+            odd[n] = row;
+            row <<= 1;
+        }
+
+        gf2_matrix_square(even, odd);   // 两个零比特
+        gf2_matrix_square(odd, even);   // 四个零比特
+
+        // 第一次平方得到一个零字节，之后每次平方长度翻倍
+        do {
+            gf2_matrix_square(even, odd);
+            len >>= 1;
+            if (len == 0) return;
+            gf2_matrix_square(odd, even);
+            len >>= 1;
+        } while (len);
+
+        for (int n = 0; n < 32; ++n) {
+            even[n] = odd[n];
+        }
+    }
+
+    // 把算子展开成按字节查表的形式
+    struct Crc32cShift {
+        uint32_t table[4][256];
+
+        explicit Crc32cShift(uint64_t len) {
+            uint32_t op[32];
+            crc32c_zeros_op(op, len);
+            for (uint32_t n = 0; n < 256; ++n) {
+                table[0][n] = gf2_matrix_times(op, n);
+                table[1][n] = gf2_matrix_times(op, n << 8);
+                table[2][n] = gf2_matrix_times(op, n << 16);
+                table[3][n] = gf2_matrix_times(op, n << 24);
+            }
+        }
+
+        uint32_t apply(uint32_t crc) const {
+            return table[0][crc & 0xFF] ^ table[1][(crc >> 8) & 0xFF] ^
+                   table[2][(crc >> 16) & 0xFF] ^ table[3][crc >> 24];
+        }
+    };
+
+    uint32_t crc32c_portable(uint32_t crc, const unsigned char* p, size_t size) {
+        const auto& t = crc_table().table;
+
+        while (size >= 8) {
+            uint32_t low, high;
+            std::memcpy(&low, p, 4);
+            std::memcpy(&high, p + 4, 4);
+            low ^= crc;
+            crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^
+                  t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+                  t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^
+                  t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+            p += 8;
+            size -= 8;
+        }
+        while (size--) {
+            crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+        }
+        return crc;
+    }
+
+#ifdef CHECKSUM_X86
+    // crc32 指令延迟 3 个周期、吞吐 1 个周期，三路交错计算才能跑满
+    const size_t CRC_LONG = 8192;
+    const size_t CRC_SHORT = 256;
+
+    const Crc32cShift& crc_long_shift() {
+        static const Crc32cShift shift(CRC_LONG);
+        return shift;
+    }
+
+    const Crc32cShift& crc_short_shift() {
+        static const Crc32cShift shift(CRC_SHORT);
+        return shift;
+    }
+
+    CHECKSUM_TARGET_SSE42
+    uint32_t crc32c_sse42(uint32_t crc, const unsigned char* p, size_t size) {
+#if defined(_M_X64) || defined(__x86_64__)
+        uint64_t crc64 = crc;
+
+        // 三段并行，之后用查表把前两段平移后合并
+        const Crc32cShift* shifts[2] = { &crc_long_shift(), &crc_short_shift() };
+        const size_t blocks[2] = { CRC_LONG, CRC_SHORT };
+        for (int level = 0; level < 2; ++level) {
+            const size_t block = blocks[level];
+            while (size >= block * 3) {
+                uint64_t crc1 = 0, crc2 = 0;
+                const unsigned char* end = p + block;
+                do {
+                    uint64_t v0, v1, v2;
+                    std::memcpy(&v0, p, 8);
+                    std::memcpy(&v1, p + block, 8);
+                    std::memcpy(&v2, p + block * 2, 8);
+                    crc64 = _mm_crc32_u64(crc64, v0);
+                    crc1 = _mm_crc32_u64(crc1, v1);
+                    crc2 = _mm_crc32_u64(crc2, v2);
+                    p += 8;
+                } while (p < end);
+                crc64 = shifts[level]->apply(static_cast<uint32_t>(crc64)) ^ crc1;
+                crc64 = shifts[level]->apply(static_cast<uint32_t>(crc64)) ^ crc2;
+                p += block * 2;
+                size -= block * 3;
+            }
+        }
+
+        while (size >= 8) {
+            uint64_t value;
+            std::memcpy(&value, p, 8);
+            crc64 = _mm_crc32_u64(crc64, value);
+            p += 8;
+            size -= 8;
+        }
+        crc = static_cast<uint32_t>(crc64);
+#endif
+        while (size >= 4) {
+            uint32_t value;
+            std::memcpy(&value, p, 4);
+            crc = _mm_crc32_u32(crc, value);
+            p += 4;
+            size -= 4;
+        }
+        while (size--) {
+            crc = _mm_crc32_u8(crc, *p++);
+        }
+        return crc;
+    }
+
+    bool detect_sse42() {
+#ifdef _MSC_VER
+        int info[4] = {};
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#else
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+        return (ecx & bit_SSE4_2) != 0;
+#endif
+    }
+#endif
+
+    // 运行时根据 CPU 选择实现，只检测一次
+    typedef uint32_t (*Crc32cFunction)(uint32_t, const unsigned char*, size_t);
+
+    Crc32cFunction select_crc32c() {
+#ifdef CHECKSUM_X86
+        if (detect_sse42()) {
+            return crc32c_sse42;
+        }
+#endif
+        return crc32c_portable;
+    }
+
+    Crc32cFunction crc32c_impl() {
+        static const Crc32cFunction impl = select_crc32c();
+        return impl;
+    }
+
+    // ---------------------------------------------------------------------
+    // 64 位哈希
+
+    const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+    const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+    const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+    const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+    const uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+    inline uint64_t rotl64(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t read64(const unsigned char* p) {
+        uint64_t value;
+        std::memcpy(&value, p, 8);
+        return value;
+    }
+
+    inline uint32_t read32(const unsigned char* p) {
+        uint32_t value;
+        std::memcpy(&value, p, 4);
+        return value;
+    }
+
+    inline uint64_t hash_round(uint64_t acc, uint64_t input) {
+        acc += input * PRIME2;
+        acc = rotl64(acc, 31);
+        return acc * PRIME1;
+    }
+
+    inline uint64_t merge_round(uint64_t acc, uint64_t value) {
+        acc ^= hash_round(0, value);
+        return acc * PRIME1 + PRIME4;
+    }
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t size) {
+    return ~crc32c_impl()(~crc, static_cast<const unsigned char*>(data), size);
+}
+
+uint32_t crc32c_software(uint32_t crc, const void* data, size_t size) {
+    return ~crc32c_portable(~crc, static_cast<const unsigned char*>(data), size);
+}
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+    if (len2 == 0) {
+        return crc1;
+    }
+    uint32_t even[32];
+    uint32_t odd[32];
+
+    odd[0] = CRC32C_POLY;
+    uint32_t row = 1;
+    for (int n = 1; n < 32; ++n) {
+        odd[n] = row;
+        row <<= 1;
+    }
+    gf2_matrix_square(even, odd);
+    gf2_matrix_square(odd, even);
+
+    // 按 len2 的二进制位逐个施加 1、2、4...个零字节的算子
+    do {
+        gf2_matrix_square(even, odd);
+        if (len2 & 1) crc1 = gf2_matrix_times(even, crc1);
+        len2 >>= 1;
+        if (len2 == 0) break;
+        gf2_matrix_square(odd, even);
+        if (len2 & 1) crc1 = gf2_matrix_times(odd, crc1);
+        len2 >>= 1;
+    } while (len2);
+
+    return crc1 ^ crc2;
+}
+
+bool crc32c_hardware_available() {
+#ifdef CHECKSUM_X86
+    return crc32c_impl() != crc32c_portable;
+#else
+    return false;
+#endif
+}
+
+uint64_t fast_hash64(const void* data, size_t size, uint64_t seed) {
+    FastHash64 hash(seed);
+    hash.update(data, size);
+    return hash.digest();
+}
+
+FastHash64::FastHash64(uint64_t seed) {
+    reset(seed);
+}
+
+void FastHash64::reset(uint64_t seed) {
+    seed_ = seed;
+    v_[0] = seed + PRIME1 + PRIME2;
+    v_[1] = seed + PRIME2;
+    v_[2] = seed;
+    v_[3] = seed - PRIME1;
+    total_ = 0;
+    buffered_ = 0;
+}
+
+void FastHash64::update(const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    total_ += size;
+
+    // 先补齐上次剩下的不足 32 字节的部分
+    if (buffered_ > 0) {
+        size_t take = 32 - buffered_;
+        if (take > size) take = size;
+        std::memcpy(buffer_ + buffered_, p, take);
+        buffered_ += take;
+        p += take;
+        size -= take;
+        if (buffered_ < 32) {
+            return;
+        }
+        v_[0] = hash_round(v_[0], read64(buffer_));
+        v_[1] = hash_round(v_[1], read64(buffer_ + 8));
+        v_[2] = hash_round(v_[2], read64(buffer_ + 16));
+        v_[3] = hash_round(v_[3], read64(buffer_ + 24));
+        buffered_ = 0;
+    }
+
+    uint64_t v1 = v_[0], v2 = v_[1], v3 = v_[2], v4 = v_[3];
+    while (size >= 32) {
+        v1 = hash_round(v1, read64(p));
+        v2 = hash_round(v2, read64(p + 8));
+        v3 = hash_round(v3, read64(p + 16));
+        v4 = hash_round(v4, read64(p + 24));
+        p += 32;
+        size -= 32;
+    }
+    v_[0] = v1; v_[1] = v2; v_[2] = v3; v_[3] = v4;
+
+    if (size > 0) {
+        std::memcpy(buffer_, p, size);
+        buffered_ = size;
+    }
+}
+
+uint64_t FastHash64::digest() const {
+    uint64_t h;
+    if (total_ >= 32) {
+        h = rotl64(v_[0], 1) + rotl64(v_[1], 7) + rotl64(v_[2], 12) + rotl64(v_[3], 18);
+        h = merge_round(h, v_[0]);
+        h = merge_round(h, v_[1]);
+        h = merge_round(h, v_[2]);
+        h = merge_round(h, v_[3]);
+    } else {
+        h = seed_ + PRIME5;
+    }
+    h += total_;
+
+    const unsigned char* p = buffer_;
+    size_t size = buffered_;
+    while (size >= 8) {
+        h ^= hash_round(0, read64(p));
+        h = rotl64(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+        size -= 8;
+    }
+    if (size >= 4) {
+        h ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+        h = rotl64(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+        size -= 4;
+    }
+    while (size > 0) {
+        h ^= (*p) * PRIME5;
+        h = rotl64(h, 11) * PRIME1;
+        ++p;
+        --size;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC32C（Castagnoli 多项式），结果与编译器和标准库无关，可以和服务器直接比较。
+// 支持分段计算: crc32c(crc32c(0, a, n), b, m) == crc32c(0, ab, n + m)
+uint32_t crc32c(uint32_t crc, const void* data, size_t size);
+
+// 合并两段数据的 CRC32C: crc1 是前段，crc2 是长度为 len2 的后段
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+
+// 当前 CPU 是否支持 SSE4.2 的 crc32 指令
+bool crc32c_hardware_available();
+
+// 始终使用查表实现的 CRC32C，结果与 crc32c 相同，用于基准测试中和硬件实现对比
+uint32_t crc32c_software(uint32_t crc, const void* data, size_t size);
+
+// 快速的 64 位非加密哈希（与 XXH64 算法相同），用于分块签名和大文件校验
+uint64_t fast_hash64(const void* data, size_t size, uint64_t seed = 0);
+
+// fast_hash64 的流式版本，数据可以分多次传入
+class FastHash64 {
+public:
+    explicit FastHash64(uint64_t seed = 0);
+
+    void reset(uint64_t seed = 0);
+    void update(const void* data, size_t size);
+    uint64_t digest() const;
+
+private:
+    uint64_t seed_;
+    uint64_t v_[4];
+    uint64_t total_;
+    unsigned char buffer_[32];
+    size_t buffered_;
+};
@@ -0,0 +1,154 @@
+#include "ChunkPool.h"
+#include <algorithm>
+#include <new>
+#include <utility>
+
+ChunkPool g_chunk_pool;
+
+ChunkBuffer::ChunkBuffer(const ChunkBuffer& other) : chunk_(other.chunk_) {
+    if (chunk_) {
+        chunk_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+ChunkBuffer::ChunkBuffer(ChunkBuffer&& other) noexcept : chunk_(other.chunk_) {
+    other.chunk_ = nullptr;
+}
+
+ChunkBuffer& ChunkBuffer::operator=(const ChunkBuffer& other) {
+    if (this != &other) {
+        ChunkBuffer copy(other);
+        std::swap(chunk_, copy.chunk_);
+    }
+    return *this;
+}
+
+ChunkBuffer& ChunkBuffer::operator=(ChunkBuffer&& other) noexcept {
+    if (this != &other) {
+        reset();
+        chunk_ = other.chunk_;
+        other.chunk_ = nullptr;
+    }
+    return *this;
+}
+
+ChunkBuffer::~ChunkBuffer() {
+    reset();
+}
+
+// 最后一个持有者负责归还，acq_rel 保证其他线程对块的读取都在归还之前完成
+void ChunkBuffer::reset() {
+    if (chunk_ && chunk_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        chunk_->pool->release(chunk_);
+    }
+    chunk_ = nullptr;
+}
+
+ChunkPool::ChunkPool(size_t max_chunks)
+    : max_chunks_(max_chunks == 0 ? 1 : max_chunks), free_list_(nullptr) {}
+
+ChunkPool::~ChunkPool() {
+    for (char* slab : slabs_) {
+        ::operator delete(slab, std::align_val_t(CHUNK_BUFFER_ALIGNMENT));
+    }
+}
+
+ChunkBuffer ChunkPool::try_acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ChunkBuffer::Chunk* chunk = take_locked();
+    if (!chunk) {
+        ++stats_.stalls;
+    }
+    return ChunkBuffer(chunk);
+}
+
+ChunkBuffer ChunkPool::acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ChunkBuffer::Chunk* chunk = take_locked();
+    if (!chunk) {
+        ++stats_.stalls;
+        auto since = Clock::now();
+        available_.wait(lock, [this, &chunk]() {
+            chunk = take_locked();
+            return chunk != nullptr;
+        });
+        stats_.stall_us += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - since).count();
+    }
+    return ChunkBuffer(chunk);
+}
+
+void ChunkPool::notify_when_available(const asio::any_io_executor& executor, std::function<void()> handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_list_ || chunks_.size() < max_chunks_) {
+        // 注册前已经有块归还
+        asio::post(executor, std::move(handler));
+        return;
+    }
+    waiters_.push_back({ executor, std::move(handler), Clock::now() });
+}
+
+ChunkPoolStats ChunkPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+ChunkBuffer::Chunk* ChunkPool::take_locked() {
+    if (!free_list_ && chunks_.size() < max_chunks_) {
+        grow_locked();
+    }
+    ChunkBuffer::Chunk* chunk = free_list_;
+    if (!chunk) {
+        return nullptr;
+    }
+
+    free_list_ = chunk->next;
+    chunk->next = nullptr;
+    chunk->size = 0;
+    chunk->refs.store(1, std::memory_order_relaxed);
+
+    ++stats_.acquires;
+    ++stats_.in_use;
+    if (stats_.in_use > stats_.high_water) {
+        stats_.high_water = stats_.in_use;
+    }
+    return chunk;
+}
+
+// 一次申请一整组块，组内的块首尾相接，每块都按页对齐
+void ChunkPool::grow_locked() {
+    size_t count = std::min(CHUNK_POOL_SLAB_CHUNKS, max_chunks_ - chunks_.size());
+    char* slab = static_cast<char*>(::operator new(count * CHUNK_BUFFER_SIZE, std::align_val_t(CHUNK_BUFFER_ALIGNMENT)));
+    slabs_.push_back(slab);
+
+    for (size_t i = 0; i < count; ++i) {
+        ChunkBuffer::Chunk& chunk = chunks_.emplace_back();
+        chunk.pool = this;
+        chunk.data = slab + i * CHUNK_BUFFER_SIZE;
+        chunk.size = 0;
+        chunk.next = free_list_;
+        free_list_ = &chunk;
+    }
+    stats_.allocated += count;
+}
+
+// 等待中的网络线程全部唤醒，没抢到块的会再次登记
+void ChunkPool::release(ChunkBuffer::Chunk* chunk) {
+    std::vector<Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        chunk->next = free_list_;
+        free_list_ = chunk;
+        --stats_.in_use;
+
+        waiters.swap(waiters_);
+        auto now = Clock::now();
+        for (const auto& waiter : waiters) {
+            stats_.stall_us += std::chrono::duration_cast<std::chrono::microseconds>(now - waiter.since).count();
+        }
+    }
+    available_.notify_one();
+
+    for (auto& waiter : waiters) {
+        asio::post(waiter.executor, std::move(waiter.handler));
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <asio.hpp>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include "Protocol.h"
+
+// 数据块缓冲区大小：一个 FILE_CHUNK_SIZE 的数据块再留出流帧头等消息头部的空间，按页对齐
+const size_t CHUNK_BUFFER_SIZE = FILE_CHUNK_SIZE + 4096;
+// 缓冲区起始地址按页对齐，可以直接用于无缓冲或注册缓冲区的文件写入
+const size_t CHUNK_BUFFER_ALIGNMENT = 4096;
+// 每次向系统申请的块数
+const size_t CHUNK_POOL_SLAB_CHUNKS = 8;
+// 缓冲池最多持有的块数，超过时取块的一方等待归还
+const size_t CHUNK_POOL_MAX_CHUNKS = 128;
+
+struct ChunkPoolStats {
+    uint64_t allocated = 0;          // 已向系统申请的块数
+    uint64_t in_use = 0;             // 正在使用的块数
+    uint64_t high_water = 0;         // 同时使用的块数峰值
+    uint64_t acquires = 0;           // 取块次数
+    uint64_t stalls = 0;             // 缓冲池用完、需要等待归还的次数
+    uint64_t stall_us = 0;           // 等待归还的总时间，微秒
+};
+
+class ChunkPool;
+
+// 数据块缓冲区的引用计数句柄
+// 同一个块可以被网络线程、校验线程和写盘线程上的任务同时持有，最后一个句柄销毁时块回到缓冲池。
+// 块的内容在交出去之后不再修改，多个线程只读访问不需要加锁。
+class ChunkBuffer {
+public:
+    ChunkBuffer() = default;
+    ChunkBuffer(const ChunkBuffer& other);
+    ChunkBuffer(ChunkBuffer&& other) noexcept;
+    ChunkBuffer& operator=(const ChunkBuffer& other);
+    ChunkBuffer& operator=(ChunkBuffer&& other) noexcept;
+    ~ChunkBuffer();
+
+    explicit operator bool() const { return chunk_ != nullptr; }
+
+    char* data() const { return chunk_->data; }
+    size_t capacity() const { return CHUNK_BUFFER_SIZE; }
+
+    // 有效数据的长度，由填充数据的一方设置
+    size_t size() const { return chunk_->size; }
+    void set_size(size_t size) { chunk_->size = size; }
+    std::string_view view() const { return std::string_view(chunk_->data, chunk_->size); }
+
+    void reset();
+
+private:
+    friend class ChunkPool;
+
+    struct Chunk {
+        ChunkPool* pool;
+        char* data;
+        size_t size;
+        std::atomic<uint32_t> refs;
+        Chunk* next;                 // 空闲链表
+    };
+
+    explicit ChunkBuffer(Chunk* chunk) : chunk_(chunk) {}
+
+    Chunk* chunk_ = nullptr;
+};
+
+// 固定大小、页对齐的数据块缓冲池
+// 块按 CHUNK_POOL_SLAB_CHUNKS 个一组向系统申请，归还后放进空闲链表，程序运行期间不释放。
+// 用满 max_chunks 后不再申请：网络线程用 try_acquire 加 notify_when_available 暂停读取，
+// 工作线程用 acquire 阻塞等待，两种等待都计入 stalls。
+class ChunkPool {
+public:
+    explicit ChunkPool(size_t max_chunks = CHUNK_POOL_MAX_CHUNKS);
+    ~ChunkPool();
+    ChunkPool(const ChunkPool&) = delete;
+    ChunkPool& operator=(const ChunkPool&) = delete;
+
+    // 缓冲池用完时返回空句柄并记一次等待
+    ChunkBuffer try_acquire();
+
+    // 阻塞到有块可用，只能在工作线程上调用
+    ChunkBuffer acquire();
+
+    // 下一次有块归还时在 executor 上调用 handler，用于 try_acquire 失败后恢复
+    void notify_when_available(const asio::any_io_executor& executor, std::function<void()> handler);
+
+    ChunkPoolStats stats() const;
+
+private:
+    friend class ChunkBuffer;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Waiter {
+        asio::any_io_executor executor;
+        std::function<void()> handler;
+        Clock::time_point since;
+    };
+
+    ChunkBuffer::Chunk* take_locked();
+    void grow_locked();
+    void release(ChunkBuffer::Chunk* chunk);
+
+    size_t max_chunks_;
+    mutable std::mutex mutex_;
+    std::condition_variable available_;
+    std::deque<ChunkBuffer::Chunk> chunks_;        // 块的管理信息，deque 扩展时地址不变
+    std::vector<char*> slabs_;
+    ChunkBuffer::Chunk* free_list_;
+    std::vector<Waiter> waiters_;
+    ChunkPoolStats stats_;
+};
+
+// 网络、校验和写盘共用的缓冲池
+extern ChunkPool g_chunk_pool;
@@ -0,0 +1,94 @@
+#include "ClientEvents.h"
+#include <deque>
+#include <mutex>
+
+namespace {
+    MpscRing<ClientEvent, CLIENT_EVENT_CAPACITY>& event_ring() {
+        static MpscRing<ClientEvent, CLIENT_EVENT_CAPACITY> ring;
+        return ring;
+    }
+
+    // 队列满时不能丢的事件按顺序排在这里，界面线程取完队列后再取
+    std::mutex overflow_mutex;
+    std::deque<ClientEvent> overflow;
+    std::atomic<uint64_t> progress_dropped{ 0 };
+
+    // 中间进度丢了会被下一次进度覆盖；其他事件和完成时的进度丢了，界面的连接状态、错误和进度条就不对了
+    bool droppable(const ClientEvent& event) {
+        return event.type == ClientEventType::PROGRESS && event.done < event.total;
+    }
+
+    void post_event(ClientEvent&& event) {
+        if (droppable(event)) {
+            if (!event_ring().try_push(std::move(event))) {
+                progress_dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            return;
+        }
+
+        // 溢出队列不为空时也排在后面，保证这些事件的顺序
+        std::lock_guard<std::mutex> lock(overflow_mutex);
+        if (overflow.empty() && event_ring().try_push(std::move(event))) {
+            return;
+        }
+        overflow.push_back(std::move(event));
+    }
+}
+
+void post_log(const std::string& message) {
+    ClientEvent event;
+    event.type = ClientEventType::LOG;
+    event.text = message;
+    post_event(std::move(event));
+}
+
+void post_error(const std::string& message) {
+    ClientEvent event;
+    event.type = ClientEventType::ERROR_MESSAGE;
+    event.text = message;
+    post_event(std::move(event));
+}
+
+void post_progress(const std::string& filename, uint64_t done, uint64_t total) {
+    ClientEvent event;
+    event.type = ClientEventType::PROGRESS;
+    event.text = filename;
+    event.done = done;
+    event.total = total;
+    post_event(std::move(event));
+}
+
+void post_server_info(const std::string& ip, const std::string& port, const std::string& name,
+                      const std::string& notice) {
+    ClientEvent event;
+    event.type = ClientEventType::SERVER_INFO;
+    event.ip = ip;
+    event.port = port;
+    event.text = name;
+    event.notice = notice;
+    post_event(std::move(event));
+}
+
+void post_disconnected() {
+    ClientEvent event;
+    event.type = ClientEventType::DISCONNECTED;
+    post_event(std::move(event));
+}
+
+bool poll_client_event(ClientEvent& event) {
+    if (event_ring().try_pop(event)) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(overflow_mutex);
+    if (overflow.empty()) {
+        return false;
+    }
+    event = std::move(overflow.front());
+    overflow.pop_front();
+    return true;
+}
+
+uint64_t dropped_progress_events() {
+    return progress_dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// 多生产者单消费者的无锁环形队列
+// 网络线程、写盘线程和校验线程都可以 push，只有界面线程 pop。
+// 队列满时 push 直接失败，生产者永远不会阻塞，失败后丢弃还是另外保存由调用方决定。
+template <typename T, size_t Capacity>
+class MpscRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity 必须是 2 的幂");
+
+public:
+    MpscRing() : tail_(0), head_(0) {
+        for (size_t i = 0; i < Capacity; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    bool try_push(T&& value) {
+        Cell* cell;
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & (Capacity - 1)];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                // 抢到这个位置
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 队列已满，value 保持不变
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 只能在消费者线程调用
+    bool try_pop(T& out) {
+        Cell& cell = cells_[head_ & (Capacity - 1)];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence != head_ + 1) {
+            return false;
+        }
+
+        out = std::move(cell.value);
+        cell.sequence.store(head_ + Capacity, std::memory_order_release);
+        ++head_;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    alignas(64) std::atomic<size_t> tail_;
+    alignas(64) size_t head_;
+    Cell cells_[Capacity];
+};
+
+// 客户端发给界面的事件类型
+enum class ClientEventType : uint8_t {
+    LOG,            // 普通消息
+    ERROR_MESSAGE,  // 错误消息
+    PROGRESS,       // 下载进度
+    SERVER_INFO,    // 服务器信息
+    DISCONNECTED    // 连接断开
+};
+
+struct ClientEvent {
+    ClientEventType type = ClientEventType::LOG;
+    std::string text;        // 消息内容；PROGRESS 时为文件名；SERVER_INFO 时为服务器名称
+    std::string notice;      // SERVER_INFO 的通知
+    std::string ip;
+    std::string port;
+    uint64_t done = 0;       // PROGRESS 的已完成字节数
+    uint64_t total = 0;      // PROGRESS 的总字节数
+};
+
+// 事件队列容量
+const size_t CLIENT_EVENT_CAPACITY = 1024;
+
+// 任意线程都可以调用，不会阻塞
+void post_log(const std::string& message);
+void post_error(const std::string& message);
+void post_progress(const std::string& filename, uint64_t done, uint64_t total);
+void post_server_info(const std::string& ip, const std::string& port, const std::string& name,
+                      const std::string& notice);
+void post_disconnected();
+
+// 界面线程每帧调用，取出一个事件，没有事件时返回 false
+bool poll_client_event(ClientEvent& event);
+
+// 队列满时丢弃的中间进度事件个数。其他事件和完成时的进度不会丢弃
+uint64_t dropped_progress_events();
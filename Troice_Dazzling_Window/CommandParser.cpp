@@ -0,0 +1,90 @@
+#include "CommandParser.h"
+#include <charconv>
+
+namespace {
+    // 最长的命令名 INIT_SERVER_INFO 加上分隔符
+    const size_t MAX_COMMAND_NAME = 17;
+}
+
+bool FieldTokenizer::next(std::string_view& field) {
+    if (done_) {
+        return false;
+    }
+
+    size_t sep = rest_.find('|');
+    if (sep == std::string_view::npos) {
+        field = rest_;
+        rest_ = std::string_view();
+        done_ = true;
+    } else {
+        field = rest_.substr(0, sep);
+        rest_.remove_prefix(sep + 1);
+    }
+    return true;
+}
+
+CommandType parse_command(std::string_view message, std::string_view& args) {
+    size_t sep = message.substr(0, MAX_COMMAND_NAME).find('|');
+    if (sep == std::string_view::npos) {
+        return CommandType::UNKNOWN;
+    }
+
+    std::string_view name = message.substr(0, sep);
+    args = message.substr(sep + 1);
+
+    // 先按长度和首字母分派，最多再比较一次完整名称
+    CommandType type = CommandType::UNKNOWN;
+    std::string_view expected;
+    switch (name.size()) {
+    case 11:
+        type = CommandType::SERVER_INFO;
+        expected = "SERVER_INFO";
+        break;
+    case 12:
+        switch (name[0]) {
+        case 'D': type = CommandType::DELETE_FILES; expected = "DELETE_FILES"; break;
+        case 'U': type = CommandType::UPDATE_FILES; expected = "UPDATE_FILES"; break;
+        case 'R': type = CommandType::REPAIR_FILES; expected = "REPAIR_FILES"; break;
+        default: break;
+        }
+        break;
+    case 13:
+        type = CommandType::CHECK_PATCHES;
+        expected = "CHECK_PATCHES";
+        break;
+    case 14:
+        type = CommandType::DOWNLOAD_FILES;
+        expected = "DOWNLOAD_FILES";
+        break;
+    case 16:
+        type = CommandType::INIT_SERVER_INFO;
+        expected = "INIT_SERVER_INFO";
+        break;
+    default:
+        break;
+    }
+
+    return name == expected ? type : CommandType::UNKNOWN;
+}
+
+bool parse_uint64(std::string_view text, uint64_t& value) {
+    if (text.empty()) {
+        return false;
+    }
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+std::string unescape_newlines(std::string_view text) {
+    std::string result;
+    result.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\\' && i + 1 < text.size() && text[i + 1] == 'n') {
+            result.push_back('\n');
+            ++i;
+        } else {
+            result.push_back(text[i]);
+        }
+    }
+    return result;
+}
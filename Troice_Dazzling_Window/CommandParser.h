@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+// 文本命令类型
+enum class CommandType : uint8_t {
+    UNKNOWN,
+    SERVER_INFO,
+    CHECK_PATCHES,
+    DELETE_FILES,
+    UPDATE_FILES,
+    DOWNLOAD_FILES,
+    REPAIR_FILES,
+    INIT_SERVER_INFO      // 客户端连接后发送，服务器回复 SERVER_INFO
+};
+
+// 按 '|' 依次切出字段，字段直接指向原消息，不分配内存
+class FieldTokenizer {
+public:
+    explicit FieldTokenizer(std::string_view text) : rest_(text), done_(false) {}
+
+    // 取下一个字段，没有更多字段时返回 false
+    bool next(std::string_view& field);
+    // 最后一个分隔符之后是否还有内容（可以为空）
+    bool has_remainder() const { return !done_; }
+    // 还没有切分的剩余内容，UPDATE_FILES 的二进制文件内容从这里取
+    std::string_view remainder() const { return done_ ? std::string_view() : rest_; }
+
+private:
+    std::string_view rest_;
+    bool done_;
+};
+
+// 识别命令名（第一个 '|' 之前的部分）并返回其后的参数。
+// 命令名最长只看 MAX_COMMAND_NAME 个字符，按长度和首字母分派，和消息长度无关。
+CommandType parse_command(std::string_view message, std::string_view& args);
+
+// 解析十进制无符号整数，整个字段都必须是数字
+bool parse_uint64(std::string_view text, uint64_t& value);
+
+// 把通知中的 "\n" 转义还原成换行，单次扫描
+std::string unescape_newlines(std::string_view text);
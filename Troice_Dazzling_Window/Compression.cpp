@@ -0,0 +1,256 @@
+#include "Compression.h"
+#include "Protocol.h"
+#include <algorithm>
+#include <cstring>
+
+#define STBI_HEADER_FILE_ONLY
+#include "stb_image.h"
+
+namespace {
+    const uint16_t LENGTH_BASE[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint8_t LENGTH_EXTRA[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const uint16_t DIST_BASE[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const uint8_t DIST_EXTRA[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    const size_t WINDOW_SIZE = 32768;
+    const size_t MIN_MATCH = 3;
+    const size_t MAX_MATCH = 258;
+    const int HASH_BITS = 15;
+    const int MAX_CHAIN = 32;
+
+    // 按 deflate 的要求从低位开始输出比特
+    class BitWriter {
+    public:
+        explicit BitWriter(std::string& out) : out_(out), bits_(0), count_(0) {}
+
+        void write(uint32_t value, int count) {
+            bits_ |= static_cast<uint64_t>(value) << count_;
+            count_ += count;
+            while (count_ >= 8) {
+                out_.push_back(static_cast<char>(bits_ & 0xFF));
+                bits_ >>= 8;
+                count_ -= 8;
+            }
+        }
+
+        // 哈夫曼码需要高位在前
+        void write_reversed(uint32_t code, int count) {
+            uint32_t reversed = 0;
+            for (int i = 0; i < count; ++i) {
+                reversed = (reversed << 1) | ((code >> i) & 1);
+            }
+            write(reversed, count);
+        }
+
+        void flush() {
+            if (count_ > 0) {
+                out_.push_back(static_cast<char>(bits_ & 0xFF));
+                bits_ = 0;
+                count_ = 0;
+            }
+        }
+
+    private:
+        std::string& out_;
+        uint64_t bits_;
+        int count_;
+    };
+
+    void write_literal(BitWriter& writer, uint32_t symbol) {
+        if (symbol <= 143) writer.write_reversed(0x30 + symbol, 8);
+        else if (symbol <= 255) writer.write_reversed(0x190 + symbol - 144, 9);
+        else if (symbol <= 279) writer.write_reversed(symbol - 256, 7);
+        else writer.write_reversed(0xC0 + symbol - 280, 8);
+    }
+
+    void write_match(BitWriter& writer, size_t length, size_t distance) {
+        int code = 28;
+        while (LENGTH_BASE[code] > length) --code;
+        write_literal(writer, 257 + code);
+        writer.write(static_cast<uint32_t>(length - LENGTH_BASE[code]), LENGTH_EXTRA[code]);
+
+        code = 29;
+        while (DIST_BASE[code] > distance) --code;
+        writer.write_reversed(code, 5);
+        writer.write(static_cast<uint32_t>(distance - DIST_BASE[code]), DIST_EXTRA[code]);
+    }
+
+    uint32_t adler32(std::string_view data) {
+        uint32_t a = 1, b = 0;
+        size_t i = 0;
+        while (i < data.size()) {
+            // 5552 是保证 b 不溢出的最大批量
+            size_t end = std::min(data.size(), i + 5552);
+            for (; i < end; ++i) {
+                a += static_cast<unsigned char>(data[i]);
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    uint32_t hash3(const unsigned char* p) {
+        uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    }
+}
+
+std::string deflate_chunk(std::string_view data) {
+    std::string out;
+    out.reserve(data.size() / 2 + 64);
+
+    // zlib 头: deflate, 32K 窗口，默认压缩级别
+    out.push_back(static_cast<char>(0x78));
+    out.push_back(static_cast<char>(0x9C));
+
+    BitWriter writer(out);
+    writer.write(1, 1);   // BFINAL
+    writer.write(1, 2);   // BTYPE = 01 固定哈夫曼
+
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(data.data());
+    const size_t size = data.size();
+
+    std::vector<int32_t> head(size_t(1) << HASH_BITS, -1);
+    std::vector<int32_t> prev(size, -1);
+
+    size_t pos = 0;
+    while (pos < size) {
+        size_t best_length = 0;
+        size_t best_distance = 0;
+
+        if (pos + MIN_MATCH <= size) {
+            uint32_t h = hash3(src + pos);
+            int32_t candidate = head[h];
+            size_t max_length = std::min(MAX_MATCH, size - pos);
+
+            for (int chain = 0; candidate >= 0 && chain < MAX_CHAIN; ++chain) {
+                size_t distance = pos - static_cast<size_t>(candidate);
+                if (distance > WINDOW_SIZE) break;
+
+                size_t length = 0;
+                while (length < max_length && src[candidate + length] == src[pos + length]) ++length;
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = distance;
+                    if (length == max_length) break;
+                }
+                candidate = prev[candidate];
+            }
+
+            prev[pos] = head[h];
+            head[h] = static_cast<int32_t>(pos);
+        }
+
+        if (best_length >= MIN_MATCH) {
+            write_match(writer, best_length, best_distance);
+            // 匹配区间内的位置也加入哈希链
+            for (size_t i = 1; i < best_length; ++i) {
+                size_t p = pos + i;
+                if (p + MIN_MATCH <= size) {
+                    uint32_t h = hash3(src + p);
+                    prev[p] = head[h];
+                    head[h] = static_cast<int32_t>(p);
+                }
+            }
+            pos += best_length;
+        } else {
+            write_literal(writer, src[pos]);
+            ++pos;
+        }
+    }
+
+    write_literal(writer, 256);   // 块结束
+    writer.flush();
+
+    uint32_t checksum = adler32(data);
+    out.push_back(static_cast<char>(checksum >> 24));
+    out.push_back(static_cast<char>(checksum >> 16));
+    out.push_back(static_cast<char>(checksum >> 8));
+    out.push_back(static_cast<char>(checksum));
+    return out;
+}
+
+bool inflate_chunk(std::string_view body, std::vector<char>& output) {
+    CompressedChunkHeader header;
+    if (body.size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, body.data(), sizeof(header));
+    if (header.rawLength > FILE_CHUNK_SIZE) {
+        return false;
+    }
+
+    output.resize(header.rawLength);
+    std::string_view compressed = body.substr(sizeof(header));
+    int length = stbi_zlib_decode_buffer(output.data(), static_cast<int>(output.size()),
+                                         compressed.data(), static_cast<int>(compressed.size()));
+    return length >= 0 && static_cast<uint32_t>(length) == header.rawLength;
+}
+
+std::string make_compressed_chunk(std::string_view data) {
+    std::string compressed = deflate_chunk(data);
+    if (compressed.size() + sizeof(CompressedChunkHeader) >= data.size()) {
+        return std::string();
+    }
+
+    CompressedChunkHeader header;
+    header.rawLength = static_cast<uint32_t>(data.size());
+
+    std::string body(reinterpret_cast<const char*>(&header), sizeof(header));
+    body += compressed;
+    return body;
+}
+
+CompressedChunkCache::CompressedChunkCache(size_t capacity_bytes)
+    : capacity_bytes_(capacity_bytes), size_bytes_(0) {}
+
+std::shared_ptr<const std::string> CompressedChunkCache::get(const std::string& path, uint64_t file_version,
+                                                             uint64_t chunk_index, std::string_view data) {
+    std::string key = path + "|" + std::to_string(file_version) + "|" + std::to_string(chunk_index);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return it->second->body;
+        }
+    }
+
+    // 压缩在锁外进行，多个线程同时未命中时最多重复压缩一次
+    std::string compressed = make_compressed_chunk(data);
+    std::shared_ptr<const std::string> body;
+    if (!compressed.empty()) {
+        body = std::make_shared<const std::string>(std::move(compressed));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.find(key) == index_.end()) {
+        size_bytes_ += key.size() + (body ? body->size() : 0);
+        lru_.push_front({ key, body });
+        index_[key] = lru_.begin();
+
+        while (size_bytes_ > capacity_bytes_ && lru_.size() > 1) {
+            const Entry& oldest = lru_.back();
+            size_bytes_ -= oldest.key.size() + (oldest.body ? oldest.body->size() : 0);
+            index_.erase(oldest.key);
+            lru_.pop_back();
+        }
+    }
+    return body;
+}
+
+size_t CompressedChunkCache::size_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_bytes_;
+}
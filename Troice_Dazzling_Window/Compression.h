@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+
+// FILE_CHUNK_Z 消息体开头的块头，后面紧跟 zlib 格式的压缩数据
+#pragma pack(push, 1)
+struct CompressedChunkHeader {
+    uint32_t rawLength;   // 解压后的长度
+};
+#pragma pack(pop)
+
+// 用固定哈夫曼编码 + LZ77 把一个数据块压缩成独立的 zlib 流
+std::string deflate_chunk(std::string_view data);
+
+// 解压一个 FILE_CHUNK_Z 消息体，结果写入 output（长度为块头中的 rawLength）
+// 解压用的是 stb_image 自带的 zlib 解码器
+bool inflate_chunk(std::string_view body, std::vector<char>& output);
+
+// 构造 FILE_CHUNK_Z 消息体；压缩后没有变小时返回空字符串，调用者应改发原始 FILE_CHUNK
+std::string make_compressed_chunk(std::string_view data);
+
+// 服务器端压缩结果缓存
+// 同一个补丁文件会被成千上万个客户端下载，每个数据块只压缩一次
+class CompressedChunkCache {
+public:
+    explicit CompressedChunkCache(size_t capacity_bytes);
+
+    // 取得某个文件某个分块的 FILE_CHUNK_Z 消息体，缓存未命中时压缩并存入缓存。
+    // 返回空指针表示该分块不可压缩
+    std::shared_ptr<const std::string> get(const std::string& path, uint64_t file_version,
+                                           uint64_t chunk_index, std::string_view data);
+
+    size_t size_bytes() const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const std::string> body;   // 为空表示不可压缩
+    };
+
+    size_t capacity_bytes_;
+    size_t size_bytes_;
+    std::list<Entry> lru_;   // 最近使用的在前
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    mutable std::mutex mutex_;
+};
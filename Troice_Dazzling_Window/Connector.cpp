@@ -0,0 +1,266 @@
+#include "Connector.h"
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <algorithm>
+
+namespace {
+    struct DnsCacheEntry {
+        asio::ip::tcp::resolver::results_type results;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    std::mutex dns_cache_mutex;
+    std::map<std::string, DnsCacheEntry> dns_cache;
+}
+
+void async_resolve_cached(asio::io_context& io_context, const std::string& host, const std::string& port,
+                          ResolveHandler handler) {
+    std::string key = host + ":" + port;
+    {
+        std::lock_guard<std::mutex> lock(dns_cache_mutex);
+        auto it = dns_cache.find(key);
+        if (it != dns_cache.end() && it->second.expires > std::chrono::steady_clock::now()) {
+            asio::post(io_context, [handler = std::move(handler), results = it->second.results]() {
+                handler(asio::error_code(), results);
+            });
+            return;
+        }
+    }
+
+    auto resolver = std::make_shared<asio::ip::tcp::resolver>(io_context);
+    resolver->async_resolve(host, port,
+        [resolver, key, handler = std::move(handler)](const asio::error_code& error,
+                                                      asio::ip::tcp::resolver::results_type results) {
+            std::unique_lock<std::mutex> lock(dns_cache_mutex);
+            if (!error) {
+                dns_cache[key] = { results, std::chrono::steady_clock::now() + DNS_CACHE_TTL };
+                lock.unlock();
+                handler(error, results);
+                return;
+            }
+
+            // DNS 暂时不可用时退回到上次的结果
+            auto it = dns_cache.find(key);
+            if (it != dns_cache.end()) {
+                auto stale = it->second.results;
+                lock.unlock();
+                handler(asio::error_code(), stale);
+                return;
+            }
+            lock.unlock();
+            handler(error, results);
+        });
+}
+
+bool parse_server_endpoint(std::string_view text, ServerEndpoint& server) {
+    size_t colon = text.rfind(':');
+    if (colon == std::string_view::npos || colon == 0 || colon + 1 == text.size()) {
+        return false;
+    }
+
+    std::string_view host = text.substr(0, colon);
+    std::string_view port = text.substr(colon + 1);
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    if (port.find_first_not_of("0123456789") != std::string_view::npos) {
+        return false;
+    }
+
+    server.host = std::string(host);
+    server.port = std::string(port);
+    return true;
+}
+
+std::vector<ServerEndpoint> load_server_list(const std::string& path) {
+    std::vector<ServerEndpoint> servers;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t begin = line.find_first_not_of(" \t");
+        if (begin == std::string::npos || line[begin] == '#') {
+            continue;
+        }
+        size_t end = line.find_last_not_of(" \t\r");
+
+        ServerEndpoint server;
+        if (parse_server_endpoint(std::string_view(line).substr(begin, end - begin + 1), server)) {
+            merge_servers(servers, { server });
+        }
+    }
+    return servers;
+}
+
+size_t merge_servers(std::vector<ServerEndpoint>& servers, const std::vector<ServerEndpoint>& additions) {
+    size_t added = 0;
+    for (const auto& server : additions) {
+        bool known = std::any_of(servers.begin(), servers.end(), [&server](const ServerEndpoint& existing) {
+            return existing.host == server.host && existing.port == server.port;
+        });
+        if (!known) {
+            servers.push_back(server);
+            ++added;
+        }
+    }
+    return added;
+}
+
+std::chrono::milliseconds reconnect_delay(unsigned attempt) {
+    thread_local std::mt19937 rng{ std::random_device{}() };
+
+    auto base = RECONNECT_INITIAL_DELAY.count() << std::min(attempt, 16u);
+    base = std::min<decltype(base)>(base, RECONNECT_MAX_DELAY.count());
+
+    std::uniform_int_distribution<long long> jitter(base / 2, base);
+    return std::chrono::milliseconds(jitter(rng));
+}
+
+ConnectRace::ConnectRace(asio::io_context& io_context, std::vector<ServerEndpoint> servers, Handler handler)
+    : io_context_(io_context), servers_(std::move(servers)), handler_(std::move(handler)),
+      stagger_timer_(io_context), resolves_pending_(0), active_attempts_(0),
+      stagger_armed_(false), finished_(false) {}
+
+void ConnectRace::start() {
+    if (servers_.empty()) {
+        complete(asio::error::host_not_found, nullptr);
+        return;
+    }
+
+    resolves_pending_ = servers_.size();
+    for (size_t i = 0; i < servers_.size(); ++i) {
+        async_resolve_cached(io_context_, servers_[i].host, servers_[i].port,
+            [self = shared_from_this(), i](const asio::error_code& error,
+                                           const asio::ip::tcp::resolver::results_type& results) {
+                self->on_resolved(i, error, results);
+            });
+    }
+}
+
+void ConnectRace::cancel() {
+    complete(asio::error::operation_aborted, nullptr);
+}
+
+// IPv6 和 IPv4 地址交替排列，某一类地址全部不通时另一类仍然能很快尝试到
+void ConnectRace::on_resolved(size_t server, const asio::error_code& error,
+                              const asio::ip::tcp::resolver::results_type& results) {
+    --resolves_pending_;
+    if (finished_) {
+        return;
+    }
+
+    if (error) {
+        last_error_ = error;
+    } else {
+        std::vector<asio::ip::tcp::endpoint> v6, v4;
+        for (const auto& entry : results) {
+            (entry.endpoint().address().is_v6() ? v6 : v4).push_back(entry.endpoint());
+        }
+        for (size_t i = 0; i < std::max(v6.size(), v4.size()); ++i) {
+            if (i < v6.size()) candidates_.push_back({ v6[i], server });
+            if (i < v4.size()) candidates_.push_back({ v4[i], server });
+        }
+    }
+
+    // 间隔已经过去（或还没有任何尝试）时立即发起
+    if (!stagger_armed_) {
+        launch_next();
+    }
+    check_exhausted();
+}
+
+void ConnectRace::launch_next() {
+    if (finished_ || candidates_.empty()) {
+        return;
+    }
+
+    Candidate candidate = candidates_.front();
+    candidates_.pop_front();
+
+    auto attempt = std::make_shared<Attempt>(io_context_, candidate.server);
+    attempts_.push_back(attempt);
+    ++active_attempts_;
+
+    attempt->deadline.expires_after(CONNECT_TIMEOUT);
+    attempt->deadline.async_wait(bind_handler_memory(handler_memory_,
+        [self = shared_from_this(), attempt](const asio::error_code& error) {
+            if (!error) {
+                self->attempt_finished(attempt, asio::error::timed_out);
+            }
+        }));
+
+    attempt->socket.async_connect(candidate.endpoint, bind_handler_memory(handler_memory_,
+        [self = shared_from_this(), attempt](const asio::error_code& error) {
+            self->attempt_finished(attempt, error);
+        }));
+
+    // 到间隔时前面的尝试还没有结果，就再发起一个
+    stagger_armed_ = true;
+    stagger_timer_.expires_after(CONNECT_STAGGER);
+    stagger_timer_.async_wait(bind_handler_memory(handler_memory_,
+        [self = shared_from_this()](const asio::error_code& error) {
+            if (error) {
+                return;
+            }
+            self->stagger_armed_ = false;
+            self->launch_next();
+        }));
+}
+
+void ConnectRace::attempt_finished(const std::shared_ptr<Attempt>& attempt, const asio::error_code& error) {
+    if (attempt->done) {
+        return;
+    }
+    attempt->done = true;
+    --active_attempts_;
+
+    asio::error_code ec;
+    attempt->deadline.cancel();
+    if (finished_) {
+        attempt->socket.close(ec);
+        return;
+    }
+
+    if (!error) {
+        complete(error, attempt);
+        return;
+    }
+
+    // 失败（包括超时）后不等间隔，立即尝试下一个地址
+    last_error_ = error;
+    attempt->socket.close(ec);
+    launch_next();
+    check_exhausted();
+}
+
+void ConnectRace::check_exhausted() {
+    if (!finished_ && active_attempts_ == 0 && candidates_.empty() && resolves_pending_ == 0) {
+        complete(last_error_ ? last_error_ : asio::error::host_not_found, nullptr);
+    }
+}
+
+void ConnectRace::complete(const asio::error_code& error, const std::shared_ptr<Attempt>& winner) {
+    if (finished_) {
+        return;
+    }
+    finished_ = true;
+    stagger_timer_.cancel();
+
+    asio::error_code ec;
+    for (auto& attempt : attempts_) {
+        if (attempt != winner) {
+            attempt->deadline.cancel();
+            attempt->socket.close(ec);
+        }
+    }
+    attempts_.clear();
+    candidates_.clear();
+
+    Handler handler = std::move(handler_);
+    if (winner) {
+        handler(error, std::move(winner->socket), servers_[winner->server]);
+    } else {
+        handler(error, asio::ip::tcp::socket(io_context_), ServerEndpoint());
+    }
+}
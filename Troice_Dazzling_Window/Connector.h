@@ -0,0 +1,104 @@
+#pragma once
+
+#include <asio.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include "HandlerMemory.h"
+
+// 单次连接尝试的超时
+const std::chrono::milliseconds CONNECT_TIMEOUT(3000);
+// 相邻两次连接尝试之间的间隔，前一个尝试还没结果时就发起下一个（happy eyeballs）
+const std::chrono::milliseconds CONNECT_STAGGER(50);
+// DNS 解析结果的缓存时间
+const std::chrono::seconds DNS_CACHE_TTL(300);
+// 重连的初始等待时间和最大等待时间
+const std::chrono::milliseconds RECONNECT_INITIAL_DELAY(500);
+const std::chrono::milliseconds RECONNECT_MAX_DELAY(30000);
+
+// 服务器列表文件，放在登录器目录下。每行一个 host:port，第一行是主服务器，其余是镜像；
+// 空行和 # 开头的行忽略。IPv6 地址写成 [地址]:端口
+const char* const SERVER_LIST_FILE = "servers.txt";
+// 没有服务器列表文件时连接的服务器
+const char* const DEFAULT_SERVER_HOST = "127.0.0.1";
+const char* const DEFAULT_SERVER_PORT = "12345";
+
+// 服务器地址，host 可以是域名或 IP
+struct ServerEndpoint {
+    std::string host;
+    std::string port;
+};
+
+// 解析 host:port，格式错误时返回 false
+bool parse_server_endpoint(std::string_view text, ServerEndpoint& server);
+
+// 读取服务器列表文件，文件不存在或没有有效的行时返回空列表
+std::vector<ServerEndpoint> load_server_list(const std::string& path);
+
+// 把 servers 中没有的地址按顺序追加到末尾，返回追加的个数
+size_t merge_servers(std::vector<ServerEndpoint>& servers, const std::vector<ServerEndpoint>& additions);
+
+using ResolveHandler = std::function<void(const asio::error_code&, const asio::ip::tcp::resolver::results_type&)>;
+
+// 带缓存的异步解析，缓存未过期时不再查询 DNS；解析失败但有过期缓存时使用过期结果
+void async_resolve_cached(asio::io_context& io_context, const std::string& host, const std::string& port,
+                          ResolveHandler handler);
+
+// 第 attempt 次重连前的等待时间：指数退避，再乘以 [0.5, 1] 的随机抖动
+std::chrono::milliseconds reconnect_delay(unsigned attempt);
+
+// 连接竞速
+// 同时解析所有服务器（主服务器和镜像），地址按 IPv6/IPv4 交替排列；
+// 每隔 CONNECT_STAGGER 发起一个新的连接尝试，某个尝试失败时立即发起下一个，
+// 第一个连上的胜出，其余尝试全部关闭。每个尝试有独立的超时。
+class ConnectRace : public std::enable_shared_from_this<ConnectRace> {
+public:
+    // 成功时 socket 为已连接的套接字，server 为胜出的服务器
+    using Handler = std::function<void(const asio::error_code& error, asio::ip::tcp::socket socket,
+                                       const ServerEndpoint& server)>;
+
+    ConnectRace(asio::io_context& io_context, std::vector<ServerEndpoint> servers, Handler handler);
+
+    void start();
+    void cancel();
+
+private:
+    struct Candidate {
+        asio::ip::tcp::endpoint endpoint;
+        size_t server;
+    };
+
+    struct Attempt {
+        asio::ip::tcp::socket socket;
+        asio::steady_timer deadline;
+        size_t server;
+        bool done;
+
+        Attempt(asio::io_context& io_context, size_t server_index)
+            : socket(io_context), deadline(io_context), server(server_index), done(false) {}
+    };
+
+    void on_resolved(size_t server, const asio::error_code& error,
+                     const asio::ip::tcp::resolver::results_type& results);
+    void launch_next();
+    void attempt_finished(const std::shared_ptr<Attempt>& attempt, const asio::error_code& error);
+    void check_exhausted();
+    void complete(const asio::error_code& error, const std::shared_ptr<Attempt>& winner);
+
+    asio::io_context& io_context_;
+    HandlerMemory handler_memory_;   // 各个尝试的连接和定时器的内存，必须比 attempts_ 后析构
+    std::vector<ServerEndpoint> servers_;
+    Handler handler_;
+    std::deque<Candidate> candidates_;
+    std::vector<std::shared_ptr<Attempt>> attempts_;
+    asio::steady_timer stagger_timer_;
+    size_t resolves_pending_;
+    size_t active_attempts_;
+    bool stagger_armed_;
+    bool finished_;
+    asio::error_code last_error_;
+};
@@ -0,0 +1,283 @@
+#include "DeltaSync.h"
+#include "FileTransfer.h"
+#include "Checksum.h"
+#include "HashCache.h"
+#include <unordered_map>
+#include <filesystem>
+#include <cstring>
+
+void RollingChecksum::reset(const char* data, size_t length) {
+    a_ = 0;
+    b_ = 0;
+    length_ = static_cast<uint32_t>(length);
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        a_ += c;
+        b_ += static_cast<uint32_t>(length - i) * c;
+    }
+}
+
+void RollingChecksum::roll(unsigned char out, unsigned char in) {
+    a_ = a_ - out + in;
+    b_ = b_ - length_ * out + a_;
+}
+
+uint32_t weak_block_checksum(const char* data, size_t length) {
+    RollingChecksum checksum;
+    checksum.reset(data, length);
+    return checksum.value();
+}
+
+uint64_t strong_block_hash(const char* data, size_t length) {
+    return fast_hash64(data, length);
+}
+
+bool compute_signatures(const std::string& path, uint32_t block_size, std::vector<BlockSignature>& signatures) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    signatures.clear();
+    std::vector<char> buffer(block_size);
+    while (file.read(buffer.data(), block_size)) {
+        signatures.push_back({ weak_block_checksum(buffer.data(), block_size),
+                               strong_block_hash(buffer.data(), block_size) });
+    }
+    return true;
+}
+
+DeltaGenerator::DeltaGenerator(const std::string& path, std::vector<BlockSignature> signatures,
+                               uint32_t block_size, size_t max_literal)
+    : path_(path), signatures_(std::move(signatures)), block_size_(block_size), max_literal_(max_literal),
+      read_size_(std::max<size_t>(max_literal, block_size) + block_size), literal_start_(0), pos_(0), eof_(false),
+      run_first_(0), run_count_(0), rolling_valid_(false), done_(false) {}
+
+bool DeltaGenerator::open() {
+    file_.open(path_, std::ios::binary);
+    return static_cast<bool>(file_);
+}
+
+// 丢弃已处理的数据并读入更多
+void DeltaGenerator::refill() {
+    if (literal_start_ > 0) {
+        buffer_.erase(buffer_.begin(), buffer_.begin() + literal_start_);
+        pos_ -= literal_start_;
+        literal_start_ = 0;
+    }
+    size_t old_size = buffer_.size();
+    buffer_.resize(old_size + read_size_);
+    file_.read(buffer_.data() + old_size, read_size_);
+    buffer_.resize(old_size + static_cast<size_t>(file_.gcount()));
+    if (file_.gcount() == 0 || !file_) {
+        eof_ = true;
+    }
+}
+
+bool DeltaGenerator::generate(size_t output_limit, const CopyHandler& on_copy, const LiteralHandler& on_literal) {
+    if (done_) return true;
+
+    // 第一次调用时建立弱校验索引，放在调用方的后台线程里做
+    if (buffer_.capacity() == 0) {
+        table_.reserve(signatures_.size());
+        for (uint32_t i = 0; i < signatures_.size(); ++i) {
+            table_.emplace(signatures_[i].weak, i);
+        }
+        buffer_.reserve(read_size_ * 2);
+    }
+
+    size_t produced = 0;
+    auto flush_literal = [&]() {
+        if (pos_ > literal_start_) {
+            on_literal(std::string_view(buffer_.data() + literal_start_, pos_ - literal_start_));
+            produced += pos_ - literal_start_;
+        }
+        literal_start_ = pos_;
+    };
+    auto flush_copy = [&]() {
+        if (run_count_ > 0) {
+            on_copy(run_first_, run_count_);
+            produced += sizeof(DeltaCopy);
+            run_count_ = 0;
+        }
+    };
+
+    while (produced < output_limit) {
+        if (buffer_.size() - pos_ < static_cast<size_t>(block_size_) + 1 && !eof_) {
+            refill();
+            if (file_.bad()) {
+                done_ = true;
+                return false;
+            }
+        }
+        if (buffer_.size() - pos_ < block_size_) {
+            break;
+        }
+
+        if (!rolling_valid_) {
+            rolling_.reset(buffer_.data() + pos_, block_size_);
+            rolling_valid_ = true;
+        }
+
+        // 弱校验命中后再用强哈希确认
+        bool matched = false;
+        uint32_t block = 0;
+        auto range = table_.equal_range(rolling_.value());
+        if (range.first != range.second) {
+            uint64_t strong = strong_block_hash(buffer_.data() + pos_, block_size_);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (signatures_[it->second].strong == strong) {
+                    // 优先选择能接上当前复制区间的分块
+                    block = it->second;
+                    matched = true;
+                    if (run_count_ > 0 && block == run_first_ + run_count_) break;
+                }
+            }
+        }
+
+        if (matched) {
+            if (pos_ > literal_start_) {
+                flush_copy();
+                flush_literal();
+            }
+            if (run_count_ > 0 && block == run_first_ + run_count_) {
+                ++run_count_;
+            } else {
+                flush_copy();
+                run_first_ = block;
+                run_count_ = 1;
+            }
+            pos_ += block_size_;
+            literal_start_ = pos_;
+            rolling_valid_ = false;
+            continue;
+        }
+
+        // 没有匹配，窗口后移一个字节
+        if (pos_ + block_size_ >= buffer_.size()) {
+            if (eof_) break;
+            continue;
+        }
+        rolling_.roll(static_cast<unsigned char>(buffer_[pos_]), static_cast<unsigned char>(buffer_[pos_ + block_size_]));
+        ++pos_;
+
+        if (pos_ - literal_start_ >= max_literal_) {
+            flush_copy();
+            flush_literal();
+        }
+    }
+
+    if (produced >= output_limit) {
+        return true;
+    }
+
+    // 剩余的数据全部作为字面数据发送
+    pos_ = buffer_.size();
+    if (pos_ > literal_start_) {
+        flush_copy();
+        while (literal_start_ < pos_) {
+            size_t length = std::min(max_literal_, pos_ - literal_start_);
+            on_literal(std::string_view(buffer_.data() + literal_start_, length));
+            literal_start_ += length;
+        }
+    }
+    flush_copy();
+    done_ = true;
+    return true;
+}
+
+DeltaApplier::DeltaApplier(const std::string& filename, uint64_t filesize, uint32_t block_size)
+    : filename_(filename), filesize_(filesize), block_size_(block_size), written_(0), crc_(0), expected_crc_(0),
+      has_expected_crc_(false) {
+    full_path_ = data_file_path(filename_);
+    temp_path_ = full_path_ + ".delta";
+}
+
+void DeltaApplier::expect_crc(uint32_t crc) {
+    expected_crc_ = crc;
+    has_expected_crc_ = true;
+}
+
+bool DeltaApplier::open() {
+    basis_.open(full_path_, std::ios::binary);
+    if (!basis_) {
+        last_error_ = "无法打开本地文件: " + full_path_;
+        return false;
+    }
+
+    output_.open(temp_path_, std::ios::binary | std::ios::trunc);
+    if (!output_) {
+        last_error_ = "无法打开文件进行写入: " + temp_path_;
+        return false;
+    }
+
+    copy_buffer_.resize(block_size_);
+    return true;
+}
+
+bool DeltaApplier::copy_blocks(uint32_t first_block, uint32_t block_count) {
+    basis_.clear();
+    basis_.seekg(static_cast<std::streamoff>(first_block) * block_size_);
+
+    for (uint32_t i = 0; i < block_count; ++i) {
+        if (!basis_.read(copy_buffer_.data(), block_size_)) {
+            last_error_ = "读取本地分块失败: " + std::to_string(first_block + i);
+            return false;
+        }
+        if (!write_literal(std::string_view(copy_buffer_.data(), block_size_))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DeltaApplier::write_literal(std::string_view data) {
+    if (written_ + data.size() > filesize_) {
+        last_error_ = "差量数据超过文件大小: " + filename_;
+        return false;
+    }
+
+    output_.write(data.data(), data.size());
+    if (!output_.good()) {
+        last_error_ = "文件写入失败: " + temp_path_;
+        return false;
+    }
+    written_ += data.size();
+    crc_ = crc32c(crc_, data.data(), data.size());
+    return true;
+}
+
+bool DeltaApplier::finish() {
+    basis_.close();
+    output_.close();
+
+    if (written_ != filesize_) {
+        last_error_ = "文件大小不匹配！预期: " + std::to_string(filesize_) +
+                      " 实际: " + std::to_string(written_);
+        abort();
+        return false;
+    }
+
+    // 复制的本地分块和字面数据写出时已经累计进 CRC，与服务器的值不同说明重建结果不对
+    if (has_expected_crc_ && crc_ != expected_crc_) {
+        last_error_ = "差量重建结果校验失败: " + filename_;
+        abort();
+        return false;
+    }
+
+    try {
+        std::filesystem::rename(temp_path_, full_path_);
+    }
+    catch (const std::filesystem::filesystem_error& e) {
+        last_error_ = "重命名文件失败: " + std::string(e.what());
+        return false;
+    }
+    remember_verified_hash(filename_, crc_);
+    return true;
+}
+
+void DeltaApplier::abort() {
+    basis_.close();
+    output_.close();
+
+    std::error_code ec;
+    std::filesystem::remove(temp_path_, ec);
+}
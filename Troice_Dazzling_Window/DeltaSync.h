@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+// 差量更新的分块大小
+const uint32_t DELTA_BLOCK_SIZE = 64 * 1024;
+// 服务器接受的最大分块大小
+const uint32_t DELTA_MAX_BLOCK_SIZE = 1024 * 1024;
+// 本地文件小于这个大小时直接整文件下载
+const uint64_t DELTA_MIN_FILESIZE = 1024 * 1024;
+
+// 单个分块的签名
+#pragma pack(push, 1)
+struct BlockSignature {
+    uint32_t weak;     // 滚动弱校验
+    uint64_t strong;   // 强哈希
+};
+
+// DELTA_COPY 的消息体：从本地旧文件复制 block_count 个连续分块
+struct DeltaCopy {
+    uint32_t first_block;
+    uint32_t block_count;
+};
+#pragma pack(pop)
+
+// rsync 的滚动校验和，窗口每向后移动一个字节只需 O(1) 更新
+class RollingChecksum {
+public:
+    RollingChecksum() : a_(0), b_(0), length_(0) {}
+
+    void reset(const char* data, size_t length);
+    void roll(unsigned char out, unsigned char in);
+    uint32_t value() const { return (a_ & 0xFFFF) | ((b_ & 0xFFFF) << 16); }
+
+private:
+    uint32_t a_;
+    uint32_t b_;
+    uint32_t length_;
+};
+
+uint32_t weak_block_checksum(const char* data, size_t length);
+uint64_t strong_block_hash(const char* data, size_t length);
+
+// 计算本地文件每个完整分块的签名，末尾不足一个分块的部分不参与匹配
+bool compute_signatures(const std::string& path, uint32_t block_size, std::vector<BlockSignature>& signatures);
+
+// 服务器端：对照客户端签名扫描新文件，输出“复制本地分块”和“字面数据”两类指令
+// 可以分多次调用 generate，每次输出一批指令后返回，调用方发完这一批再继续，内存占用与文件大小无关
+class DeltaGenerator {
+public:
+    using CopyHandler = std::function<void(uint32_t first_block, uint32_t block_count)>;
+    using LiteralHandler = std::function<void(std::string_view literal)>;
+
+    DeltaGenerator(const std::string& path, std::vector<BlockSignature> signatures, uint32_t block_size,
+                   size_t max_literal);
+    DeltaGenerator(const DeltaGenerator&) = delete;
+    DeltaGenerator& operator=(const DeltaGenerator&) = delete;
+
+    bool open();
+    // 继续扫描，输出的指令累计达到 output_limit 字节或扫描完整个文件时返回，读取失败返回 false
+    bool generate(size_t output_limit, const CopyHandler& on_copy, const LiteralHandler& on_literal);
+    bool done() const { return done_; }
+
+private:
+    void refill();
+
+    std::string path_;
+    std::vector<BlockSignature> signatures_;
+    std::unordered_multimap<uint32_t, uint32_t> table_;   // 弱校验 -> 分块序号，第一次 generate 时建立
+    uint32_t block_size_;
+    size_t max_literal_;
+    size_t read_size_;
+    std::ifstream file_;
+    // 缓冲区中保存 [literal_start_, end) 的数据，literal 不超过 max_literal_，窗口不超过 block_size_
+    std::vector<char> buffer_;
+    size_t literal_start_;
+    size_t pos_;
+    bool eof_;
+    // 相邻的复制指令合并成一条，跨批次保留
+    uint32_t run_first_;
+    uint32_t run_count_;
+    RollingChecksum rolling_;
+    bool rolling_valid_;
+    bool done_;
+};
+
+// 客户端：根据差量指令用本地旧文件重建新文件，完成后替换旧文件
+class DeltaApplier {
+public:
+    DeltaApplier(const std::string& filename, uint64_t filesize, uint32_t block_size);
+
+    void expect_crc(uint32_t crc);    // 服务器给出的新文件 CRC32C，finish 时在改名前比较
+    bool open();
+    bool copy_blocks(uint32_t first_block, uint32_t block_count);
+    bool write_literal(std::string_view data);
+    bool finish();
+    void abort();
+
+    const std::string& filename() const { return filename_; }
+    const std::string& full_path() const { return full_path_; }
+    uint64_t filesize() const { return filesize_; }
+    const std::string& last_error() const { return last_error_; }
+    bool failed() const { return !last_error_.empty(); }
+
+private:
+    std::string filename_;
+    std::string full_path_;
+    std::string temp_path_;
+    uint64_t filesize_;
+    uint32_t block_size_;
+    uint64_t written_;
+    uint32_t crc_;                    // 已写出内容的 CRC32C
+    uint32_t expected_crc_;
+    bool has_expected_crc_;
+    std::ifstream basis_;
+    std::ofstream output_;
+    std::vector<char> copy_buffer_;
+    std::string last_error_;
+};
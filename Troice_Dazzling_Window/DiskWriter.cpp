@@ -0,0 +1,94 @@
+#include "DiskWriter.h"
+#include "Checksum.h"
+#include <algorithm>
+#include <atomic>
+
+DiskWriter::DiskWriter(size_t threads, size_t capacity)
+    : stopped_(false) {
+    threads = std::max<size_t>(threads, 1);
+    for (size_t i = 0; i < threads; ++i) {
+        lanes_.push_back(std::make_unique<Lane>(capacity));
+    }
+
+    for (auto& lane : lanes_) {
+        Lane& l = *lane;
+        receive(l);
+        l.thread = std::thread([&l]() { l.io_context.run(); });
+    }
+}
+
+DiskWriter::~DiskWriter() {
+    stop();
+}
+
+DiskWriter::Lane& DiskWriter::lane_for(std::string_view key) {
+    return *lanes_[fast_hash64(key.data(), key.size()) % lanes_.size()];
+}
+
+void DiskWriter::flush(const asio::any_io_executor& executor, std::function<void()> done) {
+    // 每个队列末尾放一个计数任务，最后一个执行完的负责回调
+    auto remaining = std::make_shared<std::atomic<size_t>>(lanes_.size());
+    for (auto& lane : lanes_) {
+        Job marker = [remaining, executor, done]() {
+            if (--*remaining == 0) {
+                asio::post(executor, done);
+            }
+        };
+        lane->channel.async_send(asio::error_code(), std::move(marker), [](const asio::error_code&) {});
+    }
+}
+
+void DiskWriter::stop() {
+    if (stopped_) {
+        return;
+    }
+    stopped_ = true;
+
+    // 空任务作为结束标记排在队尾，保证之前的写入全部完成
+    for (auto& lane : lanes_) {
+        lane->channel.async_send(asio::error_code(), Job(), [](const asio::error_code&) {});
+    }
+
+    // 任务持有拥有者的最后一个引用时，stop 会在写盘线程上被调用。这时不能等自己结束，
+    // 也不能让线程还在运行的 Lane 随对象一起销毁，把所有 Lane 交给一个单独的线程等待结束后释放
+    bool on_lane = std::any_of(lanes_.begin(), lanes_.end(), [](const std::unique_ptr<Lane>& lane) {
+        return lane->thread.get_id() == std::this_thread::get_id();
+    });
+    if (on_lane) {
+        auto lanes = std::make_shared<std::vector<std::unique_ptr<Lane>>>(std::move(lanes_));
+        lanes_.clear();
+        std::thread([lanes]() {
+            for (auto& lane : *lanes) {
+                if (lane->thread.joinable()) {
+                    lane->thread.join();
+                }
+            }
+        }).detach();
+        return;
+    }
+
+    for (auto& lane : lanes_) {
+        if (lane->thread.joinable()) {
+            lane->thread.join();
+        }
+    }
+}
+
+// 每个写盘线程一次只取一个任务，执行完再取下一个，队列中的任务按顺序执行。
+// 任务执行完后 DiskWriter 可能已经销毁，这里只能访问 lane
+void DiskWriter::receive(Lane& lane) {
+    lane.channel.async_receive([&lane](const asio::error_code& error, Job job) {
+        if (error || !job) {
+            return;
+        }
+
+        try {
+            job();
+        }
+        catch (const std::exception&) {
+            // 单个任务失败不影响后面的任务
+        }
+
+        receive(lane);
+    });
+}
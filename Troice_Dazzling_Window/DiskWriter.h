@@ -0,0 +1,246 @@
+#pragma once
+
+#include <asio.hpp>
+#include <asio/experimental/concurrent_channel.hpp>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <memory>
+#include <new>
+#include <thread>
+#include <functional>
+#include <type_traits>
+#include "HandlerMemory.h"
+
+// 写盘线程数
+const size_t DISK_WRITER_THREADS = 2;
+// 每个写盘线程的队列容量（任务数），队列满时网络线程暂停读取
+const size_t DISK_QUEUE_CAPACITY = 32;
+// 写盘任务闭包的内联存储大小，收包路径上每个数据块的闭包都放得下
+const size_t DISK_JOB_INLINE_SIZE = 96;
+
+// 写盘任务
+// 和 std::function 一样可以放任意闭包，但只能移动。闭包不超过 DISK_JOB_INLINE_SIZE 时直接放在任务对象里，
+// 每收到一个数据块提交一次任务也不分配内存；更大的闭包才放到堆上
+class DiskJob {
+public:
+    DiskJob() noexcept : ops_(nullptr) {}
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, DiskJob>>>
+    DiskJob(F&& f) : ops_(ops_for<std::decay_t<F>>()) {
+        using Fn = std::decay_t<F>;
+        if constexpr (fits_inline<Fn>()) {
+            new (storage_) Fn(std::forward<F>(f));
+        } else {
+            *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(f));
+        }
+    }
+
+    DiskJob(DiskJob&& other) noexcept : ops_(other.ops_) {
+        if (ops_) {
+            ops_->move(other.storage_, storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    DiskJob& operator=(DiskJob&& other) noexcept {
+        if (this != &other) {
+            reset();
+            ops_ = other.ops_;
+            if (ops_) {
+                ops_->move(other.storage_, storage_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    ~DiskJob() { reset(); }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+    void operator()() { ops_->invoke(storage_); }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* from, void* to) noexcept;   // 移动到 to 后销毁 from 中的闭包
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template <typename Fn>
+    static constexpr bool fits_inline() {
+        return sizeof(Fn) <= DISK_JOB_INLINE_SIZE && alignof(Fn) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible_v<Fn>;
+    }
+
+    template <typename Fn>
+    static const Ops* ops_for() {
+        if constexpr (fits_inline<Fn>()) {
+            static const Ops ops = {
+                [](void* storage) { (*static_cast<Fn*>(storage))(); },
+                [](void* from, void* to) noexcept {
+                    Fn* source = static_cast<Fn*>(from);
+                    new (to) Fn(std::move(*source));
+                    source->~Fn();
+                },
+                [](void* storage) noexcept { static_cast<Fn*>(storage)->~Fn(); } };
+            return &ops;
+        } else {
+            // 存储区里只放堆上闭包的指针
+            static const Ops ops = {
+                [](void* storage) { (**static_cast<Fn**>(storage))(); },
+                [](void* from, void* to) noexcept { *static_cast<Fn**>(to) = *static_cast<Fn**>(from); },
+                [](void* storage) noexcept { delete *static_cast<Fn**>(storage); } };
+            return &ops;
+        }
+    }
+
+    void reset() noexcept {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[DISK_JOB_INLINE_SIZE];
+    const Ops* ops_;
+};
+
+// 写盘队列缓存任务的容器
+// asio 的 channel 默认用 std::deque，deque 按几百字节的节点分配，队列向前推进时不断释放和分配节点。
+// 换成只增长不收缩的环形数组，队列到过的最大深度之后不再分配内存
+template <typename T>
+class DiskQueueBuffer {
+public:
+    DiskQueueBuffer() = default;
+
+    DiskQueueBuffer(DiskQueueBuffer&& other) noexcept
+        : slots_(std::move(other.slots_)), head_(other.head_), size_(other.size_) {
+        other.slots_.clear();
+        other.head_ = 0;
+        other.size_ = 0;
+    }
+
+    DiskQueueBuffer& operator=(DiskQueueBuffer&& other) noexcept {
+        if (this != &other) {
+            slots_ = std::move(other.slots_);
+            head_ = other.head_;
+            size_ = other.size_;
+            other.slots_.clear();
+            other.head_ = 0;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T& front() { return *slots_[head_]; }
+
+    void push_back(T&& value) {
+        if (size_ == slots_.size()) {
+            grow();
+        }
+        slots_[(head_ + size_) % slots_.size()].emplace(std::move(value));
+        ++size_;
+    }
+
+    void pop_front() {
+        slots_[head_].reset();
+        head_ = (head_ + 1) % slots_.size();
+        --size_;
+    }
+
+    void clear() {
+        while (size_ > 0) {
+            pop_front();
+        }
+    }
+
+private:
+    void grow() {
+        std::vector<std::optional<T>> slots(slots_.empty() ? DISK_QUEUE_CAPACITY : slots_.size() * 2);
+        for (size_t i = 0; i < size_; ++i) {
+            slots[i].emplace(std::move(*slots_[(head_ + i) % slots_.size()]));
+        }
+        slots_ = std::move(slots);
+        head_ = 0;
+    }
+
+    std::vector<std::optional<T>> slots_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
+
+// 写盘队列的 channel traits，只把缓存任务的容器换成 DiskQueueBuffer
+template <typename... Signatures>
+struct DiskQueueTraits : asio::experimental::channel_traits<Signatures...> {
+    template <typename... NewSignatures>
+    struct rebind {
+        using other = DiskQueueTraits<NewSignatures...>;
+    };
+
+    template <typename Element>
+    struct container {
+        using type = DiskQueueBuffer<Element>;
+    };
+};
+
+// 网络线程和磁盘之间的写盘流水线
+// 每个写盘线程有自己的有界队列，同一个 key（通常是文件名）的任务总是进同一个队列，按提交顺序执行；
+// 不同文件的写入可以在不同线程上并行。
+class DiskWriter {
+public:
+    using Job = DiskJob;
+
+    explicit DiskWriter(size_t threads = DISK_WRITER_THREADS, size_t capacity = DISK_QUEUE_CAPACITY);
+    ~DiskWriter();
+    DiskWriter(const DiskWriter&) = delete;
+    DiskWriter& operator=(const DiskWriter&) = delete;
+
+    // 把任务放进 key 对应的队列。任务入队后在 executor 上调用 on_queued，
+    // 队列满时回调会一直推迟到有空位，调用方据此实现背压。
+    // 回调不转成 std::function，连同内存一起放在队列自己的 HandlerMemory 里，
+    // on_queued 应当持有 DiskWriter 的拥有者，保证回调执行前队列还在
+    template <typename OnQueued>
+    void submit(std::string_view key, Job job, const asio::any_io_executor& executor, OnQueued on_queued) {
+        Lane& lane = lane_for(key);
+
+        // 队列关闭时也要回调，否则调用方会一直停在背压状态。
+        // 有空位时 async_send 立即完成，这个完成默认经过队列自己的 io_context，写盘线程正在执行任务时
+        // 要等任务执行完才轮到它，队列实际只有一个任务深。绑定不阻塞的立即执行器，直接投递到 executor
+        lane.channel.async_send(asio::error_code(), std::move(job),
+            asio::bind_executor(executor, asio::bind_immediate_executor(
+                asio::require(executor, asio::execution::blocking.never),
+                bind_handler_memory(lane.send_memory,
+                    [on_queued = std::move(on_queued)](const asio::error_code&) mutable {
+                        on_queued();
+                    }))));
+    }
+
+    // 所有队列中此前提交的任务都执行完后，在 executor 上调用 done，写盘线程继续运行
+    void flush(const asio::any_io_executor& executor, std::function<void()> done);
+
+    // 执行完所有已入队的任务后停止写盘线程。可以在任务中调用（例如任务释放了拥有者），
+    // 这时不等待，写盘线程在剩余任务完成后由后台线程回收。stop 之后不能再提交任务
+    void stop();
+
+private:
+    using Channel = asio::experimental::basic_concurrent_channel<asio::any_io_executor, DiskQueueTraits<>,
+                                                                void(asio::error_code, Job)>;
+
+    struct Lane {
+        HandlerMemory send_memory;   // 入队回调的内存，在提交任务的线程上分配，可能在写盘线程上归还
+        asio::io_context io_context;
+        Channel channel;
+        std::thread thread;
+
+        explicit Lane(size_t capacity) : channel(io_context, capacity) {}
+    };
+
+    Lane& lane_for(std::string_view key);
+    static void receive(Lane& lane);
+
+    std::vector<std::unique_ptr<Lane>> lanes_;
+    bool stopped_;
+};
@@ -0,0 +1,173 @@
+#include "FileSink.h"
+#include <cstring>
+
+#if defined(ASIO_HAS_FILE) && !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+AsyncFileSink::AsyncFileSink(asio::io_context& io_context, size_t queue_depth)
+    : io_context_(io_context), queue_depth_(queue_depth == 0 ? 1 : queue_depth), in_flight_(0)
+#if defined(ASIO_HAS_FILE)
+    , file_(io_context)
+#endif
+{
+}
+
+#if defined(ASIO_HAS_FILE)
+
+const char* AsyncFileSink::backend_name() {
+#if defined(ASIO_HAS_IO_URING)
+    return "io_uring";
+#else
+    return "iocp";
+#endif
+}
+
+bool AsyncFileSink::open(const std::string& path, bool truncate) {
+    close();
+
+    asio::file_base::flags flags = asio::file_base::read_write | asio::file_base::create;
+    if (truncate) {
+        flags = flags | asio::file_base::truncate;
+    }
+
+    asio::error_code ec;
+    file_.open(path, flags, ec);
+    if (ec) {
+        return false;
+    }
+
+    // 缓冲区只分配和注册一次，文件重新打开时继续使用
+    if (!registration_) {
+        slots_.resize(queue_depth_);
+        std::vector<asio::mutable_buffer> buffers;
+        for (auto& slot : slots_) {
+            slot.resize(FILE_SINK_SLOT_SIZE);
+            buffers.push_back(asio::buffer(slot));
+        }
+        registration_ = std::make_unique<Registration>(asio::register_buffers(io_context_, buffers));
+
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            free_slots_.push_back(i);
+        }
+    }
+    return true;
+}
+
+bool AsyncFileSink::resize(uint64_t size) {
+    asio::error_code ec;
+    file_.resize(size, ec);
+    return !ec;
+}
+
+bool AsyncFileSink::flush() {
+    if (!file_.is_open()) {
+        return false;
+    }
+#ifdef _WIN32
+    return FlushFileBuffers(file_.native_handle()) != 0;
+#else
+    return ::fdatasync(file_.native_handle()) == 0;
+#endif
+}
+
+void AsyncFileSink::close() {
+    // 排队中的写入不再发起，在途的写入会以错误完成
+    while (!waiting_.empty()) {
+        WriteHandler handler = std::move(waiting_.front().handler);
+        waiting_.pop_front();
+        asio::post(io_context_, [handler = std::move(handler)]() { handler(false); });
+    }
+
+    asio::error_code ec;
+    file_.close(ec);
+}
+
+bool AsyncFileSink::is_open() const {
+    return file_.is_open();
+}
+
+void AsyncFileSink::async_write_at(uint64_t offset, std::string_view data, WriteHandler handler) {
+    if (data.size() > FILE_SINK_SLOT_SIZE) {
+        // 超过固定缓冲区大小的数据不走注册缓冲区
+        auto buffer = std::make_shared<std::string>(data);
+        ++in_flight_;
+        asio::async_write_at(file_, offset, asio::buffer(*buffer),
+            [self = shared_from_this(), buffer, handler = std::move(handler)](const asio::error_code& error, size_t) {
+                --self->in_flight_;
+                handler(!error);
+            });
+        return;
+    }
+
+    if (free_slots_.empty()) {
+        waiting_.push_back({ offset, std::string(data), std::move(handler) });
+        return;
+    }
+
+    size_t slot = free_slots_.back();
+    free_slots_.pop_back();
+    std::memcpy(slots_[slot].data(), data.data(), data.size());
+    start_write(slot, offset, data.size(), std::move(handler));
+}
+
+void AsyncFileSink::start_write(size_t slot, uint64_t offset, size_t size, WriteHandler handler) {
+    ++in_flight_;
+    asio::async_write_at(file_, offset, asio::buffer((*registration_)[slot], size),
+        [self = shared_from_this(), slot, handler = std::move(handler)](const asio::error_code& error, size_t) {
+            --self->in_flight_;
+            self->release_slot(slot);
+            handler(!error);
+        });
+}
+
+// 缓冲区空出来后优先给排队中的写入
+void AsyncFileSink::release_slot(size_t slot) {
+    if (waiting_.empty() || !file_.is_open()) {
+        free_slots_.push_back(slot);
+        return;
+    }
+
+    PendingWrite next = std::move(waiting_.front());
+    waiting_.pop_front();
+    std::memcpy(slots_[slot].data(), next.data.data(), next.data.size());
+    start_write(slot, next.offset, next.data.size(), std::move(next.handler));
+}
+
+#else
+
+const char* AsyncFileSink::backend_name() {
+    return "positional";
+}
+
+bool AsyncFileSink::open(const std::string& path, bool truncate) {
+    return file_.open(path, truncate);
+}
+
+bool AsyncFileSink::resize(uint64_t size) {
+    return file_.resize(size);
+}
+
+bool AsyncFileSink::flush() {
+    return file_.flush();
+}
+
+void AsyncFileSink::close() {
+    file_.close();
+}
+
+bool AsyncFileSink::is_open() const {
+    return file_.is_open();
+}
+
+// 没有异步文件支持时同步写入，回调仍然通过 io_context 异步执行，调用方看到的行为一致
+void AsyncFileSink::async_write_at(uint64_t offset, std::string_view data, WriteHandler handler) {
+    bool ok = file_.write_at(offset, data.data(), data.size());
+    ++in_flight_;
+    asio::post(io_context_, [self = shared_from_this(), ok, handler = std::move(handler)]() {
+        --self->in_flight_;
+        handler(ok);
+    });
+}
+
+#endif
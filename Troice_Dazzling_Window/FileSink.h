@@ -0,0 +1,71 @@
+#pragma once
+
+#include <asio.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include "Protocol.h"
+#include "FileTransfer.h"
+
+// 每个文件同时在途的写入数
+const size_t FILE_SINK_QUEUE_DEPTH = 16;
+// 预先注册的写缓冲区大小，和 FILE_CHUNK_SIZE 一致
+const size_t FILE_SINK_SLOT_SIZE = FILE_CHUNK_SIZE;
+
+// 异步按偏移写文件
+// asio 支持文件操作时（Windows 上是 IOCP，Linux 上定义了 ASIO_HAS_IO_URING 时是 io_uring），
+// 数据先拷贝到预先注册的固定缓冲区，再用 async_write_at 发起，最多 queue_depth 个写入同时在途，
+// 多出来的写入排队等空闲缓冲区；否则退回到 PositionalFile 同步写入。
+// 完成回调都在构造时传入的 io_context 上执行。
+class AsyncFileSink : public std::enable_shared_from_this<AsyncFileSink> {
+public:
+    using WriteHandler = std::function<void(bool)>;
+
+    explicit AsyncFileSink(asio::io_context& io_context, size_t queue_depth = FILE_SINK_QUEUE_DEPTH);
+    AsyncFileSink(const AsyncFileSink&) = delete;
+    AsyncFileSink& operator=(const AsyncFileSink&) = delete;
+
+    bool open(const std::string& path, bool truncate);
+    bool resize(uint64_t size);
+    bool flush();   // 同步等待已完成的写入落盘
+    void close();
+    bool is_open() const;
+
+    // 拷贝 data 后发起写入，调用返回后 data 即可复用
+    void async_write_at(uint64_t offset, std::string_view data, WriteHandler handler);
+
+    // 已发起或排队中还没完成的写入数
+    size_t in_flight() const { return in_flight_ + waiting_.size(); }
+
+    // 当前编译使用的写入方式，用于统计和日志
+    static const char* backend_name();
+
+private:
+    struct PendingWrite {
+        uint64_t offset;
+        std::string data;
+        WriteHandler handler;
+    };
+
+    asio::io_context& io_context_;
+    size_t queue_depth_;
+    size_t in_flight_;
+    std::deque<PendingWrite> waiting_;
+#if defined(ASIO_HAS_FILE)
+    void start_write(size_t slot, uint64_t offset, size_t size, WriteHandler handler);
+    void release_slot(size_t slot);
+
+    using Registration = asio::buffer_registration<std::vector<asio::mutable_buffer>>;
+
+    asio::random_access_file file_;
+    std::vector<std::vector<char>> slots_;          // 固定写缓冲区，注册后地址不能变
+    std::unique_ptr<Registration> registration_;
+    std::vector<size_t> free_slots_;
+#else
+    PositionalFile file_;
+#endif
+};
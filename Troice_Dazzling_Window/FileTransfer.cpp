@@ -0,0 +1,459 @@
+#include "FileTransfer.h"
+#include "Checksum.h"
+#include "HashCache.h"
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+namespace {
+    const std::string DATA_PATH = ".\\Data";
+    const std::string PART_SUFFIX = ".part";
+    const std::string JOURNAL_SUFFIX = ".part.journal";
+
+    bool read_journal(const std::string& path, PartJournal& journal) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+
+        // 版本 1 的日志较短，读出来的 flags 保持为 0
+        journal = PartJournal();
+        file.read(reinterpret_cast<char*>(&journal), sizeof(journal));
+        size_t expected = journal.version < 2 ? PART_JOURNAL_V1_SIZE : sizeof(journal);
+        return static_cast<size_t>(file.gcount()) >= expected && journal.magic == PART_JOURNAL_MAGIC &&
+               journal.verified <= journal.filesize;
+    }
+}
+
+PositionalFile::PositionalFile()
+#ifdef _WIN32
+    : handle_(INVALID_HANDLE_VALUE) {}
+#else
+    : fd_(-1) {}
+#endif
+
+PositionalFile::~PositionalFile() {
+    close();
+}
+
+bool PositionalFile::open(const std::string& path, bool truncate) {
+    close();
+#ifdef _WIN32
+    std::wstring wpath = std::filesystem::path(path).wstring();
+    handle_ = CreateFileW(wpath.c_str(), GENERIC_READ | GENERIC_WRITE,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                          truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+#else
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+#endif
+    return is_open();
+}
+
+bool PositionalFile::write_at(uint64_t offset, const char* data, size_t size) {
+#ifdef _WIN32
+    while (size > 0) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD to_write = static_cast<DWORD>(size > 0x40000000 ? 0x40000000 : size);
+        DWORD written = 0;
+        if (!WriteFile(handle_, data, to_write, &written, &overlapped) || written == 0) {
+            return false;
+        }
+        data += written;
+        offset += written;
+        size -= written;
+    }
+#else
+    while (size > 0) {
+        ssize_t written = ::pwrite(fd_, data, size, static_cast<off_t>(offset));
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        offset += static_cast<uint64_t>(written);
+        size -= static_cast<size_t>(written);
+    }
+#endif
+    return true;
+}
+
+bool PositionalFile::resize(uint64_t size) {
+#ifdef _WIN32
+    FILE_END_OF_FILE_INFO info = {};
+    info.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+    return SetFileInformationByHandle(handle_, FileEndOfFileInfo, &info, sizeof(info)) != 0;
+#else
+    return ::ftruncate(fd_, static_cast<off_t>(size)) == 0;
+#endif
+}
+
+bool PositionalFile::flush() {
+#ifdef _WIN32
+    return FlushFileBuffers(handle_) != 0;
+#else
+    return ::fdatasync(fd_) == 0;
+#endif
+}
+
+void PositionalFile::close() {
+#ifdef _WIN32
+    if (handle_ != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle_);
+        handle_ = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+#endif
+}
+
+bool PositionalFile::is_open() const {
+#ifdef _WIN32
+    return handle_ != INVALID_HANDLE_VALUE;
+#else
+    return fd_ >= 0;
+#endif
+}
+
+MappedFile::MappedFile()
+    :
+#ifdef _WIN32
+      file_(INVALID_HANDLE_VALUE), mapping_(NULL),
+#endif
+      view_(nullptr), view_size_(0), data_(nullptr), size_(0) {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path, uint64_t offset, size_t length) {
+    close();
+    if (length == 0) {
+        return false;
+    }
+
+#ifdef _WIN32
+    std::wstring wpath = std::filesystem::path(path).wstring();
+    file_ = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file_ == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    mapping_ = CreateFileMappingW(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_ == NULL) {
+        close();
+        return false;
+    }
+
+    // 映射起点必须按分配粒度对齐
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    uint64_t aligned = offset - offset % info.dwAllocationGranularity;
+    size_t delta = static_cast<size_t>(offset - aligned);
+
+    view_size_ = length + delta;
+    view_ = MapViewOfFile(mapping_, FILE_MAP_READ, static_cast<DWORD>(aligned >> 32),
+                          static_cast<DWORD>(aligned & 0xFFFFFFFF), view_size_);
+    if (view_ == NULL) {
+        view_ = nullptr;
+        close();
+        return false;
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t aligned = offset - offset % page;
+    size_t delta = static_cast<size_t>(offset - aligned);
+
+    view_size_ = length + delta;
+    void* view = mmap(nullptr, view_size_, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(aligned));
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    view_ = view;
+    madvise(view_, view_size_, MADV_SEQUENTIAL);
+#endif
+
+    data_ = static_cast<const char*>(view_) + delta;
+    size_ = length;
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (view_) UnmapViewOfFile(view_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+    mapping_ = NULL;
+    file_ = INVALID_HANDLE_VALUE;
+#else
+    if (view_) munmap(view_, view_size_);
+#endif
+    view_ = nullptr;
+    view_size_ = 0;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+std::string data_file_path(const std::string& filename) {
+    return DATA_PATH + "\\" + filename;
+}
+
+std::string part_file_path(const std::string& filename) {
+    return data_file_path(filename) + PART_SUFFIX;
+}
+
+bool write_part_journal(const std::string& filename, uint64_t filesize, uint64_t verified, uint32_t crc,
+                        bool has_crc) {
+    PositionalFile file;
+    return file.open(data_file_path(filename) + JOURNAL_SUFFIX, true) &&
+           write_part_journal(file, filesize, verified, crc, has_crc);
+}
+
+// 日志长度固定，覆盖写入就能替换整个日志，不会分配内存
+bool write_part_journal(PositionalFile& file, uint64_t filesize, uint64_t verified, uint32_t crc, bool has_crc) {
+    PartJournal journal;
+    journal.magic = PART_JOURNAL_MAGIC;
+    journal.filesize = filesize;
+    journal.verified = verified;
+    if (has_crc) {
+        journal.crc = crc;
+        journal.flags = PART_JOURNAL_HAS_CRC;
+    }
+    return file.write_at(0, reinterpret_cast<const char*>(&journal), sizeof(journal));
+}
+
+bool read_part_journal(const std::string& filename, PartJournal& journal) {
+    return read_journal(data_file_path(filename) + JOURNAL_SUFFIX, journal);
+}
+
+bool commit_part_file(const std::string& filename, std::string& error) {
+    try {
+        std::string full_path = data_file_path(filename);
+        std::filesystem::rename(full_path + PART_SUFFIX, full_path);
+        std::filesystem::remove(full_path + JOURNAL_SUFFIX);
+    }
+    catch (const std::filesystem::filesystem_error& e) {
+        error = "重命名文件失败: " + std::string(e.what());
+        return false;
+    }
+    return true;
+}
+
+void discard_part_file(const std::string& filename) {
+    std::string full_path = data_file_path(filename);
+    std::error_code ec;
+    std::filesystem::remove(full_path + PART_SUFFIX, ec);
+    std::filesystem::remove(full_path + JOURNAL_SUFFIX, ec);
+}
+
+bool ensure_data_directory(std::string& error) {
+    try {
+        if (!std::filesystem::exists(DATA_PATH)) {
+            std::filesystem::create_directory(DATA_PATH);
+        }
+    }
+    catch (const std::filesystem::filesystem_error& e) {
+        error = "创建Data目录失败: " + std::string(e.what());
+        return false;
+    }
+    return true;
+}
+
+bool write_data_file(const std::string& filename, std::string_view content, std::string& error) {
+    if (!ensure_data_directory(error)) {
+        return false;
+    }
+
+    std::string part_path = part_file_path(filename);
+    PositionalFile file;
+    if (!file.open(part_path, true)) {
+        error = "无法打开文件进行写入: " + part_path;
+        return false;
+    }
+
+    if (!file.write_at(0, content.data(), content.size())) {
+        error = "文件写入失败: " + part_path;
+        return false;
+    }
+    file.close();
+    return commit_part_file(filename, error);
+}
+
+FileReceiver::FileReceiver(const std::string& filename, uint64_t filesize, uint64_t offset)
+    : filename_(filename), filesize_(filesize), offset_(offset), received_(offset), journaled_(offset),
+      crc_(0), crc_known_(offset == 0), expected_crc_(0), has_expected_crc_(false), checksum_failed_(false) {
+    full_path_ = data_file_path(filename_);
+    part_path_ = full_path_ + PART_SUFFIX;
+    journal_path_ = full_path_ + JOURNAL_SUFFIX;
+}
+
+void FileReceiver::expect_crc(uint32_t crc) {
+    expected_crc_ = crc;
+    has_expected_crc_ = true;
+}
+
+bool FileReceiver::open() {
+    // 确保目录存在
+    if (!ensure_data_directory(last_error_)) {
+        return false;
+    }
+
+    if (offset_ != 0) {
+        // 续传时偏移不能超过日志中已确认的长度
+        PartJournal journal;
+        if (!read_journal(journal_path_, journal) || journal.filesize != filesize_ ||
+            journal.verified < offset_) {
+            last_error_ = "续传日志无效: " + filename_;
+            return false;
+        }
+
+        // 从日志记录的前缀 CRC 接着累计
+        if ((journal.flags & PART_JOURNAL_HAS_CRC) && journal.verified == offset_) {
+            crc_ = journal.crc;
+            crc_known_ = true;
+        }
+    }
+
+    if (!file_.open(part_path_, offset_ == 0)) {
+        last_error_ = "无法打开文件进行写入: " + part_path_;
+        return false;
+    }
+    // 续传时日志已经读过，截断后马上写入当前位置
+    if (!journal_file_.open(journal_path_, true)) {
+        last_error_ = "无法打开续传日志: " + journal_path_;
+        return false;
+    }
+    return write_journal();
+}
+
+bool FileReceiver::write_chunk(std::string_view data) {
+    if (received_ + data.size() > filesize_) {
+        last_error_ = "收到的数据超过文件大小: " + filename_;
+        return false;
+    }
+
+    // 按偏移写入，不依赖文件指针，也没有用户态缓冲
+    if (!file_.write_at(received_, data.data(), data.size())) {
+        last_error_ = "文件写入失败: " + part_path_;
+        return false;
+    }
+
+    received_ += data.size();
+    if (crc_known_) {
+        crc_ = crc32c(crc_, data.data(), data.size());
+    }
+
+    // 定期更新日志，日志记录的长度一定已经写入文件
+    if (received_ - journaled_ >= JOURNAL_INTERVAL) {
+        if (!write_journal()) {
+            last_error_ = "更新续传日志失败: " + journal_path_;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FileReceiver::finish() {
+    // 改名和删除日志之前先关闭，Windows 上打开着的文件不能删除
+    file_.close();
+    journal_file_.close();
+
+    if (received_ != filesize_) {
+        last_error_ = "文件大小不匹配！预期: " + std::to_string(filesize_) +
+                      " 实际: " + std::to_string(received_);
+        return false;
+    }
+
+    // 内容不对的 .part 留着续传也没用，直接删除
+    if (crc_known_ && has_expected_crc_ && crc_ != expected_crc_) {
+        last_error_ = "文件校验失败: " + filename_ + " CRC " + std::to_string(crc_) +
+                      " 预期 " + std::to_string(expected_crc_);
+        checksum_failed_ = true;
+        discard_part_file(filename_);
+        return false;
+    }
+
+    if (!commit_part_file(filename_, last_error_)) {
+        return false;
+    }
+    if (crc_known_) {
+        remember_verified_hash(filename_, crc_);
+    }
+    return true;
+}
+
+void FileReceiver::suspend() {
+    if (!file_.is_open()) {
+        return;
+    }
+
+    write_journal();
+    file_.close();
+    journal_file_.close();
+}
+
+bool FileReceiver::write_journal() {
+    // 日志只能在数据落盘之后前进，否则断电后续传会跳过没写进去的内容
+    if (!file_.flush() || !write_part_journal(journal_file_, filesize_, received_, crc_, crc_known_)) {
+        return false;
+    }
+
+    journaled_ = received_;
+    return true;
+}
+
+uint64_t FileReceiver::resume_offset(const std::string& filename, uint64_t filesize) {
+    std::string full_path = data_file_path(filename);
+
+    PartJournal journal;
+    if (!read_journal(full_path + JOURNAL_SUFFIX, journal)) {
+        return 0;
+    }
+
+    // 服务器上的文件已经换了，旧的前缀不能接着用
+    if (journal.filesize != filesize) {
+        return 0;
+    }
+
+    // .part 文件比日志记录的还短，说明日志不可信
+    std::error_code ec;
+    auto part_size = std::filesystem::file_size(full_path + PART_SUFFIX, ec);
+    if (ec || part_size < journal.verified) {
+        return 0;
+    }
+    return journal.verified;
+}
+
+std::vector<std::string> FileReceiver::pending_downloads() {
+    std::vector<std::string> files;
+
+    std::error_code ec;
+    if (!std::filesystem::exists(DATA_PATH, ec)) {
+        return files;
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(DATA_PATH, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() > JOURNAL_SUFFIX.size() &&
+            name.compare(name.size() - JOURNAL_SUFFIX.size(), JOURNAL_SUFFIX.size(), JOURNAL_SUFFIX) == 0) {
+            files.push_back(name.substr(0, name.size() - JOURNAL_SUFFIX.size()));
+        }
+    }
+    return files;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+// 续传日志，记录 .part 文件中已确认写入磁盘的前缀长度
+// 版本 2 起同时记录前缀的 CRC32C，续传后接着累计，完成时不必重新读取前缀
+#pragma pack(push, 1)
+struct PartJournal {
+    uint32_t magic;      // 固定为 PART_JOURNAL_MAGIC
+    uint32_t version;    // 日志格式版本
+    uint64_t filesize;   // 完整文件大小
+    uint64_t verified;   // 已落盘的前缀长度
+    uint32_t crc;        // [0, verified) 的 CRC32C，flags 中有 PART_JOURNAL_HAS_CRC 时有效
+    uint32_t flags;
+
+    PartJournal() : magic(0), version(2), filesize(0), verified(0), crc(0), flags(0) {}
+};
+#pragma pack(pop)
+
+const uint32_t PART_JOURNAL_MAGIC = 0x4A574454;   // "TDWJ"
+const uint32_t PART_JOURNAL_HAS_CRC = 1;
+// 版本 1 的日志没有 crc 和 flags
+const size_t PART_JOURNAL_V1_SIZE = 24;
+
+// 每写入这么多字节刷新一次文件并更新续传日志
+// 每次都要等数据真正写到磁盘，间隔太小会拖慢写入
+const uint64_t JOURNAL_INTERVAL = 16 * 1024 * 1024;
+
+// 支持按偏移写入的文件，多个连接可以同时写同一个文件的不同区域
+class PositionalFile {
+public:
+    PositionalFile();
+    ~PositionalFile();
+    PositionalFile(const PositionalFile&) = delete;
+    PositionalFile& operator=(const PositionalFile&) = delete;
+
+    bool open(const std::string& path, bool truncate);
+    bool write_at(uint64_t offset, const char* data, size_t size);
+    bool resize(uint64_t size);   // 预先分配文件大小
+    bool flush();                 // 等已写入的数据落盘
+    void close();
+    bool is_open() const;
+
+private:
+#ifdef _WIN32
+    void* handle_;
+#else
+    int fd_;
+#endif
+};
+
+// 只读映射文件中的一段，用于大文件校验
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path, uint64_t offset, size_t length);
+    void close();
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+#ifdef _WIN32
+    void* file_;
+    void* mapping_;
+#endif
+    void* view_;
+    size_t view_size_;
+    const char* data_;
+    size_t size_;
+};
+
+// Data 目录下文件的完整路径，以及对应的 .part 文件路径
+std::string data_file_path(const std::string& filename);
+std::string part_file_path(const std::string& filename);
+// 写入续传日志，verified 为已落盘的连续前缀长度，has_crc 为 false 时 crc 不记录
+bool write_part_journal(const std::string& filename, uint64_t filesize, uint64_t verified, uint32_t crc,
+                        bool has_crc);
+// 写到已经打开的日志文件，反复更新同一个日志时不用每次重新打开
+bool write_part_journal(PositionalFile& file, uint64_t filesize, uint64_t verified, uint32_t crc, bool has_crc);
+// 读取文件的续传日志，兼容版本 1
+bool read_part_journal(const std::string& filename, PartJournal& journal);
+// 下载完成后把 .part 改名为正式文件并删除日志
+bool commit_part_file(const std::string& filename, std::string& error);
+// 校验失败时删除 .part 和日志，下次从头下载
+void discard_part_file(const std::string& filename);
+// 确保 Data 目录存在
+bool ensure_data_directory(std::string& error);
+// 把完整的文件内容先写到 .part 再改名，替换过程中不会留下写了一半的正式文件
+bool write_data_file(const std::string& filename, std::string_view content, std::string& error);
+
+// 分块文件接收器
+// 每收到一个 FILE_CHUNK 就直接写入 <文件名>.part，内存占用只与块大小有关，与文件大小无关。
+// 传输完成后再改名为正式文件；中途断开时保留 .part 和 .part.journal 供下次续传。
+// 每个数据块写入时顺便累计整个文件的 CRC32C，服务器给出了 CRC 时在改名前比较，不再重新读取文件。
+class FileReceiver {
+public:
+    FileReceiver(const std::string& filename, uint64_t filesize, uint64_t offset = 0);
+
+    void expect_crc(uint32_t crc);            // 服务器给出的整个文件的 CRC32C
+    bool open();                              // 创建目录并打开 .part 文件
+    bool write_chunk(std::string_view data);  // 写入一个数据块
+    bool finish();                            // 校验大小和 CRC 并改名为正式文件
+    void suspend();                           // 连接中断时刷新数据并记录续传位置
+
+    const std::string& filename() const { return filename_; }
+    const std::string& full_path() const { return full_path_; }
+    uint64_t filesize() const { return filesize_; }
+    uint64_t received() const { return received_; }
+    const std::string& last_error() const { return last_error_; }
+    bool failed() const { return !last_error_.empty(); }
+    bool checksum_failed() const { return checksum_failed_; }   // finish 发现 CRC 与服务器不一致
+
+    // 查询某个文件可续传的偏移，没有可用日志、或日志记录的文件大小与服务器现在的 filesize 不同时返回 0
+    static uint64_t resume_offset(const std::string& filename, uint64_t filesize);
+    // 列出 Data 目录下所有未完成的下载
+    static std::vector<std::string> pending_downloads();
+
+private:
+    bool write_journal();
+
+    std::string filename_;
+    std::string full_path_;
+    std::string part_path_;
+    std::string journal_path_;
+    uint64_t filesize_;
+    uint64_t offset_;
+    uint64_t received_;          // 含续传偏移在内的已接收字节数
+    uint64_t journaled_;         // 上次写入日志时的位置
+    uint32_t crc_;               // [0, received_) 的 CRC32C
+    bool crc_known_;             // 续传时日志中没有前缀的 CRC 则为 false，只校验大小
+    uint32_t expected_crc_;
+    bool has_expected_crc_;
+    bool checksum_failed_;
+    PositionalFile file_;
+    PositionalFile journal_file_;   // 接收期间一直打开，定期更新时覆盖写入
+    std::string last_error_;
+};
@@ -1,10 +1,15 @@
 #include "GameManager.h"
+#include "Checksum.h"
 #include <string>
 #include <vector>
 #include <asio.hpp>
 #include <filesystem>
 #include <fstream>
 #include <string_view>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <future>
 
 // 定义 ServerInfo 的静态成员变量
 std::string ServerInfo::ip;
@@ -19,306 +24,1415 @@ asio::io_context global_io_context;
 // 定义全局客户端指针
 std::shared_ptr<Client> g_client;
 
-void ConvertAndShowMessage(const std::string& cmdContent)
-{
-    int wlen = MultiByteToWideChar(CP_UTF8, 0, cmdContent.c_str(), -1, NULL, 0);
-    if (wlen > 0) {
-        std::wstring wstr(wlen, 0);
-        MultiByteToWideChar(CP_UTF8, 0, cmdContent.c_str(), -1, &wstr[0], wlen);
-        MessageBoxW(NULL, wstr.c_str(), L"客户端到消息", MB_OK);
+// 定义补丁校验器
+std::shared_ptr<PatchVerifier> g_verifier;
+
+namespace {
+    // 在写盘线程上写入一个数据块，每跨过一个进度间隔报告一次进度
+    void write_received_chunk(FileReceiver& receiver, std::string_view data) {
+        uint64_t before = receiver.received();
+        if (!receiver.write_chunk(data)) {
+            post_error(receiver.last_error());
+            return;
+        }
+
+        if (before / PROGRESS_REPORT_INTERVAL != receiver.received() / PROGRESS_REPORT_INTERVAL) {
+            post_progress(receiver.filename(), receiver.received(), receiver.filesize());
+        }
+    }
+
+    // 在写盘线程上写入 FILE_CHUNK / STREAM_DATA 的数据，压缩块是独立的 zlib 流，先解压再写
+    void write_wire_chunk(FileReceiver& receiver, std::string_view body, bool compressed) {
+        if (receiver.failed()) {
+            return;
+        }
+        if (!compressed) {
+            write_received_chunk(receiver, body);
+            return;
+        }
+
+        // 解压缓冲区在同一个写盘线程的任务之间复用
+        thread_local std::vector<char> inflate_buffer;
+        if (!inflate_chunk(body, inflate_buffer)) {
+            post_error("解压数据块失败");
+            return;
+        }
+        write_received_chunk(receiver, std::string_view(inflate_buffer.data(), inflate_buffer.size()));
     }
+
+    // 携带文件内容的消息，消息体读进缓冲池的块，不超过 CHUNK_BUFFER_SIZE
+    bool carries_file_data(uint16_t message_type) {
+        switch (static_cast<MessageType>(message_type)) {
+        case MessageType::FILE_CHUNK:
+        case MessageType::FILE_CHUNK_Z:
+        case MessageType::STREAM_DATA:
+        case MessageType::STREAM_DATA_Z:
+        case MessageType::DELTA_LITERAL:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // 窗口归还的时机取决于写盘速度，回放时不参与出站比较
+    bool is_window_update(const std::string& packet) {
+        PacketHeader header;
+        std::memcpy(&header, packet.data(), PACKET_HEADER_SIZE);
+        return header.messageType == static_cast<uint16_t>(MessageType::WINDOW_UPDATE);
+    }
+
+#if defined(ASIO_HAS_CO_AWAIT)
+    // 出错时返回错误码而不是抛异常，和回调版的处理方式一致
+    constexpr auto use_nothrow_awaitable = asio::as_tuple(asio::use_awaitable);
+
+    // 协程中的异常和回调版一样从 io_context::run 抛出，不被丢弃
+    void rethrow_exception(std::exception_ptr error) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // 定时器设为永不到期，当作信号使用，cancel() 唤醒等待的协程
+    asio::awaitable<void> wait_signal(asio::steady_timer& signal, HandlerMemory& memory) {
+        signal.expires_at(std::chrono::steady_clock::time_point::max());
+        co_await signal.async_wait(bind_handler_memory(memory, use_nothrow_awaitable));
+    }
+#endif
 }
 
 // 客户端类实现
 Client::Client()
-    : socket_(global_io_context), buffer_(1024) {}
+    : socket_(global_io_context), reconnect_timer_(global_io_context), read_signal_(global_io_context),
+      write_signal_(global_io_context) {}
+
+void Client::set_coroutine_io(bool enabled) {
+    coroutine_io_ = enabled && CLIENT_HAS_COROUTINE_IO;
+}
 
 void Client::start(const std::string& server_ip, const std::string& server_port) {
-    asio::ip::tcp::resolver resolver(global_io_context);
-    auto endpoints = resolver.resolve(server_ip, server_port);
-    
-    // 准备要发送的消息
-    pending_message_ = "INIT_SERVER_INFO| N/A <END_OF_MESSAGE>";
-    
-    asio::async_connect(socket_, endpoints,
-        [self = shared_from_this()](const asio::error_code& error, const asio::ip::tcp::endpoint&) {
-            if (!error) {
-                // 先启动读取
-                self->do_read();
-                
-                // 使用成员变量发送消息
-                asio::async_write(
-                    self->socket_,
-                    asio::buffer(self->pending_message_),
-                    [self](const asio::error_code& error, std::size_t /*bytes_transferred*/) {
-                        if (error) {
-                            // 处理发送错误
-                        }
-                    }
-                );
+    start(std::vector<ServerEndpoint>{ { server_ip, server_port } });
+}
+
+// 可以在任意线程调用，解析和连接都在网络线程上异步进行
+void Client::start(const std::vector<ServerEndpoint>& servers) {
+    asio::post(global_io_context, [self = shared_from_this(), servers]() {
+        self->servers_ = servers;
+        self->connect();
+    });
+}
+
+// 所有服务器同时竞速，第一个连上的胜出
+void Client::connect() {
+    connect_race_ = std::make_shared<ConnectRace>(global_io_context, servers_,
+        [weak_self = weak_from_this()](const asio::error_code& error, asio::ip::tcp::socket socket,
+                                       const ServerEndpoint& server) {
+            auto self = weak_self.lock();
+            if (!self) {
+                return;
             }
+            self->connect_race_.reset();
+
+            if (error) {
+                self->schedule_reconnect();
+                return;
+            }
+            self->on_connected(std::move(socket), server);
         });
+    connect_race_->start();
+}
+
+void Client::on_connected(asio::ip::tcp::socket socket, const ServerEndpoint& server) {
+    socket_ = std::move(socket);
+    server_ip_ = server.host;
+    server_port_ = server.port;
+    ++connection_id_;
+    reconnect_attempt_ = 0;
+    begin_session();
+}
+
+void Client::begin_session() {
+    // 新服务器是否支持多路复用要等 SERVER_INFO
+    multiplex_ = false;
+
+    // 先启动读取
+    do_read();
+
+    // 初始化消息排在最前面，之后是续传请求和连接期间排队的请求，一起聚合发送
+    write_queue_.push_front(make_packet(MessageType::TEXT_COMMAND, "INIT_SERVER_INFO| N/A "));
+    g_transfer_stats.add_send_queue(1);
+    resume_pending_downloads();
+    connected_ = true;
+    do_write();
+}
+
+// 指数退避加随机抖动，避免服务器恢复时所有客户端同时重连
+void Client::schedule_reconnect() {
+    reconnect_timer_.expires_after(reconnect_delay(reconnect_attempt_++));
+    reconnect_timer_.async_wait(bind_handler_memory(handler_memory_,
+        [self = shared_from_this()](const asio::error_code& error) {
+            if (!error) {
+                self->connect();
+            }
+        }));
+}
+
+void Client::start_capture(const std::string& path) {
+    asio::post(global_io_context, [self = shared_from_this(), path]() {
+        auto writer = std::make_unique<TraceWriter>();
+        if (!writer->open(path)) {
+            post_error("无法创建轨迹文件: " + path);
+            return;
+        }
+        self->capture_ = std::move(writer);
+        post_log("开始录制协议轨迹: " + path);
+    });
+}
+
+void Client::stop_capture() {
+    std::promise<void> closed;
+    asio::post(global_io_context, [self = shared_from_this(), &closed]() {
+        self->capture_.reset();
+        closed.set_value();
+    });
+    closed.get_future().wait();
+}
+
+void Client::start_replay(const std::string& path, bool paced, std::function<void(const ReplayResult&)> on_done) {
+    asio::post(global_io_context, [self = shared_from_this(), path, paced, on_done]() {
+        auto replay = std::make_unique<ReplayState>(global_io_context);
+        if (!replay->reader.open(path)) {
+            ReplayResult result;
+            result.error = replay->reader.last_error();
+            if (on_done) {
+                on_done(result);
+            }
+            return;
+        }
+
+        replay->paced = paced;
+        replay->on_done = on_done;
+        replay->started = std::chrono::steady_clock::now();
+        self->replay_ = std::move(replay);
+        ++self->connection_id_;
+        self->begin_session();
+    });
 }
 
 void Client::send_request(const std::string& request) {
-    // 将请求保存到成员变量中
-    pending_message_ = request;
-    
-    // 使用成员变量发送数据
-    asio::async_write(socket_, 
-        asio::buffer(pending_message_),
-        [self = shared_from_this()](const asio::error_code& error, std::size_t /*length*/) {
-            if (error) {
-                // 处理发送错误
+    // 校验结果等请求由界面发起，单独记下来，回放时在同样的位置重新发起
+    if (capture_) {
+        capture_->record(TraceDirection::REQUEST, make_packet(MessageType::TEXT_COMMAND, request));
+    }
+    // 加上包头后发送
+    send_packet(MessageType::TEXT_COMMAND, request);
+}
+
+// 请求文件，offset 不为 0 时从该位置续传
+void Client::request_file(const std::string& filename, uint64_t offset) {
+    g_transfer_stats.file_requested(filename);
+    if (multiplex_) {
+        open_stream(filename, offset);
+        return;
+    }
+    send_packet(MessageType::GET_FILE, filename + "|" + std::to_string(offset));
+}
+
+// 本地已有旧版本时发送分块签名请求差量更新
+// 签名需要读完整个本地文件，放进文件扫描队列计算，算完再回到网络线程发送
+void Client::request_delta(const std::string& filename) {
+    g_transfer_stats.file_requested(filename);
+    g_file_scan_queue.post(data_file_path(filename), [self = shared_from_this(), filename]() {
+        std::vector<BlockSignature> signatures;
+        if (!compute_signatures(data_file_path(filename), DELTA_BLOCK_SIZE, signatures)) {
+            asio::post(global_io_context, [self, filename]() { self->request_file(filename, 0); });
+            return;
+        }
+
+        std::string body = filename + "|" + std::to_string(DELTA_BLOCK_SIZE) + "|";
+        body.append(reinterpret_cast<const char*>(signatures.data()), signatures.size() * sizeof(BlockSignature));
+        // 签名列表超过服务器接受的请求长度时整文件下载
+        if (body.size() > MAX_REQUEST_BODY_LENGTH) {
+            asio::post(global_io_context, [self, filename]() { self->request_file(filename, 0); });
+            return;
+        }
+
+        asio::post(global_io_context, [self, packet = make_packet(MessageType::DELTA_REQUEST, body)]() mutable {
+            self->send_packet(std::move(packet));
+        });
+    });
+}
+
+// 大文件走多连接分段下载，小文件在主连接上请求
+void Client::download_file(const std::string& filename, uint64_t filesize) {
+    uint64_t offset = FileReceiver::resume_offset(filename, filesize);
+
+    // 没有未完成的下载，且本地有足够大的旧文件时走差量更新
+    std::error_code ec;
+    if (offset == 0 && std::filesystem::file_size(data_file_path(filename), ec) >= DELTA_MIN_FILESIZE && !ec) {
+        request_delta(filename);
+        return;
+    }
+
+    if (filesize < SEGMENTED_THRESHOLD) {
+        request_file(filename, offset);
+        return;
+    }
+    if (skip_segmented_in_replay(filename)) {
+        return;
+    }
+
+    auto downloader = std::make_shared<SegmentedDownloader>(
+        global_io_context, server_ip_, server_port_, filename, filesize, offset);
+    track_download(downloader, filename, filesize);
+    downloader->start();
+}
+
+// 只重新下载清单比较后不一致的数据块，相邻的块合并成一个区间
+void Client::repair_file(const std::string& filename, uint64_t filesize, const std::vector<uint64_t>& chunks,
+                         uint32_t chunk_size) {
+    if (chunks.empty() || skip_segmented_in_replay(filename)) {
+        return;
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (uint64_t chunk : chunks) {
+        uint64_t begin = chunk * chunk_size;
+        uint64_t end = std::min(begin + chunk_size, filesize);
+        if (!ranges.empty() && ranges.back().second == begin) {
+            ranges.back().second = end;
+        } else {
+            ranges.push_back({ begin, end });
+        }
+    }
+
+    auto downloader = std::make_shared<SegmentedDownloader>(
+        global_io_context, server_ip_, server_port_, filename, filesize);
+    track_download(downloader, filename, filesize);
+    downloader->start_repair(ranges);
+}
+
+// 分段下载的额外连接不在录制范围内，回放时不连接服务器，只记一次跳过
+bool Client::skip_segmented_in_replay(const std::string& filename) {
+    if (!replay_) {
+        return false;
+    }
+    ++replay_->result.segmented_skipped;
+    post_log("回放时跳过分段下载: " + filename);
+    return true;
+}
+
+// 记录进行中的下载，完成后移除
+void Client::track_download(const std::shared_ptr<SegmentedDownloader>& downloader, const std::string& filename,
+                            uint64_t filesize) {
+    std::weak_ptr<SegmentedDownloader> weak_downloader = downloader;
+    g_transfer_stats.file_requested(filename);
+
+    downloader->on_report = [](const DownloadReport& report) {
+        g_transfer_stats.update_segmented(report.filename, report.aggregate_rate, report.connection_rates);
+        post_progress(report.filename, report.downloaded, report.filesize);
+    };
+
+    downloader->on_complete = [self = shared_from_this(), weak_downloader, filename, filesize](bool success, const std::string& error) {
+        g_transfer_stats.segmented_finished(filename);
+        if (success) {
+            g_transfer_stats.file_completed(filename, filesize);
+            post_progress(filename, filesize, filesize);
+            post_log("文件写入成功: " + data_file_path(filename));
+        } else {
+            g_transfer_stats.file_failed(filename);
+            post_error(error);
+        }
+
+        auto& downloads = self->segmented_downloads_;
+        auto finished = weak_downloader.lock();
+        downloads.erase(std::remove(downloads.begin(), downloads.end(), finished), downloads.end());
+        if (finished && finished->checksum_failed()) {
+            self->retry_corrupt_download(filename, filesize);
+        }
+    };
+
+    segmented_downloads_.push_back(downloader);
+}
+
+// 在复用的缓冲区里构造数据包后排队发送
+void Client::send_packet(MessageType type, std::string_view body) {
+    std::string packet;
+    if (!free_buffers_.empty()) {
+        packet = std::move(free_buffers_.back());
+        free_buffers_.pop_back();
+        packet.clear();
+    }
+    append_packet(packet, type, body);
+    send_packet(std::move(packet));
+}
+
+// 数据包只进队列，同一时间最多只有一个 async_write 在进行
+void Client::send_packet(std::string packet) {
+    write_queue_.push_back(std::move(packet));
+    g_transfer_stats.add_send_queue(1);
+    if (connected_ && writing_.empty()) {
+        do_write();
+    }
+}
+
+// 把队列中的数据包一次性取出，用一个 gather 写发送出去
+void Client::do_write() {
+    if (!writing_.empty() || write_queue_.empty()) {
+        return;
+    }
+
+    // 回放时发出的数据包只和录制的比较
+    if (replay_) {
+        g_transfer_stats.add_send_queue(-static_cast<int64_t>(write_queue_.size()));
+        for (auto& packet : write_queue_) {
+            if (!is_window_update(packet)) {
+                replay_->produced.push_back(std::move(packet));
+            }
+        }
+        write_queue_.clear();
+        match_outbound();
+        return;
+    }
+
+#if defined(ASIO_HAS_CO_AWAIT)
+    // 每个连接启动一次发送循环，之后 do_write 只唤醒等待新数据包的循环
+    if (coroutine_io_) {
+        if (write_loop_id_ != connection_id_) {
+            write_loop_id_ = connection_id_;
+            asio::co_spawn(global_io_context, write_loop(shared_from_this(), connection_id_), rethrow_exception);
+        } else {
+            write_signal_.cancel();
+        }
+        return;
+    }
+#endif
+
+    gather_writes();
+    asio::async_write(socket_, write_buffers_, bind_handler_memory(handler_memory_,
+        [self = shared_from_this(), id = connection_id_](const asio::error_code& error, std::size_t /*length*/) {
+            self->recycle_writes();
+            if (error && id == self->connection_id_) {
+                self->abort_writes();
+                return;
+            }
+
+            // 旧连接上的写入结束时，新连接可能已经有数据在排队
+            if (self->connected_) {
+                self->do_write();
             }
+        }));
+}
+
+// 从发送队列取出一批数据包，准备好聚合写的缓冲区序列
+void Client::gather_writes() {
+    while (!write_queue_.empty() && writing_.size() < MAX_GATHER_PACKETS) {
+        if (capture_) {
+            capture_->record(TraceDirection::OUTBOUND, write_queue_.front());
+        }
+        writing_.push_back(std::move(write_queue_.front()));
+        write_queue_.pop_front();
+    }
+
+    write_buffers_.clear();
+    for (const auto& packet : writing_) {
+        write_buffers_.push_back(asio::buffer(packet));
+    }
+}
+
+// 发送完的缓冲区回收，下次构造数据包时复用容量
+void Client::recycle_writes() {
+    g_transfer_stats.add_send_queue(-static_cast<int64_t>(writing_.size()));
+    for (auto& packet : writing_) {
+        if (free_buffers_.size() < MAX_FREE_SEND_BUFFERS) {
+            free_buffers_.push_back(std::move(packet));
+        }
+    }
+    writing_.clear();
+}
+
+// 发送失败时丢弃剩余请求，关闭连接后由读取端处理断线
+void Client::abort_writes() {
+    g_transfer_stats.add_send_queue(-static_cast<int64_t>(write_queue_.size()));
+    write_queue_.clear();
+    connected_ = false;
+    asio::error_code ec;
+    socket_.close(ec);
+}
+
+#if defined(ASIO_HAS_CO_AWAIT)
+// 协程版的发送循环，和 do_write 的回调链做同样的事：同一时间只有一个聚合写，
+// 写的同时收包循环可以继续排队，写完接着发送排队的数据包
+asio::awaitable<void> Client::write_loop(std::shared_ptr<Client> /*self*/, uint64_t id) {
+    while (id == connection_id_ && connected_) {
+        if (write_queue_.empty() || !writing_.empty()) {
+            co_await wait_signal(write_signal_, handler_memory_);
+            continue;
+        }
+
+        gather_writes();
+        auto [error, length] = co_await asio::async_write(socket_, write_buffers_,
+                                                          bind_handler_memory(handler_memory_, use_nothrow_awaitable));
+        recycle_writes();
+        if (error && id == connection_id_) {
+            abort_writes();
+            co_return;
+        }
+    }
+
+    // 旧连接上的写入结束时，新连接可能已经有数据在排队
+    if (id != connection_id_ && connected_) {
+        do_write();
+    }
+}
+#endif
+
+// 把文件操作交给写盘线程。任务进入队列前暂停读取 socket，接收速度不会超过磁盘
+// job 直接放进计时的闭包，只包装成一个 DiskJob，数据块的闭包放在任务对象内，不分配内存
+template <typename Job>
+void Client::submit_disk_job(const std::string& key, Job job) {
+    ++pending_disk_jobs_;
+    g_transfer_stats.add_disk_queue(1);
+
+    // 统计排队深度和每个写盘任务的耗时
+    auto timed_job = [job = std::move(job)]() mutable {
+        g_transfer_stats.add_disk_queue(-1);
+        auto start = std::chrono::steady_clock::now();
+        job();
+        g_transfer_stats.record_disk_write(std::chrono::steady_clock::now() - start);
+    };
+
+    disk_writer_.submit(key, std::move(timed_job), global_io_context.get_executor(),
+        [self = shared_from_this()]() {
+            if (--self->pending_disk_jobs_ == 0 && self->read_deferred_) {
+                self->read_deferred_ = false;
+                self->do_read();
+            }
+        });
+}
+
+// 写盘线程上发现需要重新下载时，回到网络线程发送请求
+void Client::post_request_file(const std::string& filename) {
+    asio::post(global_io_context, [weak_self = weak_from_this(), filename]() {
+        if (auto self = weak_self.lock()) {
+            self->request_file(filename, 0);
+        }
+    });
+}
+
+// 校验失败的 .part 已经删除，从头重新下载。在网络线程上调用
+void Client::retry_corrupt_download(const std::string& filename, uint64_t filesize) {
+    unsigned& retries = checksum_retries_[filename];
+    if (retries >= MAX_CHECKSUM_RETRIES) {
+        post_error("文件多次校验失败，不再重试: " + filename);
+        return;
+    }
+    ++retries;
+    post_log("文件校验失败，第 " + std::to_string(retries) + " 次重新下载: " + filename);
+    download_file(filename, filesize);
+}
+
+// 把 Data 目录下所有带续传日志的文件一次性请求回来
+// 这时还不知道服务器上的文件大小，先按日志记录的大小续传，FileReceiver::open 收到 FILE_BEGIN 后
+// 再和服务器给出的大小比较，不一致时从头下载
+void Client::resume_pending_downloads() {
+    for (const auto& filename : FileReceiver::pending_downloads()) {
+        PartJournal journal;
+        uint64_t offset = 0;
+        if (read_part_journal(filename, journal)) {
+            offset = FileReceiver::resume_offset(filename, journal.filesize);
+        }
+        request_file(filename, offset);
+    }
+}
+
+// 连接断开时保存正在接收的文件，下次连接后从断点续传
+void Client::handle_disconnect() {
+    if (receiving_file_) {
+        g_transfer_stats.file_failed(receiving_file_->filename());
+        submit_disk_job(receiving_file_->filename(), [receiver = receiving_file_]() {
+            receiver->suspend();
         });
+        receiving_file_.reset();
+    }
+    // 流和 GET_FILE 一样，已开始接收的文件留下续传日志，还没开始的请求随连接丢弃
+    for (auto& entry : streams_) {
+        g_transfer_stats.file_failed(entry.second.filename);
+        if (entry.second.receiver) {
+            submit_disk_job(entry.second.filename, [receiver = entry.second.receiver]() {
+                receiver->suspend();
+            });
+        }
+    }
+    for (const auto& pending : stream_backlog_) {
+        g_transfer_stats.file_failed(pending.first);
+    }
+    streams_.clear();
+    stream_backlog_.clear();
+    connected_ = false;
+    // 协程版的发送循环被唤醒后看到连接已断开就退出
+    write_signal_.cancel();
+    post_disconnected();
+
+    asio::error_code ec;
+    socket_.close(ec);
+    schedule_reconnect();
 }
 
+// 先读取固定 8 字节的包头
 void Client::do_read() {
-    if (!stream_buffer_) {
-        stream_buffer_ = std::make_shared<asio::streambuf>();    }
-    
-    asio::async_read_until(
+    if (replay_) {
+        replay_next();
+        return;
+    }
+
+#if defined(ASIO_HAS_CO_AWAIT)
+    // 每个连接启动一次收包循环，之后 do_read 只唤醒等待写盘的循环
+    if (coroutine_io_) {
+        if (read_loop_id_ != connection_id_) {
+            read_loop_id_ = connection_id_;
+            asio::co_spawn(global_io_context, read_loop(shared_from_this(), connection_id_), rethrow_exception);
+        } else {
+            read_signal_.cancel();
+        }
+        return;
+    }
+#endif
+
+    asio::async_read(
         socket_,
-        *stream_buffer_,
-        "<END_OF_MESSAGE>",
-        [self = shared_from_this()](const asio::error_code& error, std::size_t bytes_transferred) {
+        asio::buffer(&header_, PACKET_HEADER_SIZE),
+        bind_handler_memory(handler_memory_,
+        [self = shared_from_this(), id = connection_id_](const asio::error_code& error, std::size_t bytes_transferred) {
+            // 重连后旧连接上的读取结果直接丢弃
+            if (id != self->connection_id_) {
+                return;
+            }
+            self->handle_read_header(error, bytes_transferred);
+        })
+    );
+}
 
-            self->handle_read(error, bytes_transferred);
+// 检查包头并准备消息体的接收缓冲区，包头非法时关闭连接
+Client::BodyBuffer Client::prepare_body(asio::mutable_buffer& target) {
+    asio::error_code ec;
+    if (header_.bodyLength > MAX_BODY_LENGTH) {
+        post_error("非法的消息长度: " + std::to_string(header_.bodyLength));
+        socket_.close(ec);
+        handle_disconnect();
+        return BodyBuffer::INVALID;
+    }
+
+    if (carries_file_data(header_.messageType)) {
+        if (header_.bodyLength > CHUNK_BUFFER_SIZE) {
+            post_error("数据块过大: " + std::to_string(header_.bodyLength));
+            socket_.close(ec);
+            handle_disconnect();
+            return BodyBuffer::INVALID;
+        }
+
+        // 文件数据直接读进缓冲池的块，之后解压、写盘都在这个块上进行，不再拷贝
+        body_chunk_ = g_chunk_pool.try_acquire();
+        if (!body_chunk_) {
+            return BodyBuffer::POOL_EXHAUSTED;
         }
+        body_chunk_.set_size(header_.bodyLength);
+        target = asio::buffer(body_chunk_.data(), body_chunk_.size());
+    } else {
+        // resize 不会缩小容量，接收缓冲区在消息之间复用
+        body_.resize(header_.bodyLength);
+        target = asio::buffer(body_.data(), body_.size());
+    }
+    return BodyBuffer::READY;
+}
+
+// 根据包头中的 bodyLength 精确读取消息体
+void Client::handle_read_header(const asio::error_code& error, size_t /*bytes_transferred*/) {
+    if (error) {
+        handle_disconnect();
+        return;
+    }
+
+    asio::mutable_buffer target;
+    switch (prepare_body(target)) {
+    case BodyBuffer::INVALID:
+        return;
+    case BodyBuffer::POOL_EXHAUSTED:
+        // 缓冲池用完说明写盘跟不上，有块归还后再读，期间 socket 上的数据留在内核缓冲区
+        g_chunk_pool.notify_when_available(global_io_context.get_executor(),
+            [self = shared_from_this(), id = connection_id_]() {
+                if (id == self->connection_id_) {
+                    self->handle_read_header(asio::error_code(), PACKET_HEADER_SIZE);
+                }
+            });
+        return;
+    case BodyBuffer::READY:
+        break;
+    }
+
+    asio::async_read(
+        socket_,
+        target,
+        bind_handler_memory(handler_memory_,
+        [self = shared_from_this(), id = connection_id_](const asio::error_code& error, std::size_t bytes_transferred) {
+            if (id != self->connection_id_) {
+                return;
+            }
+            self->handle_read(error, bytes_transferred);
+        })
     );
 }
 
 void Client::handle_read(const asio::error_code& error, size_t bytes_transferred) {
     if (!error) {
-        // 从 buffer 中提取所有数据
-        std::string data{
-            asio::buffers_begin(stream_buffer_->data()),
-            asio::buffers_begin(stream_buffer_->data()) + bytes_transferred
-        };
-        stream_buffer_->consume(bytes_transferred);  // 清空缓冲区
+        dispatch_message(bytes_transferred);
 
-        // 查找消息结束标记
-        size_t endPos = data.find("<END_OF_MESSAGE>");
-        if (endPos != std::string::npos) {
-            // 提取有效消息内容
-            std::string command = data.substr(0, endPos);
-            
-            //ConvertAndShowMessage(command);
-            // 处理命令
-            process_message(command);
+        // 继续读下一个消息，写盘队列满时等任务入队后再读
+        if (pending_disk_jobs_ > 0) {
+            read_deferred_ = true;
+        } else {
+            do_read();
         }
+    }
+    else {
+        body_chunk_.reset();
+        handle_disconnect();
+    }
+}
+
+// 处理 header_ 和接收缓冲区中的一个完整数据包
+void Client::dispatch_message(size_t length) {
+    g_transfer_stats.add_received(PACKET_HEADER_SIZE + length);
 
-        // 继续读下一个消息
-        do_read();
+    // 直接在接收缓冲区上处理，不做拷贝
+    std::string_view body = body_chunk_ ? body_chunk_.view() : std::string_view(body_.data(), length);
+    if (capture_) {
+        capture_->record(TraceDirection::INBOUND, header_, body);
+    }
+    switch (static_cast<MessageType>(header_.messageType)) {
+    case MessageType::TEXT_COMMAND:
+        process_message(body);
+        break;
+    case MessageType::FILE_BEGIN:
+        handle_file_begin(body);
+        break;
+    case MessageType::FILE_CHUNK:
+        handle_file_chunk(body);
+        break;
+    case MessageType::FILE_CHUNK_Z:
+        handle_file_chunk_z(body);
+        break;
+    case MessageType::FILE_END:
+        handle_file_end();
+        break;
+    case MessageType::STREAM_BEGIN:
+        handle_stream_begin(body);
+        break;
+    case MessageType::STREAM_DATA:
+        handle_stream_data(body, false);
+        break;
+    case MessageType::STREAM_DATA_Z:
+        handle_stream_data(body, true);
+        break;
+    case MessageType::STREAM_END:
+        handle_stream_end(body, false);
+        break;
+    case MessageType::STREAM_ERROR:
+        handle_stream_end(body, true);
+        break;
+    case MessageType::DELTA_BEGIN:
+        handle_delta_begin(body);
+        break;
+    case MessageType::DELTA_COPY:
+        handle_delta_copy(body);
+        break;
+    case MessageType::DELTA_LITERAL:
+        handle_delta_literal(body);
+        break;
+    case MessageType::DELTA_END:
+        handle_delta_end();
+        break;
+    case MessageType::MANIFEST:
+        handle_manifest(body);
+        break;
+    default:
+        break;
     }
+    // 没有对应接收文件、没交给写盘任务的块在这里归还
+    body_chunk_.reset();
 }
 
-// 解析消息，返回分割后的部分
-std::vector<std::string> Client::parse_message(const std::string& message) {
-    std::vector<std::string> parts;
-    size_t pos = 0;
-    size_t prev = 0;
-    
-    while ((pos = message.find('|', prev)) != std::string::npos) {
-        parts.push_back(message.substr(prev, pos - prev));
-        prev = pos + 1;
+#if defined(ASIO_HAS_CO_AWAIT)
+// 协程版的收包循环，和 do_read / handle_read_header / handle_read 的回调链做同样的事
+asio::awaitable<void> Client::read_loop(std::shared_ptr<Client> /*self*/, uint64_t id) {
+    for (;;) {
+        auto [header_error, header_length] = co_await asio::async_read(socket_,
+            asio::buffer(&header_, PACKET_HEADER_SIZE), bind_handler_memory(handler_memory_, use_nothrow_awaitable));
+        // 重连后旧连接上的读取结果直接丢弃
+        if (id != connection_id_) {
+            co_return;
+        }
+        if (header_error) {
+            handle_disconnect();
+            co_return;
+        }
+
+        asio::mutable_buffer target;
+        BodyBuffer prepared = prepare_body(target);
+        while (prepared == BodyBuffer::POOL_EXHAUSTED) {
+            // 缓冲池用完说明写盘跟不上，有块归还后再读，期间 socket 上的数据留在内核缓冲区
+            g_chunk_pool.notify_when_available(global_io_context.get_executor(), [weak_self = weak_from_this()]() {
+                if (auto self = weak_self.lock()) {
+                    self->read_signal_.cancel();
+                }
+            });
+            co_await wait_signal(read_signal_, handler_memory_);
+            prepared = prepare_body(target);
+        }
+        if (prepared == BodyBuffer::INVALID) {
+            co_return;
+        }
+
+        auto [body_error, body_length] =
+            co_await asio::async_read(socket_, target, bind_handler_memory(handler_memory_, use_nothrow_awaitable));
+        if (id != connection_id_) {
+            co_return;
+        }
+        if (body_error) {
+            body_chunk_.reset();
+            handle_disconnect();
+            co_return;
+        }
+        dispatch_message(body_length);
+
+        // 写盘队列满时等任务入队后再读，submit_disk_job 的回调通过 do_read 唤醒
+        while (pending_disk_jobs_ > 0) {
+            read_deferred_ = true;
+            co_await wait_signal(read_signal_, handler_memory_);
+        }
     }
-    parts.push_back(message.substr(prev));
-    
-    return parts;
 }
+#endif
 
-// 处理服务器信息
-void Client::handle_server_info(const std::vector<std::string>& parts) {
-    if (parts.size() >= 5 && parts[0] == "SERVER_INFO") {
-        std::string ip = parts[1];
-        std::string port = parts[2];
-        std::string name = parts[3];
-        std::string notice = parts[4];
-
-        // 处理通知中的换行符
-        std::string::size_type pos = 0;
-        while ((pos = notice.find("\\n", pos)) != std::string::npos) {
-            notice.replace(pos, 2, "\n");
-            pos += 1;
-        }
-
-        // 更新服务器信息
-        ServerInfo::ip = ip;
-        ServerInfo::port = port;
-        ServerInfo::name = name;
-        ServerInfo::notice = notice;
-        ServerInfo::isConnected = true;
-    }
-}
-
-void Client::handle_delete_files(const std::vector<std::string>& files) {
-    std::string data_path = ".\\Data\\";
-    
-    for (const auto& filename : files) {
-        std::string full_path = data_path + filename;
-        
-        try {
-            if (std::filesystem::exists(full_path)) {
-                std::filesystem::remove(full_path);
+// 从轨迹中取下一个入站数据包放进接收缓冲区，出站记录留着和回放时发出的数据包比较，
+// 界面发起的请求在原来的位置重新发起
+void Client::replay_next() {
+    TraceRecord record;
+    for (;;) {
+        if (replay_->holding) {
+            record = std::move(replay_->held);
+            replay_->holding = false;
+        } else if (!replay_->reader.next(record)) {
+            break;
+        }
+
+        if (record.direction == TraceDirection::OUTBOUND) {
+            if (is_window_update(record.packet)) {
+                continue;
+            }
+            replay_->expected.push_back(std::move(record.packet));
+            match_outbound();
+            continue;
+        }
+        if (record.direction == TraceDirection::REQUEST) {
+            send_request(record.packet.substr(PACKET_HEADER_SIZE));
+            continue;
+        }
+
+        std::memcpy(&header_, record.packet.data(), PACKET_HEADER_SIZE);
+        size_t length = record.packet.size() - PACKET_HEADER_SIZE;
+        if (carries_file_data(header_.messageType)) {
+            if (length > CHUNK_BUFFER_SIZE) {
+                post_error("数据块过大: " + std::to_string(length));
+                continue;
             }
+            // 和网络读取一样把文件数据放进缓冲池的块，用完时不在网络线程上阻塞，有块归还后再回放这个数据包
+            body_chunk_ = g_chunk_pool.try_acquire();
+            if (!body_chunk_) {
+                replay_->held = std::move(record);
+                replay_->holding = true;
+                g_chunk_pool.notify_when_available(global_io_context.get_executor(), [self = shared_from_this()]() {
+                    if (self->replay_) {
+                        self->replay_next();
+                    }
+                });
+                return;
+            }
+            body_chunk_.set_size(length);
+            std::memcpy(body_chunk_.data(), record.packet.data() + PACKET_HEADER_SIZE, length);
+        } else {
+            body_.assign(record.packet.begin() + PACKET_HEADER_SIZE, record.packet.end());
         }
-        catch (const std::filesystem::filesystem_error& e) {
+        ++replay_->result.packets;
+        replay_->result.bytes += record.packet.size();
 
+        // 和网络读取一样在下一次事件循环中处理，写盘回调可以穿插执行，也不会递归
+        auto handler = [self = shared_from_this(), length](const asio::error_code& /*error*/ = asio::error_code()) {
+            self->handle_read(asio::error_code(), length);
+        };
+        if (replay_->paced) {
+            replay_->timer.expires_at(replay_->started + std::chrono::microseconds(record.timestamp));
+            replay_->timer.async_wait(handler);
+        } else {
+            asio::post(global_io_context, handler);
         }
+        return;
     }
+
+    replay_->result.error = replay_->reader.last_error();
+    finish_replay();
 }
 
-void Client::handle_update_files(const std::string& filename, const std::vector<char>& content) {
-    std::string data_path = ".\\Data\\";
-    std::string full_path = data_path + filename;
-    
-    try {
+void Client::match_outbound() {
+    auto& expected = replay_->expected;
+    auto& produced = replay_->produced;
+    while (!expected.empty() && !produced.empty()) {
+        if (expected.front() == produced.front()) {
+            ++replay_->result.outbound_matched;
+        } else {
+            ++replay_->result.outbound_mismatched;
+        }
+        expected.pop_front();
+        produced.pop_front();
+    }
+}
 
-        ConvertAndShowMessage("文件内容大小: " + std::to_string(content.size()) + " 字节");
+// 轨迹读完时所有写盘任务都已入队，等它们执行完再统计时间
+void Client::finish_replay() {
+    disk_writer_.flush(global_io_context.get_executor(), [self = shared_from_this()]() {
+        ReplayState& replay = *self->replay_;
+        replay.result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replay.started).count();
+        replay.result.outbound_missing = replay.expected.size();
+        replay.result.outbound_extra = replay.produced.size();
 
-        // 确保目录存在
-        if (!std::filesystem::exists(data_path)) {
-            std::filesystem::create_directory(data_path);
-            ConvertAndShowMessage("创建Data目录");
+        ReplayResult result = replay.result;
+        auto on_done = std::move(replay.on_done);
+        self->replay_.reset();
+        self->connected_ = false;
+        if (on_done) {
+            on_done(result);
         }
+    });
+}
+
+// 处理服务器信息
+void Client::handle_server_info(std::string_view args) {
+    FieldTokenizer fields(args);
+    std::string_view ip, port, name, notice, capability, mirrors;
+    if (!fields.next(ip) || !fields.next(port) || !fields.next(name) || !fields.next(notice)) {
+        return;
+    }
+    multiplex_ = fields.next(capability) && capability == CAPABILITY_MULTIPLEX;
 
-        // 写入文件
-        std::ofstream file(full_path, std::ios::binary | std::ios::trunc);
-        if (file.is_open()) {
-            file.write(content.data(), content.size());
-            
-            if (file.good()) {
-                ConvertAndShowMessage("文件写入成功");
-                
-                // 验证文件大小
-                file.flush();
-                file.close();
-                auto written_size = std::filesystem::file_size(full_path);
-                ConvertAndShowMessage("已写入文件大小: " + std::to_string(written_size) + " 字节");
-            } else {
-                ConvertAndShowMessage("文件写入失败");
+    // 镜像列表用逗号分隔，记进服务器列表，之后重连时一起竞速
+    if (fields.next(mirrors)) {
+        std::vector<ServerEndpoint> announced;
+        while (!mirrors.empty()) {
+            size_t comma = mirrors.find(',');
+            ServerEndpoint server;
+            if (parse_server_endpoint(mirrors.substr(0, comma), server)) {
+                announced.push_back(std::move(server));
             }
+            mirrors = comma == std::string_view::npos ? std::string_view() : mirrors.substr(comma + 1);
         }
-        else {
-            ConvertAndShowMessage("无法打开文件进行写入: " + full_path);
+        size_t added = merge_servers(servers_, announced);
+        if (added > 0) {
+            post_log("服务器公布了 " + std::to_string(added) + " 个新的镜像");
         }
     }
-    catch (const std::exception& e) {
-        ConvertAndShowMessage("更新文件失败，错误: " + std::string(e.what()));
+
+    // 交给界面线程更新服务器信息，通知中的 \n 还原成换行
+    post_server_info(std::string(ip), std::string(port), std::string(name), unescape_newlines(notice));
+}
+
+void Client::handle_delete_files(std::string_view args) {
+    FieldTokenizer fields(args);
+    std::string_view filename;
+    while (fields.next(filename)) {
+        if (filename.empty()) continue;
+
+        // 和同名文件的写入在同一个队列里，按顺序执行
+        std::string name(filename);
+        submit_disk_job(name, [full_path = data_file_path(name)]() {
+            std::error_code ec;
+            std::filesystem::remove(full_path, ec);
+        });
     }
 }
 
-void Client::process_message(const std::string& message) {
-    if (message.find(Command::SERVER_INFO) == 0) {
-        std::vector<std::string> parts = parse_message(message);
-        handle_server_info(parts);
-    } 
-    else if (message.find(Command::CHECK_PATCHES) == 0) {
-        // 处理补丁检查
-    } 
-    else if (message.find(Command::DELETE_FILES) == 0) {
-        std::vector<std::string> parts = parse_message(message);
-        parts.erase(parts.begin());
-        handle_delete_files(parts);
-    } 
-    else if (message.find(Command::UPDATE_FILES) == 0) {
-        ConvertAndShowMessage("收到更新文件命令");
-        
-        // 查找分隔符
-        size_t first_sep = message.find('|');
-        if (first_sep == std::string::npos) {
-            ConvertAndShowMessage("未找到第一个分隔符");
+void Client::handle_update_files(std::string_view filename, std::string_view content) {
+    // 消息体缓冲区会被下一个消息复用，内容需要拷贝一份交给写盘线程。
+    // UPDATE_FILES 不带 CRC，只校验了大小，这里算出的 CRC 只是给之后的校验做缓存
+    std::string name(filename);
+    submit_disk_job(name, [name, content = std::string(content)]() {
+        // 内容整个在内存里，写盘前算好 CRC，改名到位后记下，之后的校验不用再读这个文件
+        uint32_t crc = crc32c(0, content.data(), content.size());
+        std::string error;
+        if (!write_data_file(name, content, error)) {
+            post_error("更新文件失败，错误: " + error);
             return;
         }
 
-        size_t second_sep = message.find('|', first_sep + 1);
-        if (second_sep == std::string::npos) {
-            ConvertAndShowMessage("未找到第二个分隔符");
-            return;
+        remember_verified_hash(name, crc);
+        post_log("文件写入成功: " + data_file_path(name));
+    });
+}
+
+// FILE_BEGIN 和 STREAM_BEGIN 共用，消息格式: 文件名|文件大小|起始偏移[|CRC32C]
+std::shared_ptr<FileReceiver> Client::begin_receive(std::string_view message) {
+    FieldTokenizer fields(message);
+    std::string_view name_field, size_field, offset_field, crc_field;
+    if (!fields.next(name_field) || !fields.next(size_field)) {
+        post_error("FILE_BEGIN 格式错误");
+        return nullptr;
+    }
+
+    std::string filename(name_field);
+    uint64_t filesize = 0;
+    uint64_t offset = 0;
+    if (!parse_uint64(size_field, filesize) ||
+        (fields.next(offset_field) && !parse_uint64(offset_field, offset))) {
+        post_error("文件大小字段无效");
+        return nullptr;
+    }
+
+    g_transfer_stats.file_first_byte(filename);
+    auto receiver = std::make_shared<FileReceiver>(filename, filesize, offset);
+    // 旧服务器不带 CRC，只校验大小
+    uint64_t crc = 0;
+    if (fields.next(crc_field) && parse_uint64(crc_field, crc) && crc <= UINT32_MAX) {
+        receiver->expect_crc(static_cast<uint32_t>(crc));
+    }
+    submit_disk_job(filename, [self = shared_from_this(), receiver, offset]() {
+        if (receiver->open()) {
+            post_progress(receiver->filename(), receiver->received(), receiver->filesize());
+        } else {
+            post_error(receiver->last_error());
+            g_transfer_stats.file_failed(receiver->filename());
+
+            // 续传失败则从头重新下载
+            if (offset != 0) {
+                self->post_request_file(receiver->filename());
+            }
         }
+    });
+    return receiver;
+}
 
-        size_t third_sep = message.find('|', second_sep + 1);
-        if (third_sep == std::string::npos) {
-            ConvertAndShowMessage("未找到第三个分隔符");
+// FILE_END 和 STREAM_END 共用，写盘队列里的数据都写完后再收尾
+void Client::finish_receive(const std::shared_ptr<FileReceiver>& receiver) {
+    submit_disk_job(receiver->filename(), [weak_self = weak_from_this(), receiver]() {
+        if (receiver->failed()) {
+            g_transfer_stats.file_failed(receiver->filename());
             return;
         }
+        if (receiver->finish()) {
+            g_transfer_stats.file_completed(receiver->filename(), receiver->filesize());
+            post_progress(receiver->filename(), receiver->filesize(), receiver->filesize());
+            post_log("文件写入成功: " + receiver->full_path());
+        } else {
+            g_transfer_stats.file_failed(receiver->filename());
+            post_error(receiver->last_error());
+            if (receiver->checksum_failed()) {
+                asio::post(global_io_context, [weak_self, receiver]() {
+                    if (auto self = weak_self.lock()) {
+                        self->retry_corrupt_download(receiver->filename(), receiver->filesize());
+                    }
+                });
+            }
+        }
+    });
+}
 
-        // 提取文件名和大小
-        std::string filename = message.substr(first_sep + 1, second_sep - first_sep - 1);
-        std::streamsize filesize = std::stoll(message.substr(second_sep + 1, third_sep - second_sep - 1));
-        
-        ConvertAndShowMessage("文件名: " + filename);
-        ConvertAndShowMessage("预期文件大小: " + std::to_string(filesize) + " 字节");
+// 分块传输开始，同一时间只有一个文件在接收，之前没收完的先挂起留待续传
+void Client::handle_file_begin(std::string_view message) {
+    if (receiving_file_) {
+        g_transfer_stats.file_failed(receiving_file_->filename());
+        submit_disk_job(receiving_file_->filename(), [receiver = receiving_file_]() {
+            receiver->suspend();
+        });
+    }
+    receiving_file_ = begin_receive(message);
+}
 
-        // 查找内容边界标记
-        std::string start_marker = "|<START_CONTENT>|";
-        std::string end_marker = "|<END_CONTENT>|";
-        
-        size_t content_start = message.find(start_marker);
-        size_t content_end = message.find(end_marker);
-        
-        if (content_start == std::string::npos) {
-            ConvertAndShowMessage("未找到内容开始标记");
-            return;
+// 每个数据块收到后立即写盘，写盘任务持有接收时的块，data 指向块内
+void Client::handle_file_chunk(std::string_view data) {
+    if (!receiving_file_) {
+        return;
+    }
+
+    submit_disk_job(receiving_file_->filename(), [receiver = receiving_file_, chunk = std::move(body_chunk_), data]() {
+        write_wire_chunk(*receiver, data, false);
+    });
+}
+
+// 解压也放到写盘线程上做
+void Client::handle_file_chunk_z(std::string_view body) {
+    if (!receiving_file_) {
+        return;
+    }
+
+    submit_disk_job(receiving_file_->filename(), [receiver = receiving_file_, chunk = std::move(body_chunk_), body]() {
+        write_wire_chunk(*receiver, body, true);
+    });
+}
+
+void Client::handle_file_end() {
+    if (!receiving_file_) {
+        return;
+    }
+
+    finish_receive(receiving_file_);
+    receiving_file_.reset();
+}
+
+// 同时进行的流达到上限时先排队，有流结束再发出
+void Client::open_stream(const std::string& filename, uint64_t offset) {
+    if (streams_.size() >= MUX_MAX_STREAMS) {
+        stream_backlog_.emplace_back(filename, offset);
+        return;
+    }
+
+    uint32_t id = next_stream_id_++;
+    if (next_stream_id_ == 0) {
+        next_stream_id_ = 1;
+    }
+    streams_[id].filename = filename;
+
+    std::string packet;
+    append_stream_packet(packet, MessageType::STREAM_GET, id, filename + "|" + std::to_string(offset));
+    send_packet(std::move(packet));
+}
+
+// 每个流有自己的 FileReceiver，不同文件的数据交错到达也各自写进自己的文件
+void Client::handle_stream_begin(std::string_view body) {
+    uint32_t id = 0;
+    std::string_view message;
+    if (!split_stream_frame(body, id, message)) {
+        return;
+    }
+    auto it = streams_.find(id);
+    if (it == streams_.end() || it->second.receiver) {
+        return;
+    }
+    it->second.receiver = begin_receive(message);
+}
+
+// 写盘完成后才归还窗口，某个文件写得慢时只有它的流会停下来
+void Client::handle_stream_data(std::string_view body, bool compressed) {
+    uint32_t id = 0;
+    std::string_view data;
+    if (!split_stream_frame(body, id, data)) {
+        return;
+    }
+    auto it = streams_.find(id);
+    if (it == streams_.end() || !it->second.receiver) {
+        return;
+    }
+
+    auto bytes = static_cast<uint32_t>(data.size());
+    submit_disk_job(it->second.filename,
+        [self = shared_from_this(), receiver = it->second.receiver, chunk = std::move(body_chunk_), data, compressed, id,
+         bytes]() {
+            write_wire_chunk(*receiver, data, compressed);
+            asio::post(global_io_context, bind_handler_memory(self->disk_handler_memory_,
+                [self, id, bytes]() { self->stream_consumed(id, bytes); }));
+        });
+}
+
+void Client::stream_consumed(uint32_t stream_id, uint32_t bytes) {
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end()) {
+        return;
+    }
+
+    MuxStream& stream = it->second;
+    stream.consumed += bytes;
+    if (stream.consumed >= STREAM_WINDOW_UPDATE_THRESHOLD) {
+        std::string packet;
+        append_stream_packet(packet, MessageType::WINDOW_UPDATE, stream_id,
+                             std::string_view(reinterpret_cast<const char*>(&stream.consumed), sizeof(stream.consumed)));
+        send_packet(std::move(packet));
+        stream.consumed = 0;
+    }
+}
+
+// STREAM_END 和 STREAM_ERROR 都结束这个流，空出的位置留给排队的请求
+void Client::handle_stream_end(std::string_view body, bool failed) {
+    uint32_t id = 0;
+    std::string_view message;
+    if (!split_stream_frame(body, id, message)) {
+        return;
+    }
+    auto it = streams_.find(id);
+    if (it == streams_.end()) {
+        return;
+    }
+
+    if (failed) {
+        g_transfer_stats.file_failed(it->second.filename);
+        post_error("下载 " + it->second.filename + " 失败: " + std::string(message));
+        if (it->second.receiver) {
+            submit_disk_job(it->second.filename, [receiver = it->second.receiver]() {
+                receiver->suspend();
+            });
+        }
+    } else if (it->second.receiver) {
+        finish_receive(it->second.receiver);
+    }
+    streams_.erase(it);
+
+    if (!stream_backlog_.empty()) {
+        auto next = std::move(stream_backlog_.front());
+        stream_backlog_.pop_front();
+        open_stream(next.first, next.second);
+    }
+}
+
+// 差量传输开始，消息体格式: 文件名|新文件大小|分块大小[|CRC32C]
+void Client::handle_delta_begin(std::string_view message) {
+    FieldTokenizer fields(message);
+    std::string_view name_field, size_field, block_field, crc_field;
+    if (!fields.next(name_field) || !fields.next(size_field) || !fields.next(block_field)) {
+        post_error("DELTA_BEGIN 格式错误");
+        return;
+    }
+
+    std::string filename(name_field);
+    uint64_t filesize = 0;
+    uint64_t block_size = 0;
+    if (!parse_uint64(size_field, filesize) || !parse_uint64(block_field, block_size) ||
+        block_size == 0 || block_size > UINT32_MAX) {
+        post_error("DELTA_BEGIN 字段无效");
+        return;
+    }
+
+    if (delta_file_) {
+        g_transfer_stats.file_failed(delta_file_->filename());
+        submit_disk_job(delta_file_->filename(), [applier = delta_file_]() {
+            applier->abort();
+        });
+    }
+
+    g_transfer_stats.file_first_byte(filename);
+    delta_file_ = std::make_shared<DeltaApplier>(filename, filesize, static_cast<uint32_t>(block_size));
+    uint64_t crc = 0;
+    if (fields.next(crc_field) && parse_uint64(crc_field, crc) && crc <= UINT32_MAX) {
+        delta_file_->expect_crc(static_cast<uint32_t>(crc));
+    }
+    submit_disk_job(filename, [self = shared_from_this(), applier = delta_file_]() {
+        if (!applier->open()) {
+            post_error(applier->last_error());
+            applier->abort();
+            g_transfer_stats.file_failed(applier->filename());
+            self->post_request_file(applier->filename());
         }
-        if (content_end == std::string::npos) {
-            ConvertAndShowMessage("未找到内容结束标记");
+    });
+}
+
+void Client::handle_delta_copy(std::string_view data) {
+    if (!delta_file_) {
+        return;
+    }
+
+    DeltaCopy copy;
+    if (data.size() != sizeof(copy)) {
+        post_error("DELTA_COPY 格式错误");
+        return;
+    }
+    std::memcpy(&copy, data.data(), sizeof(copy));
+
+    submit_disk_job(delta_file_->filename(), [applier = delta_file_, copy]() {
+        if (applier->failed()) {
             return;
         }
+        if (!applier->copy_blocks(copy.first_block, copy.block_count)) {
+            post_error(applier->last_error());
+            applier->abort();
+        }
+    });
+}
 
-        // 计算实际内容的起始位置和大小（从开始标记的最后一个字符到结束标记的第一个字符）
-        content_start += start_marker.length();
-        size_t content_size = content_end - content_start;
-        
-        ConvertAndShowMessage("实际内容大小: " + std::to_string(content_size) + " 字节");
+void Client::handle_delta_literal(std::string_view data) {
+    if (!delta_file_) {
+        return;
+    }
 
-        // 验证文件大小
-        if (content_size != static_cast<size_t>(filesize)) {
-            ConvertAndShowMessage("文件大小不匹配！预期: " + std::to_string(filesize) + 
-                                " 实际: " + std::to_string(content_size));
+    submit_disk_job(delta_file_->filename(), [applier = delta_file_, chunk = std::move(body_chunk_), data]() {
+        if (applier->failed()) {
             return;
         }
+        if (!applier->write_literal(data)) {
+            post_error(applier->last_error());
+            applier->abort();
+        }
+    });
+}
+
+void Client::handle_delta_end() {
+    if (!delta_file_) {
+        return;
+    }
 
-        // 确保目录存在
-        std::string data_path = ".\\Data";
-        if (!std::filesystem::exists(data_path)) {
-            std::filesystem::create_directory(data_path);
+    submit_disk_job(delta_file_->filename(), [self = shared_from_this(), applier = delta_file_]() {
+        if (!applier->failed()) {
+            if (applier->finish()) {
+                g_transfer_stats.file_completed(applier->filename(), applier->filesize());
+                post_log("文件写入成功: " + applier->full_path());
+                return;
+            }
+            post_error(applier->last_error());
         }
 
-        // 写入文件
-        std::string full_path = data_path + "\\" + filename;
-        std::ofstream outfile(full_path, std::ios::binary);
-        if (!outfile) {
-            ConvertAndShowMessage("无法打开文件进行写入: " + full_path);
+        // 差量重建失败则整文件重新下载，重新请求时重新开始计时
+        g_transfer_stats.file_failed(applier->filename());
+        self->post_request_file(applier->filename());
+    });
+    delta_file_.reset();
+}
+
+// 服务器要求校验的文件列表，为每个文件请求 Merkle 清单
+void Client::handle_repair_files(std::string_view args) {
+    FieldTokenizer fields(args);
+    std::string_view filename;
+    while (fields.next(filename)) {
+        if (!filename.empty()) {
+            send_packet(MessageType::GET_MANIFEST, filename);
+        }
+    }
+}
+
+// 收到清单后在文件扫描队列中计算本地文件的树并比较，只修复不一致的数据块
+void Client::handle_manifest(std::string_view message) {
+    size_t sep = message.find('|');
+    if (sep == std::string_view::npos) {
+        post_error("MANIFEST 格式错误");
+        return;
+    }
+
+    std::string filename(message.substr(0, sep));
+    auto remote = std::make_shared<MerkleTree>();
+    if (!parse_merkle_manifest(message.substr(sep + 1), *remote)) {
+        post_error("MANIFEST 格式错误: " + filename);
+        return;
+    }
+
+    std::error_code ec;
+    if (!std::filesystem::exists(data_file_path(filename), ec)) {
+        download_file(filename, remote->filesize);
+        return;
+    }
+
+    g_file_scan_queue.post(data_file_path(filename), [self = shared_from_this(), filename, remote]() {
+        MerkleTree local;
+        if (!build_merkle_tree(data_file_path(filename), remote->chunk_size, local)) {
+            post_error("读取本地文件失败，改为整文件下载: " + filename);
+            asio::post(global_io_context, [self, filename, remote]() {
+                self->download_file(filename, remote->filesize);
+            });
             return;
         }
 
-        // 写入文件内容
-        outfile.write(message.data() + content_start, content_size);
-        
-        if (outfile.good()) {
-            ConvertAndShowMessage("文件写入成功: " + full_path);
-            
-            // 验证写入的文件大小
-            outfile.flush();
-            outfile.close();
-            auto written_size = std::filesystem::file_size(full_path);
-            ConvertAndShowMessage("已写入文件大小: " + std::to_string(written_size) + " 字节");
+        std::vector<uint64_t> chunks = diff_merkle_trees(local, *remote);
+        asio::post(global_io_context, [self, filename, remote, chunks]() {
+            self->repair_file(filename, remote->filesize, chunks, remote->chunk_size);
+        });
+    });
+}
+
+// 服务器下发的待下载文件列表，格式: DOWNLOAD_FILES|文件名|大小|文件名|大小...
+void Client::handle_download_files(std::string_view args) {
+    // 每轮更新重新计算校验失败的重试次数
+    checksum_retries_.clear();
+
+    FieldTokenizer fields(args);
+    std::string_view name_field, size_field;
+    while (fields.next(name_field) && fields.next(size_field)) {
+        uint64_t filesize = 0;
+        if (!parse_uint64(size_field, filesize)) {
+            continue;
+        }
+        std::string filename(name_field);
+
+        uint64_t offset = FileReceiver::resume_offset(filename, filesize);
+        std::error_code ec;
+        bool has_basis = offset == 0 &&
+            std::filesystem::file_size(data_file_path(filename), ec) >= DELTA_MIN_FILESIZE && !ec;
+
+        if (filesize >= SEGMENTED_THRESHOLD || has_basis) {
+            download_file(filename, filesize);
         } else {
-            ConvertAndShowMessage("文件写入失败");
-            outfile.close();
+            // 小文件的请求在发送队列里合并成一次聚合写
+            request_file(filename, offset);
         }
     }
 }
 
+void Client::process_message(std::string_view message) {
+    std::string_view args;
+    switch (parse_command(message, args)) {
+    case CommandType::SERVER_INFO:
+        handle_server_info(args);
+        break;
+    case CommandType::CHECK_PATCHES:
+        // 处理补丁检查
+        break;
+    case CommandType::DELETE_FILES:
+        handle_delete_files(args);
+        break;
+    case CommandType::DOWNLOAD_FILES:
+        handle_download_files(args);
+        break;
+    case CommandType::REPAIR_FILES:
+        handle_repair_files(args);
+        break;
+    case CommandType::UPDATE_FILES: {
+        // 格式: UPDATE_FILES|文件名|文件大小|<文件内容>
+        // 文件内容是二进制数据，长度由文件大小字段给出，不再依赖结束标记
+        FieldTokenizer fields(args);
+        std::string_view filename, size_field;
+        if (!fields.next(filename) || !fields.next(size_field) || !fields.has_remainder()) {
+            post_error("UPDATE_FILES 格式错误");
+            return;
+        }
+
+        uint64_t filesize = 0;
+        if (!parse_uint64(size_field, filesize)) {
+            post_error("文件大小字段无效");
+            return;
+        }
+
+        std::string_view content = fields.remainder();
+
+        // 验证文件大小
+        if (content.size() != filesize) {
+            post_error("文件大小不匹配！预期: " + std::to_string(filesize) +
+                       " 实际: " + std::to_string(content.size()));
+            return;
+        }
+
+        handle_update_files(filename, content);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
 // 初始化服务器信息
-void initialize_server_info() {
-    asio::io_context::work work(global_io_context); // 确保不退出
+void initialize_server_info(const std::string& capture_path) {
+    // 断线重连期间可能没有待处理的操作，保证 io_context 不退出
+    static auto work = asio::make_work_guard(global_io_context);
 
     g_client = std::make_shared<Client>();  // 初始化全局客户端
-    g_client->start("127.0.0.1", "12345");
+    if (!capture_path.empty()) {
+        g_client->start_capture(capture_path);
+    }
+    // 主服务器和镜像来自服务器列表文件，连上后服务器在 SERVER_INFO 中公布的镜像会追加进来
+    std::vector<ServerEndpoint> servers = load_server_list(SERVER_LIST_FILE);
+    if (servers.empty()) {
+        servers.push_back({ DEFAULT_SERVER_HOST, DEFAULT_SERVER_PORT });
+    }
+    g_client->start(servers);
 
     std::thread t([]() {
         global_io_context.run();
@@ -328,15 +1442,31 @@ void initialize_server_info() {
 
 }
 
-void check_and_start_game(HWND hwnd) {
+// full_rehash 为 true 时忽略哈希缓存，重新计算所有文件
+void check_and_start_game(HWND hwnd, bool full_rehash) {
+    // 上一次校验还没结束
+    if (g_verifier && g_verifier->is_running()) {
+        return;
+    }
+
     // 检查 Data 目录
     std::string data_path = ".\\Data";
     if (!std::filesystem::exists(data_path)) {
         return;
     }
 
-    // 存储补丁文件信息
-    std::vector<PatchFileInfo> patch_files;
+    // 读取哈希缓存，元数据没变的文件直接使用缓存结果
+    auto cache = std::make_shared<HashCache>();
+    bool has_verified = false;
+    if (!full_rehash) {
+        cache->load(HASH_CACHE_FILE);
+        // 下载时已经边收边校验过的文件，直接使用当时算出的 CRC
+        has_verified = apply_verified_hashes(*cache) > 0;
+    }
+
+    std::vector<std::string> patch_paths;
+    std::vector<FileMeta> patch_metas;
+    std::vector<PatchVerifyResult> cached_results;
 
     // 遍历 Data 目录
     for (const auto& entry : std::filesystem::directory_iterator(data_path)) {
@@ -349,48 +1479,62 @@ void check_and_start_game(HWND hwnd) {
                 continue;
             }
 
-            // 打开文件
-            std::ifstream file(entry.path(), std::ios::binary);
-            if (!file) continue;
-
-            // 获取文件大小
-            file.seekg(0, std::ios::end);
-            size_t filesize = file.tellg();
-            file.seekg(0, std::ios::beg);
-
-            // 计算 CRC
-            const size_t buffer_size = 8192;
-            std::vector<char> buffer(buffer_size);
-            std::hash<std::string_view> hasher;
-            size_t crc = 0;
-
-            while (file) {
-                file.read(buffer.data(), buffer_size);
-                std::streamsize count = file.gcount();
-                if (count > 0) {
-                    crc ^= hasher(std::string_view(buffer.data(), count));
-                }
+            FileMeta meta;
+            uint32_t crc = 0;
+            if (read_file_meta(entry.path().string(), meta) && cache->lookup(filename, meta, crc)) {
+                PatchVerifyResult result;
+                result.filename = filename;
+                result.filesize = meta.size;
+                result.crc = crc;
+                result.ok = true;
+                cached_results.push_back(result);
+                continue;
             }
-            file.close();
 
-            // 添加到补丁文件列表
-            patch_files.push_back({filename, filesize, crc});
+            patch_paths.push_back(entry.path().string());
+            patch_metas.push_back(meta);
         }
     }
 
-    // 构造请求消息
-    std::string request = "CHECK_PATCHES|\n";
-    for (const auto& file : patch_files) {
-        request += file.filename + "|" + std::to_string(file.crc) + "|\n";
-    }
-    request += "<END_OF_MESSAGE>";
+    // 只有变化过的文件才在工作线程中重新计算
+    g_verifier = std::make_shared<PatchVerifier>();
+    g_verifier->start(patch_paths,
+        [](const PatchVerifyResult& result) {
+        // 在校验线程中调用，事件队列可以从任意线程投递
+        if (result.ok) {
+            post_log("已校验: " + result.filename);
+        } else {
+            post_error("无法读取补丁: " + result.filename);
+        }
+    },
+        [cache, patch_paths, patch_metas, cached_results, has_verified](const std::vector<PatchVerifyResult>& results) {
+        // 更新缓存
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (results[i].ok && patch_metas[i].size == results[i].filesize) {
+                cache->update(results[i].filename, patch_metas[i], results[i].crc);
+            }
+        }
+        if (!results.empty() || has_verified) {
+            cache->save(HASH_CACHE_FILE);
+        }
 
-    //ConvertAndShowMessage(request);
+        // 构造请求消息
+        std::string request = "CHECK_PATCHES|\n";
+        for (const auto* list : { &cached_results, &results }) {
+            for (const auto& file : *list) {
+                if (file.ok) {
+                    request += file.filename + "|" + std::to_string(file.crc) + "|\n";
+                }
+            }
+        }
 
-    // 使用全局客户端发送请求
-    if (g_client) {
-        g_client->send_request(request);
-    }
+        // 回到网络线程发送
+        asio::post(global_io_context, [request]() {
+            if (g_client) {
+                g_client->send_request(request);
+            }
+        });
+    });
 }
 
 // 其他函数实现...
\ No newline at end of file
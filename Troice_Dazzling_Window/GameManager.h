@@ -4,11 +4,62 @@
 #include <windows.h>
 #include <string>
 #include <vector>
+#include <deque>
 #include <asio.hpp>
 #include <filesystem>
 #include <fstream>
 #include <string_view>
 #include <memory>
+#include <functional>
+#include <chrono>
+#include <map>
+#include "Protocol.h"
+#include "FileTransfer.h"
+#include "SegmentedDownload.h"
+#include "DeltaSync.h"
+#include "Compression.h"
+#include "PatchVerifier.h"
+#include "HashCache.h"
+#include "MerkleManifest.h"
+#include "DiskWriter.h"
+#include "ClientEvents.h"
+#include "TransferStats.h"
+#include "Connector.h"
+#include "HandlerMemory.h"
+#include "ChunkPool.h"
+#include "CommandParser.h"
+#include "ProtocolTrace.h"
+
+// 一次聚合写最多合并的数据包数
+const size_t MAX_GATHER_PACKETS = 64;
+// 最多保留的空闲发送缓冲区个数
+const size_t MAX_FREE_SEND_BUFFERS = 16;
+// 单连接下载每收到这么多字节报告一次进度
+const uint64_t PROGRESS_REPORT_INTERVAL = 1024 * 1024;
+// 一个流写盘完成的字节数攒到这么多才发送 WINDOW_UPDATE
+const uint32_t STREAM_WINDOW_UPDATE_THRESHOLD = STREAM_INITIAL_WINDOW / 2;
+// 一轮更新中同一个文件校验失败后重新下载的次数上限，服务器上的文件本身损坏时不会一直重试
+const unsigned MAX_CHECKSUM_RETRIES = 2;
+
+// C++20 编译时主连接可以改用协程收发，默认仍是回调链（协程版目前慢 10%～20%）
+#if defined(ASIO_HAS_CO_AWAIT)
+const bool CLIENT_HAS_COROUTINE_IO = true;
+#else
+const bool CLIENT_HAS_COROUTINE_IO = false;
+#endif
+
+// 一次回放的结果
+struct ReplayResult {
+    uint64_t packets = 0;               // 回放的入站数据包数
+    uint64_t bytes = 0;                 // 入站字节数，含包头
+    uint64_t outbound_matched = 0;      // 与录制时一致的出站数据包
+    uint64_t outbound_mismatched = 0;   // 与录制时不一致的出站数据包
+    uint64_t outbound_missing = 0;      // 录制中有、回放时没有发出的数据包
+    uint64_t outbound_extra = 0;        // 回放时多发出的数据包
+    uint64_t segmented_skipped = 0;     // 跳过的分段下载和修复，它们的数据走额外连接，不在录制中
+    double seconds = 0.0;               // 从开始到写盘全部完成
+    std::string error;
+};
 
 // 命令定义
 namespace Command {
@@ -16,9 +67,11 @@ namespace Command {
     const std::string CHECK_PATCHES = "CHECK_PATCHES|";        // 校验补丁
     const std::string DELETE_FILES = "DELETE_FILES|";          // 删除文件命令
     const std::string UPDATE_FILES = "UPDATE_FILES|";          // 更新文件命令
+    const std::string DOWNLOAD_FILES = "DOWNLOAD_FILES|";      // 下载文件列表: 文件名|大小|文件名|大小...
+    const std::string REPAIR_FILES = "REPAIR_FILES|";          // 需要按清单修复的文件: 文件名|文件名...
 }
 
-// 全局服务器信息
+// 全局服务器信息，只在界面线程读写，网络线程通过 ClientEvent 更新
 struct ServerInfo {
     static std::string ip;
     static std::string port;
@@ -27,13 +80,6 @@ struct ServerInfo {
     static bool isConnected;
 };
 
-// 补丁文件信息结构
-struct PatchFileInfo {
-    std::string filename;
-    size_t filesize;
-    size_t crc;
-};
-
 // 声明全局 io_context
 extern asio::io_context global_io_context;
 
@@ -43,37 +89,156 @@ class Client;
 // 添加全局客户端指针
 extern std::shared_ptr<Client> g_client;
 
-// 添加辅助函数声明
-void ConvertAndShowMessage(const std::string& message);
+// 正在进行或最近一次的补丁校验
+extern std::shared_ptr<PatchVerifier> g_verifier;
 
 // 客户端类
 class Client : public std::enable_shared_from_this<Client> {
 public:
     Client();
     void start(const std::string& server_ip, const std::string& server_port);
+    void start(const std::vector<ServerEndpoint>& servers);   // 第一个是主服务器，其余是镜像
+    // 主连接改用协程收发，在 start 之前调用，默认是回调链，不支持协程的编译中总是回调链。
+    // 两种方式的协议处理完全相同，PatchBench receive 用它比较
+    void set_coroutine_io(bool enabled);
     void send_request(const std::string& request);
+    void request_file(const std::string& filename, uint64_t offset = 0);
+    void download_file(const std::string& filename, uint64_t filesize);
+    void request_delta(const std::string& filename);
+    void repair_file(const std::string& filename, uint64_t filesize, const std::vector<uint64_t>& chunks,
+                     uint32_t chunk_size);
+
+    // 把主连接上收发的每个数据包录制到轨迹文件，可以在任意线程调用
+    void start_capture(const std::string& path);
+    // 停止录制并把缓冲的数据写入文件，等网络线程处理完才返回，不能在网络线程上调用
+    void stop_capture();
+    // 回放模式：不连接服务器，收到的数据包从轨迹文件读取，经过和网络数据完全相同的 handle_read 路径处理，
+    // 发出的数据包与录制的比较而不发送。paced 为 true 时按录制时的间隔回放，否则尽快回放。
+    // 轨迹读完且写盘全部完成后在网络线程上调用 on_done
+    void start_replay(const std::string& path, bool paced, std::function<void(const ReplayResult&)> on_done);
 
 private:
+    struct ReplayState {
+        TraceReader reader;
+        bool paced = false;
+        asio::steady_timer timer;
+        std::chrono::steady_clock::time_point started;
+        std::deque<std::string> expected;     // 录制的出站数据包，还没和回放结果比较的
+        std::deque<std::string> produced;     // 回放时发出的数据包，还没和录制比较的
+        TraceRecord held;                     // 缓冲池用完时留下的入站数据包，有块归还后接着回放
+        bool holding = false;
+        ReplayResult result;
+        std::function<void(const ReplayResult&)> on_done;
+
+        explicit ReplayState(asio::io_context& io_context) : timer(io_context) {}
+    };
+
+    // 多路复用下载中的一个流
+    struct MuxStream {
+        std::string filename;
+        std::shared_ptr<FileReceiver> receiver;   // 收到 STREAM_BEGIN 后才创建
+        uint32_t consumed = 0;                    // 已写盘但还没通过 WINDOW_UPDATE 归还的窗口
+    };
+
+    void connect();
+    void on_connected(asio::ip::tcp::socket socket, const ServerEndpoint& server);
+    void begin_session();
+    void schedule_reconnect();
+    void send_packet(MessageType type, std::string_view body);
+    void send_packet(std::string packet);
+    void do_write();
+    template <typename Job>
+    void submit_disk_job(const std::string& key, Job job);
+    void post_request_file(const std::string& filename);
+    void retry_corrupt_download(const std::string& filename, uint64_t filesize);
+    void resume_pending_downloads();
+    void handle_disconnect();
     void do_read();
+#if defined(ASIO_HAS_CO_AWAIT)
+    asio::awaitable<void> read_loop(std::shared_ptr<Client> self, uint64_t id);
+    asio::awaitable<void> write_loop(std::shared_ptr<Client> self, uint64_t id);
+#endif
+    void gather_writes();
+    void recycle_writes();
+    void abort_writes();
+    void replay_next();
+    bool skip_segmented_in_replay(const std::string& filename);
+    void match_outbound();
+    void finish_replay();
+    // 准备消息体接收缓冲区的结果
+    enum class BodyBuffer { READY, POOL_EXHAUSTED, INVALID };
+    BodyBuffer prepare_body(asio::mutable_buffer& target);
+    void handle_read_header(const asio::error_code& error, size_t bytes_transferred);
     void handle_read(const asio::error_code& error, size_t bytes_transferred);
-    void process_message(const std::string& message);
-    std::vector<std::string> parse_message(const std::string& message);
-    void handle_server_info(const std::vector<std::string>& parts);
-    void handle_delete_files(const std::vector<std::string>& files);
-    void handle_update_files(const std::string& filename, const std::vector<char>& content);
+    void dispatch_message(size_t length);
+    void process_message(std::string_view message);
+    void handle_server_info(std::string_view args);
+    void handle_delete_files(std::string_view args);
+    void handle_update_files(std::string_view filename, std::string_view content);
+    std::shared_ptr<FileReceiver> begin_receive(std::string_view message);
+    void finish_receive(const std::shared_ptr<FileReceiver>& receiver);
+    void handle_file_begin(std::string_view message);
+    void handle_file_chunk(std::string_view data);
+    void handle_file_chunk_z(std::string_view body);
+    void handle_file_end();
+    void open_stream(const std::string& filename, uint64_t offset);
+    void handle_stream_begin(std::string_view body);
+    void handle_stream_data(std::string_view body, bool compressed);
+    void handle_stream_end(std::string_view body, bool failed);
+    void stream_consumed(uint32_t stream_id, uint32_t bytes);
+    void handle_download_files(std::string_view args);
+    void handle_delta_begin(std::string_view message);
+    void handle_delta_copy(std::string_view data);
+    void handle_delta_literal(std::string_view data);
+    void handle_delta_end();
+    void handle_repair_files(std::string_view args);
+    void handle_manifest(std::string_view message);
+    void track_download(const std::shared_ptr<SegmentedDownloader>& downloader, const std::string& filename,
+                        uint64_t filesize);
 
+    HandlerMemory handler_memory_;   // 收发操作和重连定时器的内存，必须比 socket_ 后析构
+    HandlerMemory disk_handler_memory_;   // 写盘线程投递回网络线程的回调的内存
     asio::ip::tcp::socket socket_;
-    std::vector<char> buffer_;
-    std::string accumulated_data_;
-    std::shared_ptr<asio::streambuf> stream_buffer_;
-    std::string pending_message_;
+    PacketHeader header_;            // 当前正在读取的包头
+    std::vector<char> body_;         // 消息体接收缓冲区，跨消息复用
+    ChunkBuffer body_chunk_;         // 文件数据消息的消息体直接读进缓冲池的块，随写盘任务交给写盘线程
+    std::deque<std::string> write_queue_;       // 等待发送的数据包
+    std::vector<std::string> writing_;          // 正在发送的一批数据包，发送完成前不能改动
+    std::vector<asio::const_buffer> write_buffers_;  // 聚合写的缓冲区序列
+    std::vector<std::string> free_buffers_;     // 发送完回收的缓冲区
+    bool connected_ = false;                    // 连接建立前只排队不发送
+    DiskWriter disk_writer_;                        // 写盘流水线，文件操作都不在网络线程上做
+    size_t pending_disk_jobs_ = 0;                  // 还没进入写盘队列的任务数
+    bool read_deferred_ = false;                    // 写盘队列满时暂停读取 socket
+    std::shared_ptr<FileReceiver> receiving_file_;  // 正在分块接收的文件，只在写盘线程上操作
+    bool multiplex_ = false;                        // 服务器支持多路复用时用 STREAM_GET 代替 GET_FILE
+    uint32_t next_stream_id_ = 1;                   // 重连后也不复用，旧连接迟到的窗口归还不会算到新流上
+    std::map<uint32_t, MuxStream> streams_;         // 进行中的流
+    std::deque<std::pair<std::string, uint64_t>> stream_backlog_;  // 等待空闲流的 文件名、起始偏移
+    std::vector<std::shared_ptr<SegmentedDownloader>> segmented_downloads_;  // 进行中的分段下载
+    std::map<std::string, unsigned> checksum_retries_;  // 本轮更新中各文件因校验失败重新下载的次数
+    std::shared_ptr<DeltaApplier> delta_file_;      // 正在差量重建的文件，只在写盘线程上操作
+    std::string server_ip_;          // 当前连接的服务器，分段下载也连这里
+    std::string server_port_;
+    std::vector<ServerEndpoint> servers_;
+    std::shared_ptr<ConnectRace> connect_race_;
+    asio::steady_timer reconnect_timer_;
+    bool coroutine_io_ = false;
+    asio::steady_timer read_signal_;     // 协程版收包循环等待写盘或缓冲池时用的信号，cancel() 唤醒
+    asio::steady_timer write_signal_;    // 协程版发送循环等待新数据包时用的信号
+    uint64_t read_loop_id_ = 0;      // 已经启动收包循环的连接
+    uint64_t write_loop_id_ = 0;     // 已经启动发送循环的连接
+    unsigned reconnect_attempt_ = 0;
+    uint64_t connection_id_ = 0;     // 每次连上加一，旧连接的回调据此忽略
+    std::unique_ptr<TraceWriter> capture_;     // 录制中的轨迹，只在网络线程上使用
+    std::unique_ptr<ReplayState> replay_;      // 不为空时处于回放模式
 };
 
 // 函数声明
-void initialize_server_info();
+void initialize_server_info(const std::string& capture_path = "");
 void check_for_updates();
 void download_and_update();
 void download_file(const std::string& filename);
 void launch_game();
-void check_and_start_game(HWND hwnd);
+void check_and_start_game(HWND hwnd, bool full_rehash = false);
 
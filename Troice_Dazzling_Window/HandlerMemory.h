@@ -0,0 +1,89 @@
+#pragma once
+
+#include <asio.hpp>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// 每个连接预留的处理器内存块数，够读、写和一个定时器同时进行
+const size_t HANDLER_MEMORY_SLOTS = 3;
+// 每块的大小，asio 异步操作的状态连同回调一般不超过这个大小
+const size_t HANDLER_MEMORY_SLOT_SIZE = 512;
+
+// 连接自己的异步操作内存
+// asio 每发起一次异步操作都要为操作状态分配内存。用 bind_handler_memory 包装的回调通过 associated_allocator
+// 从这里取内存，操作完成后归还，同一块内存被下一个操作复用，连接建立后收发消息不再调用 malloc。
+// 块都被占用或操作状态超过块大小时退回 asio 的 recycling_allocator。
+// 块的占用标记是原子变量，操作可以在一个线程上发起、在另一个线程上完成，例如写盘线程投递回网络线程的回调。
+class HandlerMemory {
+public:
+    HandlerMemory() = default;
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* allocate(size_t size) {
+        if (size <= HANDLER_MEMORY_SLOT_SIZE) {
+            for (size_t i = 0; i < HANDLER_MEMORY_SLOTS; ++i) {
+                bool expected = false;
+                if (in_use_[i].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                    return &storage_[i];
+                }
+            }
+        }
+        return fallback_.allocate(size);
+    }
+
+    void deallocate(void* pointer, size_t size) {
+        for (size_t i = 0; i < HANDLER_MEMORY_SLOTS; ++i) {
+            if (pointer == &storage_[i]) {
+                in_use_[i].store(false, std::memory_order_release);
+                return;
+            }
+        }
+        fallback_.deallocate(static_cast<unsigned char*>(pointer), size);
+    }
+
+private:
+    struct alignas(std::max_align_t) Slot {
+        unsigned char bytes[HANDLER_MEMORY_SLOT_SIZE];
+    };
+
+    Slot storage_[HANDLER_MEMORY_SLOTS];
+    std::atomic<bool> in_use_[HANDLER_MEMORY_SLOTS] = {};
+    asio::recycling_allocator<unsigned char> fallback_;
+};
+
+// 从 HandlerMemory 分配的标准分配器，asio 通过 associated_allocator 取得
+template <typename T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory) : memory_(&memory) {}
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept : memory_(other.memory_) {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(memory_->allocate(sizeof(T) * count));
+    }
+
+    void deallocate(T* pointer, size_t count) {
+        memory_->deallocate(pointer, sizeof(T) * count);
+    }
+
+    bool operator==(const HandlerAllocator& other) const noexcept { return memory_ == other.memory_; }
+    bool operator!=(const HandlerAllocator& other) const noexcept { return memory_ != other.memory_; }
+
+private:
+    template <typename> friend class HandlerAllocator;
+
+    HandlerMemory* memory_;
+};
+
+// 把回调和连接的 HandlerMemory 绑定在一起，memory 必须比回调活得久，通常是回调持有的连接对象的成员。
+// 也可以包装 use_awaitable 这样的完成令牌，协程中的异步操作同样从 memory 分配
+template <typename Handler>
+auto bind_handler_memory(HandlerMemory& memory, Handler&& handler) {
+    return asio::bind_allocator(HandlerAllocator<char>(memory), std::forward<Handler>(handler));
+}
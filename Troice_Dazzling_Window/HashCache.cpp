@@ -0,0 +1,203 @@
+#include "HashCache.h"
+#include "Checksum.h"
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <mutex>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+bool read_file_meta(const std::string& path, FileMeta& meta) {
+    std::error_code ec;
+    meta.size = std::filesystem::file_size(path, ec);
+    if (ec) return false;
+    meta.mtime = static_cast<int64_t>(std::filesystem::last_write_time(path, ec).time_since_epoch().count());
+    if (ec) return false;
+
+#ifdef _WIN32
+    std::wstring wpath = std::filesystem::path(path).wstring();
+    HANDLE handle = CreateFileW(wpath.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL ok = GetFileInformationByHandle(handle, &info);
+    CloseHandle(handle);
+    if (!ok) return false;
+    meta.file_id = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    meta.file_id = static_cast<uint64_t>(st.st_ino);
+#endif
+    return true;
+}
+
+bool HashCache::load(const std::string& path) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec || size < sizeof(HashCacheHeader) || !mapped_.open(path, 0, static_cast<size_t>(size))) {
+        return false;
+    }
+
+    const HashCacheHeader* header = reinterpret_cast<const HashCacheHeader*>(mapped_.data());
+    uint64_t entries_end = sizeof(HashCacheHeader) + static_cast<uint64_t>(header->count) * sizeof(HashCacheEntry);
+    if (header->magic != HASH_CACHE_MAGIC || header->version != HASH_CACHE_VERSION || entries_end > size) {
+        mapped_.close();
+        return false;
+    }
+
+    count_ = header->count;
+    entries_ = reinterpret_cast<const HashCacheEntry*>(mapped_.data() + sizeof(HashCacheHeader));
+    names_ = mapped_.data() + entries_end;
+    names_size_ = static_cast<size_t>(size - entries_end);
+    return true;
+}
+
+const HashCacheEntry* HashCache::find(const std::string& filename) const {
+    if (!entries_) return nullptr;
+
+    uint64_t hash = fast_hash64(filename.data(), filename.size());
+    const HashCacheEntry* end = entries_ + count_;
+    const HashCacheEntry* it = std::lower_bound(entries_, end, hash,
+        [](const HashCacheEntry& entry, uint64_t value) { return entry.name_hash < value; });
+
+    // 哈希相同时再比较文件名
+    for (; it != end && it->name_hash == hash; ++it) {
+        if (static_cast<size_t>(it->name_offset) + it->name_length <= names_size_ &&
+            filename.compare(0, std::string::npos, names_ + it->name_offset, it->name_length) == 0) {
+            return it;
+        }
+    }
+    return nullptr;
+}
+
+bool HashCache::lookup(const std::string& filename, const FileMeta& meta, uint32_t& crc) const {
+    auto update = updates_.find(filename);
+    if (update != updates_.end()) {
+        const FileMeta& m = update->second.meta;
+        if (m.size == meta.size && m.mtime == meta.mtime && m.file_id == meta.file_id) {
+            crc = update->second.crc;
+            return true;
+        }
+        return false;
+    }
+
+    const HashCacheEntry* entry = find(filename);
+    if (!entry || entry->size != meta.size || entry->mtime != meta.mtime || entry->file_id != meta.file_id) {
+        return false;
+    }
+    crc = entry->crc;
+    return true;
+}
+
+void HashCache::update(const std::string& filename, const FileMeta& meta, uint32_t crc) {
+    updates_[filename] = { meta, crc };
+}
+
+bool HashCache::save(const std::string& path) {
+    // 合并旧条目和新结果
+    std::map<std::string, Record> records;
+    for (uint32_t i = 0; i < count_; ++i) {
+        const HashCacheEntry& entry = entries_[i];
+        if (static_cast<size_t>(entry.name_offset) + entry.name_length > names_size_) continue;
+
+        FileMeta meta;
+        meta.size = entry.size;
+        meta.mtime = entry.mtime;
+        meta.file_id = entry.file_id;
+        records[std::string(names_ + entry.name_offset, entry.name_length)] = { meta, entry.crc };
+    }
+    for (const auto& update : updates_) {
+        records[update.first] = update.second;
+    }
+
+    // 已删除的文件不再保留
+    std::string data_dir = std::filesystem::path(path).parent_path().string();
+    for (auto it = records.begin(); it != records.end();) {
+        std::error_code ec;
+        if (!std::filesystem::exists(std::filesystem::path(data_dir) / it->first, ec)) {
+            it = records.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::vector<HashCacheEntry> entries;
+    std::string names;
+    for (const auto& record : records) {
+        HashCacheEntry entry = {};
+        entry.name_hash = fast_hash64(record.first.data(), record.first.size());
+        entry.size = record.second.meta.size;
+        entry.mtime = record.second.meta.mtime;
+        entry.file_id = record.second.meta.file_id;
+        entry.crc = record.second.crc;
+        entry.name_offset = static_cast<uint32_t>(names.size());
+        entry.name_length = static_cast<uint32_t>(record.first.size());
+        names += record.first;
+        entries.push_back(entry);
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const HashCacheEntry& a, const HashCacheEntry& b) { return a.name_hash < b.name_hash; });
+
+    HashCacheHeader header = {};
+    header.magic = HASH_CACHE_MAGIC;
+    header.version = HASH_CACHE_VERSION;
+    header.count = static_cast<uint32_t>(entries.size());
+
+    // 先写临时文件再替换，避免写到一半时缓存损坏
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(HashCacheEntry));
+        file.write(names.data(), names.size());
+        if (!file.good()) return false;
+    }
+
+    mapped_.close();
+    entries_ = nullptr;
+    names_ = nullptr;
+    count_ = 0;
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) return false;
+
+    updates_.clear();
+    return load(path);
+}
+
+namespace {
+    // 写盘线程和网络线程都会记录，校验开始时由界面线程取走
+    std::mutex verified_mutex;
+    std::map<std::string, std::pair<FileMeta, uint32_t>> verified_hashes;
+}
+
+void remember_verified_hash(const std::string& filename, uint32_t crc) {
+    FileMeta meta;
+    if (!read_file_meta(data_file_path(filename), meta)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(verified_mutex);
+    verified_hashes[filename] = { meta, crc };
+}
+
+size_t apply_verified_hashes(HashCache& cache) {
+    std::map<std::string, std::pair<FileMeta, uint32_t>> hashes;
+    {
+        std::lock_guard<std::mutex> lock(verified_mutex);
+        hashes.swap(verified_hashes);
+    }
+
+    for (const auto& entry : hashes) {
+        cache.update(entry.first, entry.second.first, entry.second.second);
+    }
+    return hashes.size();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include "FileTransfer.h"
+
+// 文件元数据，三项都没变就认为文件内容没变
+struct FileMeta {
+    uint64_t size = 0;
+    int64_t mtime = 0;       // 最后修改时间
+    uint64_t file_id = 0;    // Windows 文件索引 / inode
+};
+
+bool read_file_meta(const std::string& path, FileMeta& meta);
+
+#pragma pack(push, 1)
+struct HashCacheHeader {
+    uint32_t magic;          // HASH_CACHE_MAGIC
+    uint32_t version;
+    uint32_t count;          // 条目数
+    uint32_t reserved;
+};
+
+// 固定长度的索引条目，按 name_hash 排序，文件名保存在条目数组之后的字符串区
+struct HashCacheEntry {
+    uint64_t name_hash;
+    uint64_t size;
+    int64_t mtime;
+    uint64_t file_id;
+    uint32_t crc;
+    uint32_t name_offset;    // 相对字符串区起点
+    uint32_t name_length;
+    uint32_t reserved;
+};
+#pragma pack(pop)
+
+const uint32_t HASH_CACHE_MAGIC = 0x43484454;   // "TDHC"
+const uint32_t HASH_CACHE_VERSION = 1;
+
+// 补丁文件哈希缓存
+// 缓存文件直接映射到内存，按文件名哈希二分查找，启动时不需要解析。
+// 新的结果先记在内存中，save() 时与旧条目合并后整体重写。
+class HashCache {
+public:
+    bool load(const std::string& path);
+    bool lookup(const std::string& filename, const FileMeta& meta, uint32_t& crc) const;
+    void update(const std::string& filename, const FileMeta& meta, uint32_t crc);
+    bool save(const std::string& path);
+
+private:
+    struct Record {
+        FileMeta meta;
+        uint32_t crc;
+    };
+
+    const HashCacheEntry* find(const std::string& filename) const;
+
+    MappedFile mapped_;
+    const HashCacheEntry* entries_ = nullptr;
+    const char* names_ = nullptr;
+    size_t names_size_ = 0;
+    uint32_t count_ = 0;
+    std::map<std::string, Record> updates_;
+};
+
+// 缓存文件路径
+const char* const HASH_CACHE_FILE = ".\\Data\\patch_hashes.idx";
+
+// 下载时边收边算出并校验过的 CRC。文件改名到位后调用，记录当时的元数据，
+// 下一次 check_and_start_game 把它们合并进缓存，刚下载的文件不必重新读一遍
+void remember_verified_hash(const std::string& filename, uint32_t crc);
+// 取出记录的结果并写进 cache，返回条数
+size_t apply_verified_hashes(HashCache& cache);
@@ -9,6 +9,9 @@
 // 其他头文件
 #include "main.h"
 #include "GameManager.h"
+#include <deque>
+#include <map>
+#include <cstdio>
 
 // 定义全局变量
 static ID3D11Device* g_pd3dDevice = nullptr;
@@ -17,6 +20,7 @@ static IDXGISwapChain* g_pSwapChain = nullptr;
 static UINT g_ResizeWidth = 0, g_ResizeHeight = 0;
 static ID3D11RenderTargetView* g_mainRenderTargetView = nullptr;
 ID3D11ShaderResourceView* g_background = nullptr;  // 定义 g_background
+static std::string g_capturePath;                  // 命令行 --capture <文件> 指定的协议轨迹文件
 
 // 函数声明
 bool CreateDeviceD3D(HWND hWnd);
@@ -33,6 +37,16 @@ int WinMain(
     int nShowCmd
 )
 {
+    // --capture <文件>: 把与服务器之间的通信录制下来，供 TraceReplay 回放
+    std::string cmdLine = lpCmdLine ? lpCmdLine : "";
+    size_t capture = cmdLine.find("--capture ");
+    if (capture != std::string::npos)
+    {
+        g_capturePath = cmdLine.substr(capture + 10);
+        g_capturePath.erase(0, g_capturePath.find_first_not_of(" \""));
+        g_capturePath.erase(g_capturePath.find_last_not_of(" \"") + 1);
+    }
+
     WNDCLASSEXW wc = { sizeof(wc), CS_CLASSDC, WndProc, 0L, 0L, GetModuleHandle(nullptr), nullptr, nullptr, nullptr, nullptr, L"ImGui Example", nullptr };
     ::RegisterClassExW(&wc);
     HWND hwnd = ::CreateWindowW(wc.lpszClassName, L"Troice Dazzling Window", WS_POPUP, 100, 100, 0, 0, nullptr, nullptr, wc.hInstance, nullptr);
@@ -150,6 +164,12 @@ int WinMain(
     ::DestroyWindow(hwnd);
     ::UnregisterClassW(wc.lpszClassName, wc.hInstance);
 
+    // 退出前把录制缓冲区中的数据写完
+    if (g_client && !g_capturePath.empty())
+    {
+        g_client->stop_capture();
+    }
+
     return 0;
 }
 
@@ -275,11 +295,132 @@ LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
 
 
 
+// 界面上显示的客户端消息
+struct ClientMessage {
+    bool error;
+    std::string text;
+};
+
+static const size_t MAX_CLIENT_MESSAGES = 50;
+static std::deque<ClientMessage> g_clientMessages;                             // 最近的消息，最新的在最后
+static std::map<std::string, std::pair<uint64_t, uint64_t>> g_downloadProgress;  // 文件名 -> (已下载, 总大小)
+
+// 每帧取出网络线程发来的事件，界面状态只在这里修改
+static void DrainClientEvents() {
+    ClientEvent event;
+    while (poll_client_event(event)) {
+        switch (event.type) {
+        case ClientEventType::LOG:
+        case ClientEventType::ERROR_MESSAGE:
+            g_clientMessages.push_back({ event.type == ClientEventType::ERROR_MESSAGE, std::move(event.text) });
+            if (g_clientMessages.size() > MAX_CLIENT_MESSAGES) {
+                g_clientMessages.pop_front();
+            }
+            break;
+        case ClientEventType::PROGRESS:
+            if (event.done >= event.total) {
+                g_downloadProgress.erase(event.text);
+            } else {
+                g_downloadProgress[event.text] = { event.done, event.total };
+            }
+            break;
+        case ClientEventType::SERVER_INFO:
+            ServerInfo::ip = std::move(event.ip);
+            ServerInfo::port = std::move(event.port);
+            ServerInfo::name = std::move(event.text);
+            ServerInfo::notice = std::move(event.notice);
+            ServerInfo::isConnected = true;
+            break;
+        case ClientEventType::DISCONNECTED:
+            ServerInfo::isConnected = false;
+            break;
+        }
+    }
+}
+
+// 统计导出到登录器所在目录下的 Logs，不和补丁一起放进游戏的 Data 目录
+static std::string stats_export_path(const char* filename) {
+    wchar_t module[MAX_PATH];
+    DWORD length = GetModuleFileNameW(nullptr, module, MAX_PATH);
+    std::filesystem::path dir = length > 0 && length < MAX_PATH
+        ? std::filesystem::path(module).parent_path() : std::filesystem::current_path();
+    dir /= "Logs";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    return (dir / filename).string();
+}
+
+// 传输统计面板，放在通知区域左侧
+static void StatsPanel(ImVec2 pos, ImVec2 size) {
+    StatsSnapshot stats = g_transfer_stats.snapshot();
+    const double MB = 1024.0 * 1024.0;
+
+    ImGui::SetCursorPos(pos);
+    ImGui::BeginChild("传输统计", size, true);
+    ImGui::Text("速度 %.2f MB/s", stats.rate_ewma / MB);
+    ImGui::Text("峰值 %.2f MB/s", stats.rate_peak / MB);
+    ImGui::Text("已接收 %.1f MB", stats.bytes_received / MB);
+    ImGui::Separator();
+    ImGui::Text("发送队列 %lld", (long long)stats.send_queue_depth);
+    ImGui::Text("写盘队列 %lld", (long long)stats.disk_queue_depth);
+    ImGui::Text("在途写入 %lld", (long long)stats.file_writes_in_flight);
+    ImGui::Text("写盘延迟 %.0f/%llu us", stats.disk_write.average_us, (unsigned long long)stats.disk_write.max_us);
+    ImGui::Text("校验速度 %.1f MB/s", stats.hash_rate / MB);
+    ImGui::Text("数据块 %llu/%llu 峰值 %llu", (unsigned long long)stats.chunk_pool.in_use,
+                (unsigned long long)stats.chunk_pool.allocated, (unsigned long long)stats.chunk_pool.high_water);
+    ImGui::Text("缓冲池等待 %llu 次 %.1f ms", (unsigned long long)stats.chunk_pool.stalls,
+                stats.chunk_pool.stall_us / 1000.0);
+    ImGui::Text("丢弃的进度事件 %llu", (unsigned long long)dropped_progress_events());
+    ImGui::Separator();
+    for (const auto& rate : stats.segmented) {
+        ImGui::Text("%s %.2f MB/s %zu 个连接", rate.filename.c_str(), rate.aggregate_rate / MB,
+                    rate.connection_rates.size());
+        std::string connections;
+        for (double connection_rate : rate.connection_rates) {
+            char text[32];
+            std::snprintf(text, sizeof(text), " %.2f", connection_rate / MB);
+            connections += text;
+        }
+        ImGui::Text("  各连接 MB/s:%s", connections.c_str());
+    }
+    for (const auto& file : stats.active_files) {
+        if (file.first_byte_ms < 0) {
+            ImGui::Text("%s 首字节 等待中", file.filename.c_str());
+        } else {
+            ImGui::Text("%s 首字节 %.0f ms", file.filename.c_str(), file.first_byte_ms);
+        }
+    }
+    if (!stats.finished_files.empty()) {
+        const FileTiming& last = stats.finished_files.back();
+        ImGui::Text("%s 完成 %.0f ms", last.filename.c_str(), last.complete_ms);
+    }
+
+    if (ImGui::Button("导出 JSON")) {
+        std::string path = stats_export_path("transfer_stats.json");
+        if (g_transfer_stats.dump_json(path)) {
+            post_log("统计已导出: " + path);
+        } else {
+            post_error("导出统计失败: " + path);
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("导出 CSV")) {
+        std::string path = stats_export_path("transfer_stats.csv");
+        if (g_transfer_stats.dump_csv(path)) {
+            post_log("统计已导出: " + path);
+        } else {
+            post_error("导出统计失败: " + path);
+        }
+    }
+    ImGui::EndChild();
+}
+
 void MainWindow() {
     static bool open = true;
     static bool first_time = true;
     static int bg_width = 0, bg_height = 0;
     static bool serverOnline = true;
+    static bool showStats = false;
     static HWND main_hwnd = NULL;
     
     if (first_time)
@@ -288,11 +429,14 @@ void MainWindow() {
         main_hwnd = GetActiveWindow();
         
         // 直接调用 initialize_server_info
-        initialize_server_info();
+        initialize_server_info(g_capturePath);
         
         first_time = false;
     }
 
+    DrainClientEvents();
+    g_transfer_stats.sample();
+
     if (open) {
         // 设置窗口和按钮的样式
         ImGuiStyle& style = ImGui::GetStyle();
@@ -331,6 +475,12 @@ void MainWindow() {
             open = false;
         }
 
+        // 传输统计开关
+        ImGui::SetCursorPos(ImVec2(ImGui::GetWindowSize().x - 110, 10));
+        if (ImGui::Button("统计", ImVec2(60, 30))) {
+            showStats = !showStats;
+        }
+
         // 计算底部按钮的位置和间距
         float button_width = 150;
         float button_height = 40;
@@ -394,6 +544,24 @@ void MainWindow() {
         ImGui::SetWindowFontScale(1.0f);
         ImGui::EndChild();
 
+        if (showStats) {
+            StatsPanel(ImVec2(start_x, 60), ImVec2(button_width + spacing - 10, 360));
+        }
+
+        // 下载进度和最近的消息
+        ImGui::SetCursorPos(ImVec2(start_x + button_width + spacing, 430));
+        ImGui::BeginChild("消息区域", ImVec2(600, 60), false);
+        for (const auto& progress : g_downloadProgress) {
+            double percent = progress.second.second ? 100.0 * progress.second.first / progress.second.second : 0.0;
+            ImGui::Text("正在下载 %s %.1f%%", progress.first.c_str(), percent);
+        }
+        int shown = 0;
+        for (auto it = g_clientMessages.rbegin(); it != g_clientMessages.rend() && shown < 3; ++it, ++shown) {
+            ImVec4 color = it->error ? ImVec4(1.0f, 0.4f, 0.4f, 1.0f) : ImVec4(1.0f, 1.0f, 1.0f, 1.0f);
+            ImGui::TextColored(color, "%s", it->text.c_str());
+        }
+        ImGui::EndChild();
+
         // 底部按钮 - 所有四个按钮
         ImGui::SetCursorPos(ImVec2(start_x, start_y));
         if (ImGui::Button("注册账号", ImVec2(button_width, button_height))) {
@@ -410,9 +578,16 @@ void MainWindow() {
             // 处理进入QQ群按钮点击
         }
 
+        // 校验进度
+        if (g_verifier && g_verifier->is_running()) {
+            ImGui::SetCursorPos(ImVec2(start_x + (button_width + spacing) * 3, start_y - 30));
+            ImGui::Text("正在校验补丁 %d/%d", (int)g_verifier->files_done(), (int)g_verifier->files_total());
+        }
+
         ImGui::SetCursorPos(ImVec2(start_x + (button_width + spacing) * 3, start_y));
         if (ImGui::Button("启动游戏", ImVec2(button_width, button_height))) {
-            check_and_start_game(main_hwnd);  // 传递窗口句柄
+            // 按住 Shift 点击时忽略缓存，完整重新校验
+            check_and_start_game(main_hwnd, ImGui::GetIO().KeyShift);  // 传递窗口句柄
         }
 
         // 恢复按钮样式
@@ -0,0 +1,135 @@
+#include "MerkleManifest.h"
+#include "Checksum.h"
+#include <fstream>
+#include <cstring>
+
+namespace {
+    uint64_t hash_pair(uint64_t left, uint64_t right) {
+        uint64_t pair[2] = { left, right };
+        return fast_hash64(pair, sizeof(pair));
+    }
+}
+
+uint64_t MerkleTree::root() const {
+    if (levels.empty() || levels.back().empty()) {
+        return 0;
+    }
+    return levels.back()[0];
+}
+
+void MerkleTree::build_from_leaves(std::vector<uint64_t> leaves) {
+    levels.clear();
+    levels.push_back(std::move(leaves));
+
+    while (levels.back().size() > 1) {
+        const std::vector<uint64_t>& below = levels.back();
+        std::vector<uint64_t> level((below.size() + 1) / 2);
+        for (size_t i = 0; i < level.size(); ++i) {
+            size_t left = i * 2;
+            level[i] = left + 1 < below.size() ? hash_pair(below[left], below[left + 1]) : below[left];
+        }
+        levels.push_back(std::move(level));
+    }
+}
+
+bool build_merkle_tree(const std::string& path, uint32_t chunk_size, MerkleTree& tree) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file || chunk_size == 0) return false;
+
+    std::vector<char> buffer(chunk_size);
+    std::vector<uint64_t> leaves;
+    uint64_t filesize = 0;
+
+    while (file) {
+        file.read(buffer.data(), chunk_size);
+        std::streamsize count = file.gcount();
+        if (count <= 0) break;
+        leaves.push_back(fast_hash64(buffer.data(), static_cast<size_t>(count)));
+        filesize += static_cast<uint64_t>(count);
+    }
+
+    tree.filesize = filesize;
+    tree.chunk_size = chunk_size;
+    tree.build_from_leaves(std::move(leaves));
+    return true;
+}
+
+std::string serialize_merkle_manifest(const MerkleTree& tree) {
+    MerkleManifestHeader header;
+    header.magic = MERKLE_MANIFEST_MAGIC;
+    header.chunkSize = tree.chunk_size;
+    header.fileSize = tree.filesize;
+    header.leafCount = static_cast<uint32_t>(tree.leaf_count());
+
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (header.leafCount > 0) {
+        data.append(reinterpret_cast<const char*>(tree.levels[0].data()), header.leafCount * sizeof(uint64_t));
+    }
+    return data;
+}
+
+bool parse_merkle_manifest(std::string_view data, MerkleTree& tree) {
+    MerkleManifestHeader header;
+    if (data.size() < sizeof(header)) return false;
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    if (header.magic != MERKLE_MANIFEST_MAGIC || header.chunkSize == 0 ||
+        data.size() != sizeof(header) + static_cast<uint64_t>(header.leafCount) * sizeof(uint64_t)) {
+        return false;
+    }
+
+    std::vector<uint64_t> leaves(header.leafCount);
+    if (header.leafCount > 0) {
+        std::memcpy(leaves.data(), data.data() + sizeof(header), header.leafCount * sizeof(uint64_t));
+    }
+
+    tree.filesize = header.fileSize;
+    tree.chunk_size = header.chunkSize;
+    tree.build_from_leaves(std::move(leaves));
+    return true;
+}
+
+std::vector<uint64_t> diff_merkle_trees(const MerkleTree& local, const MerkleTree& remote) {
+    std::vector<uint64_t> chunks;
+    const size_t remote_leaves = remote.leaf_count();
+
+    if (local.chunk_size != remote.chunk_size) {
+        // 分块大小不同，整个文件都需要重新下载
+        for (uint64_t i = 0; i < remote_leaves; ++i) chunks.push_back(i);
+    }
+    else if (local.levels.size() != remote.levels.size()) {
+        // 文件长度相差太多导致树高不同时，直接逐个比较叶子
+        const size_t local_leaves = local.leaf_count();
+        for (uint64_t i = 0; i < remote_leaves; ++i) {
+            if (i >= local_leaves || local.levels[0][i] != remote.levels[0][i]) {
+                chunks.push_back(i);
+            }
+        }
+    }
+    else if (local.filesize != remote.filesize || local.root() != remote.root()) {
+        // 自顶向下，每层只保留哈希不同的节点
+        std::vector<size_t> differing = { 0 };
+        for (size_t level = remote.levels.size() - 1; level > 0; --level) {
+            const auto& local_below = local.levels[level - 1];
+            const auto& remote_below = remote.levels[level - 1];
+
+            std::vector<size_t> next;
+            for (size_t node : differing) {
+                for (size_t child = node * 2; child <= node * 2 + 1 && child < remote_below.size(); ++child) {
+                    if (child >= local_below.size() || local_below[child] != remote_below[child]) {
+                        next.push_back(child);
+                    }
+                }
+            }
+            differing.swap(next);
+        }
+        chunks.assign(differing.begin(), differing.end());
+    }
+
+    // 本地文件的最后一个数据块可能比服务器的短，哈希相同也要修正长度
+    if (local.filesize != remote.filesize && remote_leaves > 0 &&
+        (chunks.empty() || chunks.back() != remote_leaves - 1)) {
+        chunks.push_back(remote_leaves - 1);
+    }
+    return chunks;
+}
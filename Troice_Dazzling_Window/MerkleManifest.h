@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+// 清单中每个叶子对应的数据块大小
+const uint32_t MERKLE_CHUNK_SIZE = 1024 * 1024;
+
+#pragma pack(push, 1)
+struct MerkleManifestHeader {
+    uint32_t magic;        // MERKLE_MANIFEST_MAGIC
+    uint32_t chunkSize;
+    uint64_t fileSize;
+    uint32_t leafCount;    // 后面紧跟 leafCount 个 uint64_t 叶子哈希
+};
+#pragma pack(pop)
+
+const uint32_t MERKLE_MANIFEST_MAGIC = 0x4D4B4454;   // "TDKM"
+
+// 文件的 Merkle 树，levels[0] 是叶子（每个数据块的哈希），最后一层只有根
+struct MerkleTree {
+    uint64_t filesize = 0;
+    uint32_t chunk_size = MERKLE_CHUNK_SIZE;
+    std::vector<std::vector<uint64_t>> levels;
+
+    uint64_t root() const;
+    size_t leaf_count() const { return levels.empty() ? 0 : levels[0].size(); }
+
+    // 由叶子构造上层节点，奇数个时最后一个节点直接上提
+    void build_from_leaves(std::vector<uint64_t> leaves);
+};
+
+bool build_merkle_tree(const std::string& path, uint32_t chunk_size, MerkleTree& tree);
+
+// 清单只传输叶子，接收方自行构造上层
+std::string serialize_merkle_manifest(const MerkleTree& tree);
+bool parse_merkle_manifest(std::string_view data, MerkleTree& tree);
+
+// 从根开始比较，只进入哈希不同的子树，返回需要重新下载的数据块序号
+std::vector<uint64_t> diff_merkle_trees(const MerkleTree& local, const MerkleTree& remote);
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+// 大于这个大小的文件拆成多个区间并行计算
+const uint64_t VERIFY_RANGE_SIZE = 64ull * 1024 * 1024;
+// 扫描本地文件的工作线程数上限
+const size_t FILE_SCAN_MAX_THREADS = 4;
+
+// 单个文件的校验结果
+struct PatchVerifyResult {
+    std::string filename;
+    uint64_t filesize = 0;
+    uint32_t crc = 0;
+    bool ok = false;      // 读取失败时为 false
+};
+
+// 补丁目录校验器
+// 在工作线程池中并行计算各个补丁文件的 CRC32C，大文件按区间拆分后用 crc32c_combine 合并。
+// 机械硬盘上并行随机读反而更慢，检测到寻道开销时退化为单线程顺序读取。
+class PatchVerifier : public std::enable_shared_from_this<PatchVerifier> {
+public:
+    PatchVerifier();
+
+    // 开始校验，on_file 在每个文件完成时调用，on_done 在全部完成时调用（都在工作线程中）
+    void start(const std::vector<std::string>& paths,
+               std::function<void(const PatchVerifyResult&)> on_file,
+               std::function<void(const std::vector<PatchVerifyResult>&)> on_done);
+    void cancel();
+
+    bool is_running() const { return running_; }
+    size_t files_total() const { return files_total_; }
+    size_t files_done() const { return files_done_; }
+    uint64_t bytes_total() const { return bytes_total_; }
+    uint64_t bytes_done() const { return bytes_done_; }
+
+private:
+    struct FileJob {
+        std::string path;
+        PatchVerifyResult result;
+        std::vector<uint32_t> range_crcs;
+        std::atomic<size_t> ranges_left{ 0 };
+        std::atomic<bool> failed{ false };
+    };
+
+    struct RangeTask {
+        FileJob* job;
+        size_t index;
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    void worker();
+    void run_task(const RangeTask& task);
+    void finish_file(FileJob& job);
+
+    std::vector<std::unique_ptr<FileJob>> jobs_;
+    std::deque<RangeTask> tasks_;
+    std::mutex mutex_;
+    std::function<void(const PatchVerifyResult&)> on_file_;
+    std::function<void(const std::vector<PatchVerifyResult>&)> on_done_;
+
+    std::atomic<bool> running_;
+    std::atomic<bool> cancelled_;
+    std::atomic<size_t> files_total_;
+    std::atomic<size_t> files_done_;
+    std::atomic<uint64_t> bytes_total_;
+    std::atomic<uint64_t> bytes_done_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+// 本地文件扫描队列
+// 差量签名、Merkle 树这类要读完整个本地文件的任务排进同一个队列，由有限个工作线程依次执行，
+// 一次更新有很多文件时不会同时开出同样多的线程。和 PatchVerifier 一样，机械硬盘上只用一个线程顺序读取。
+class FileScanQueue {
+public:
+    // path 只用来在第一次提交时判断磁盘类型，task 在工作线程中执行
+    void post(const std::string& path, std::function<void()> task);
+
+private:
+    void worker();
+
+    std::mutex mutex_;
+    std::deque<std::function<void()>> tasks_;
+    size_t threads_ = 0;
+    size_t max_threads_ = 0;
+};
+
+extern FileScanQueue g_file_scan_queue;
+
+// 判断路径所在的磁盘是否有寻道开销（机械硬盘）
+bool path_on_rotational_disk(const std::string& path);
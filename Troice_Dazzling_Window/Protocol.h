@@ -1,17 +1,58 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <cstdint>
+#include <cstring>
 
 // 包头大小
 const uint32_t PACKET_HEADER_SIZE = 8;
 
+// 协议版本号
+const uint16_t PROTOCOL_VERSION = 2;
+
+// 单个消息体的最大长度，超过视为非法包
+const uint32_t MAX_BODY_LENGTH = 64 * 1024 * 1024;
+// 客户端发给服务器的消息体上限，服务器收到更长的请求直接断开
+// 最长的请求是 DELTA_REQUEST 的签名列表，64 KB 分块时够覆盖 10 GB 以上的本地文件
+const uint32_t MAX_REQUEST_BODY_LENGTH = 2 * 1024 * 1024;
+
+// 分块传输时每个 FILE_CHUNK 的最大数据长度
+const uint32_t FILE_CHUNK_SIZE = 256 * 1024;
+
+// 多路复用：服务器在 SERVER_INFO 的最后一个字段带上这个标记，客户端才会使用 STREAM_* 消息
+const char* const CAPABILITY_MULTIPLEX = "MUX";
+// 一个连接上同时进行的流数上限
+const uint32_t MUX_MAX_STREAMS = 8;
+// 每个流的初始发送窗口，单位是流数据消息体的字节数（不含 StreamFrameHeader）
+const uint32_t STREAM_INITIAL_WINDOW = 4 * FILE_CHUNK_SIZE;
+
 // 消息类型
 enum class MessageType : uint16_t {
     UNKNOWN = 0,
     GET_NOTICE = 1,        // 获取通知
     NOTICE_RESPONSE = 2,   // 通知响应
-    GET_FILE = 3,         // 获取文件
+    GET_FILE = 3,         // 获取文件，消息体: 文件名|起始偏移[|长度]，长度省略时发送到文件末尾
     FILE_RESPONSE = 4,    // 文件响应
+    TEXT_COMMAND = 5,     // 文本命令（SERVER_INFO| 等，消息体不再带结束标记）
+    FILE_BEGIN = 6,       // 分块传输开始，消息体: 文件名|文件大小|起始偏移[|CRC32C]，CRC 是整个文件的，客户端边收边校验
+    FILE_CHUNK = 7,       // 分块数据，消息体为原始字节，不超过 FILE_CHUNK_SIZE
+    FILE_END = 8,         // 分块传输结束，消息体为空
+    DELTA_REQUEST = 9,    // 请求差量更新，消息体: 文件名|分块大小| 后接 BlockSignature 数组
+    DELTA_BEGIN = 10,     // 差量传输开始，消息体: 文件名|新文件大小|分块大小[|CRC32C]
+    DELTA_COPY = 11,      // 从本地旧文件复制分块，消息体为 DeltaCopy
+    DELTA_LITERAL = 12,   // 字面数据，消息体为原始字节
+    DELTA_END = 13,       // 差量传输结束，消息体为空
+    FILE_CHUNK_Z = 14,    // 压缩的分块数据，消息体: CompressedChunkHeader + zlib 数据
+    GET_MANIFEST = 15,    // 请求文件的 Merkle 清单，消息体: 文件名
+    MANIFEST = 16,        // Merkle 清单，消息体: 文件名| 后接 MerkleManifestHeader 和叶子哈希
+    // 以下消息的消息体都以 StreamFrameHeader 开头，不同流的数据可以在一个连接上交错发送
+    STREAM_GET = 17,      // 在新的流上获取文件，后接: 文件名|起始偏移[|长度]
+    STREAM_BEGIN = 18,    // 流开始，后接: 文件名|文件大小|起始偏移[|CRC32C]
+    STREAM_DATA = 19,     // 流数据，后接原始字节
+    STREAM_DATA_Z = 20,   // 压缩的流数据，后接 CompressedChunkHeader + zlib 数据
+    STREAM_END = 21,      // 流结束，之后这个流 ID 不再使用
+    STREAM_ERROR = 22,    // 流出错并结束，后接错误信息，其他流不受影响
+    WINDOW_UPDATE = 23,   // 客户端处理完数据后增加流的发送窗口，后接 uint32 增量
     ERROR_RESPONSE = 999   // 错误响应
 };
 
@@ -22,7 +63,64 @@ struct PacketHeader {
     uint32_t bodyLength;   // 消息体长度
     uint16_t version;      // 协议版本号
 
-    PacketHeader() : messageType(0), bodyLength(0), version(1) {}
+    PacketHeader() : messageType(0), bodyLength(0), version(PROTOCOL_VERSION) {}
+};
+#pragma pack(pop)
+
+static_assert(sizeof(PacketHeader) == PACKET_HEADER_SIZE, "PacketHeader 必须是 8 字节");
+
+// STREAM_* 和 WINDOW_UPDATE 消息体的开头，流 ID 由客户端分配，0 不使用
+#pragma pack(push, 1)
+struct StreamFrameHeader {
+    uint32_t streamId;
 };
 #pragma pack(pop)
 
+// 把一个完整的数据包（包头 + 消息体）追加到 out 末尾，out 可以是复用的缓冲区
+inline void append_packet(std::string& out, MessageType type, std::string_view body) {
+    PacketHeader header;
+    header.messageType = static_cast<uint16_t>(type);
+    header.bodyLength = static_cast<uint32_t>(body.size());
+
+    size_t pos = out.size();
+    out.resize(pos + PACKET_HEADER_SIZE + body.size());
+    std::memcpy(&out[pos], &header, PACKET_HEADER_SIZE);
+    if (!body.empty()) {
+        std::memcpy(&out[pos + PACKET_HEADER_SIZE], body.data(), body.size());
+    }
+}
+
+// 构造一个完整的数据包（包头 + 消息体）
+inline std::string make_packet(MessageType type, std::string_view body) {
+    std::string packet;
+    append_packet(packet, type, body);
+    return packet;
+}
+
+// 追加一个多路复用的数据包，消息体为 StreamFrameHeader + payload
+inline void append_stream_packet(std::string& out, MessageType type, uint32_t stream_id, std::string_view payload) {
+    PacketHeader header;
+    header.messageType = static_cast<uint16_t>(type);
+    header.bodyLength = static_cast<uint32_t>(sizeof(StreamFrameHeader) + payload.size());
+    StreamFrameHeader frame = { stream_id };
+
+    size_t pos = out.size();
+    out.resize(pos + PACKET_HEADER_SIZE + header.bodyLength);
+    std::memcpy(&out[pos], &header, PACKET_HEADER_SIZE);
+    std::memcpy(&out[pos + PACKET_HEADER_SIZE], &frame, sizeof(frame));
+    if (!payload.empty()) {
+        std::memcpy(&out[pos + PACKET_HEADER_SIZE + sizeof(frame)], payload.data(), payload.size());
+    }
+}
+
+// 拆出多路复用消息体中的流 ID 和其余部分
+inline bool split_stream_frame(std::string_view body, uint32_t& stream_id, std::string_view& payload) {
+    StreamFrameHeader frame;
+    if (body.size() < sizeof(frame)) {
+        return false;
+    }
+    std::memcpy(&frame, body.data(), sizeof(frame));
+    stream_id = frame.streamId;
+    payload = body.substr(sizeof(frame));
+    return stream_id != 0;
+}
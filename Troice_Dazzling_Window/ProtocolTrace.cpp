@@ -0,0 +1,120 @@
+#include "ProtocolTrace.h"
+#include <algorithm>
+#include <cstring>
+
+TraceWriter::~TraceWriter() {
+    close();
+}
+
+bool TraceWriter::open(const std::string& path) {
+    close();
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!file_) {
+        return false;
+    }
+
+    TraceFileHeader header;
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.startTime = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    last_ = std::chrono::steady_clock::now();
+    buffer_.clear();
+    buffer_.reserve(TRACE_FLUSH_SIZE + PACKET_HEADER_SIZE + FILE_CHUNK_SIZE);
+    return file_.good();
+}
+
+void TraceWriter::append_record_header(TraceDirection direction, size_t length) {
+    auto now = std::chrono::steady_clock::now();
+    uint64_t delta = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - last_).count());
+    last_ = now;
+
+    TraceRecordHeader header;
+    header.deltaMicros = static_cast<uint32_t>(std::min<uint64_t>(delta, UINT32_MAX));
+    header.direction = static_cast<uint8_t>(direction);
+    header.length = static_cast<uint32_t>(length);
+    buffer_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void TraceWriter::record(TraceDirection direction, const PacketHeader& header, std::string_view body) {
+    if (!file_.is_open()) {
+        return;
+    }
+
+    append_record_header(direction, PACKET_HEADER_SIZE + body.size());
+    buffer_.append(reinterpret_cast<const char*>(&header), PACKET_HEADER_SIZE);
+    buffer_.append(body.data(), body.size());
+    if (buffer_.size() >= TRACE_FLUSH_SIZE) {
+        file_.write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+}
+
+void TraceWriter::record(TraceDirection direction, std::string_view packet) {
+    if (!file_.is_open()) {
+        return;
+    }
+
+    append_record_header(direction, packet.size());
+    buffer_.append(packet.data(), packet.size());
+    if (buffer_.size() >= TRACE_FLUSH_SIZE) {
+        file_.write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+}
+
+void TraceWriter::close() {
+    if (!file_.is_open()) {
+        return;
+    }
+    file_.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+    file_.close();
+}
+
+bool TraceReader::open(const std::string& path) {
+    file_.open(path, std::ios::binary);
+    if (!file_) {
+        last_error_ = "无法打开轨迹文件: " + path;
+        return false;
+    }
+
+    TraceFileHeader header;
+    if (!file_.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magic != TRACE_MAGIC || header.version != TRACE_VERSION) {
+        last_error_ = "不是有效的轨迹文件: " + path;
+        return false;
+    }
+    timestamp_ = 0;
+    return true;
+}
+
+bool TraceReader::next(TraceRecord& record) {
+    TraceRecordHeader header;
+    if (!file_.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        // 正好在记录边界结束是正常的文件结尾
+        if (file_.gcount() != 0) {
+            last_error_ = "轨迹文件被截断";
+        }
+        return false;
+    }
+
+    if (header.length < PACKET_HEADER_SIZE || header.length > PACKET_HEADER_SIZE + MAX_BODY_LENGTH ||
+        header.direction > static_cast<uint8_t>(TraceDirection::REQUEST)) {
+        last_error_ = "轨迹文件记录损坏";
+        return false;
+    }
+
+    record.packet.resize(header.length);
+    if (!file_.read(&record.packet[0], header.length)) {
+        last_error_ = "轨迹文件被截断";
+        return false;
+    }
+
+    timestamp_ += header.deltaMicros;
+    record.timestamp = timestamp_;
+    record.direction = static_cast<TraceDirection>(header.direction);
+    return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+#include "Protocol.h"
+
+const uint32_t TRACE_MAGIC = 0x52544454;   // "TDTR"
+const uint32_t TRACE_VERSION = 1;
+// 录制缓冲区攒到这么大才写一次文件
+const size_t TRACE_FLUSH_SIZE = 1024 * 1024;
+
+enum class TraceDirection : uint8_t {
+    INBOUND = 0,    // 服务器发给客户端
+    OUTBOUND = 1,   // 客户端发给服务器
+    REQUEST = 2     // 界面通过 send_request 发起的请求，不是收包触发的，回放时重新发起
+};
+
+#pragma pack(push, 1)
+struct TraceFileHeader {
+    uint32_t magic;         // TRACE_MAGIC
+    uint32_t version;       // TRACE_VERSION
+    int64_t startTime;      // 开始录制的时间，Unix 微秒
+};
+
+// 每条记录的头，后面紧跟 length 字节的完整数据包（包头 + 消息体）
+struct TraceRecordHeader {
+    uint32_t deltaMicros;   // 距上一条记录的微秒数，超过 uint32 范围时截断
+    uint8_t direction;      // TraceDirection
+    uint32_t length;
+};
+#pragma pack(pop)
+
+struct TraceRecord {
+    TraceDirection direction = TraceDirection::INBOUND;
+    uint64_t timestamp = 0;   // 距录制开始的微秒数
+    std::string packet;       // 完整数据包
+};
+
+// 协议录制
+// 记录主连接上收发的每个数据包和时间，写入紧凑的二进制轨迹文件，供 TraceReplay 回放。
+class TraceWriter {
+public:
+    TraceWriter() = default;
+    ~TraceWriter();
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    bool open(const std::string& path);
+    // 收到的数据包，包头和消息体分开传入，不需要先拼起来
+    void record(TraceDirection direction, const PacketHeader& header, std::string_view body);
+    // 发出的完整数据包
+    void record(TraceDirection direction, std::string_view packet);
+    void close();
+    bool is_open() const { return file_.is_open(); }
+
+private:
+    void append_record_header(TraceDirection direction, size_t length);
+
+    std::ofstream file_;
+    std::string buffer_;
+    std::chrono::steady_clock::time_point last_;
+};
+
+// 按顺序读取轨迹文件中的记录
+class TraceReader {
+public:
+    bool open(const std::string& path);
+    // 读取下一条记录，文件结束或记录损坏时返回 false，损坏时 last_error() 不为空
+    bool next(TraceRecord& record);
+    const std::string& last_error() const { return last_error_; }
+
+private:
+    std::ifstream file_;
+    uint64_t timestamp_ = 0;
+    std::string last_error_;
+};
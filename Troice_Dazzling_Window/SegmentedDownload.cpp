@@ -0,0 +1,546 @@
+#include "SegmentedDownload.h"
+#include "Checksum.h"
+#include "CommandParser.h"
+#include "HashCache.h"
+#include <algorithm>
+
+namespace {
+    // 连接失败次数超过这个值就放弃本次下载
+    const uint64_t MAX_CONNECTION_FAILURES = 16;
+    // 新增连接后总速度至少提升这么多才继续增加
+    const double GROWTH_THRESHOLD = 1.10;
+}
+
+// ---------------------------------------------------------------------------
+// RangeConnection
+
+RangeConnection::RangeConnection(asio::io_context& io_context, std::shared_ptr<SegmentedDownloader> owner)
+    : socket_(io_context), owner_(owner), segment_begin_(0), segment_end_(0),
+      write_offset_(0), segment_crc_(0), sampled_bytes_(0), has_segment_(false), active_(true) {}
+
+void RangeConnection::start(const asio::ip::tcp::resolver::results_type& endpoints) {
+    asio::async_connect(socket_, endpoints, bind_handler_memory(handler_memory_,
+        [self = shared_from_this()](const asio::error_code& error, const asio::ip::tcp::endpoint&) {
+            if (error) {
+                self->fail();
+                return;
+            }
+            self->request_next_segment();
+            self->do_read();
+        }));
+}
+
+void RangeConnection::close() {
+    active_ = false;
+    asio::error_code ignored;
+    socket_.close(ignored);
+}
+
+uint64_t RangeConnection::take_sampled_bytes() {
+    uint64_t bytes = sampled_bytes_;
+    sampled_bytes_ = 0;
+    return bytes;
+}
+
+// 领取下一个分段并发送 GET_FILE|文件名|起始偏移|长度
+void RangeConnection::request_next_segment() {
+    auto owner = owner_.lock();
+    SegmentedDownloader::Segment segment;
+    if (!owner || !owner->next_segment(segment)) {
+        has_segment_ = false;
+        close();
+        return;
+    }
+
+    segment_begin_ = segment.begin;
+    segment_end_ = segment.end;
+    write_offset_ = segment.begin;
+    segment_crc_ = 0;
+    has_segment_ = true;
+
+    pending_message_ = make_packet(MessageType::GET_FILE,
+        owner->filename_ + "|" + std::to_string(segment.begin) + "|" + std::to_string(segment.end - segment.begin));
+
+    asio::async_write(socket_, asio::buffer(pending_message_), bind_handler_memory(handler_memory_,
+        [self = shared_from_this()](const asio::error_code& error, std::size_t /*length*/) {
+            if (error) {
+                self->fail();
+            }
+        }));
+}
+
+void RangeConnection::do_read() {
+    asio::async_read(socket_, asio::buffer(&header_, PACKET_HEADER_SIZE), bind_handler_memory(handler_memory_,
+        [self = shared_from_this()](const asio::error_code& error, std::size_t /*bytes_transferred*/) {
+            self->handle_read_header(error);
+        }));
+}
+
+void RangeConnection::handle_read_header(const asio::error_code& error) {
+    if (error || header_.bodyLength > MAX_BODY_LENGTH) {
+        fail();
+        return;
+    }
+
+    body_.resize(header_.bodyLength);
+    asio::async_read(socket_, asio::buffer(body_.data(), body_.size()), bind_handler_memory(handler_memory_,
+        [self = shared_from_this()](const asio::error_code& error, std::size_t bytes_transferred) {
+            self->handle_read(error, bytes_transferred);
+        }));
+}
+
+void RangeConnection::handle_read(const asio::error_code& error, size_t bytes_transferred) {
+    if (error) {
+        fail();
+        return;
+    }
+
+    auto owner = owner_.lock();
+    if (!owner || !active_) {
+        close();
+        return;
+    }
+
+    g_transfer_stats.add_received(PACKET_HEADER_SIZE + bytes_transferred);
+    std::string_view body(body_.data(), bytes_transferred);
+    switch (static_cast<MessageType>(header_.messageType)) {
+    case MessageType::FILE_BEGIN: {
+        // 文件名|文件大小|起始偏移[|CRC32C]，CRC 是整个文件的
+        FieldTokenizer fields(body);
+        std::string_view field;
+        uint64_t crc = 0;
+        if (fields.next(field) && fields.next(field) && fields.next(field) && fields.next(field) &&
+            parse_uint64(field, crc) && crc <= UINT32_MAX) {
+            owner->expect_crc(static_cast<uint32_t>(crc));
+        }
+        break;
+    }
+    case MessageType::FILE_CHUNK:
+        if (!handle_chunk(*owner, body)) {
+            fail();
+            return;
+        }
+        break;
+    case MessageType::FILE_CHUNK_Z:
+        if (!inflate_chunk(body, inflate_buffer_) ||
+            !handle_chunk(*owner, std::string_view(inflate_buffer_.data(), inflate_buffer_.size()))) {
+            fail();
+            return;
+        }
+        break;
+    case MessageType::FILE_END:
+        if (!has_segment_ || write_offset_ != segment_end_) {
+            fail();
+            return;
+        }
+        has_segment_ = false;
+        owner->segment_done({ segment_begin_, segment_end_, segment_crc_ });
+        request_next_segment();
+        break;
+    case MessageType::ERROR_RESPONSE:
+        fail();
+        return;
+    default:
+        break;
+    }
+
+    if (active_) {
+        // 写盘积压时先不读，由下载器在写入完成后恢复
+        if (owner->write_backlogged()) {
+            owner->wait_for_writes(shared_from_this());
+        } else {
+            do_read();
+        }
+    }
+}
+
+void RangeConnection::resume_read() {
+    if (active_) {
+        do_read();
+    }
+}
+
+bool RangeConnection::handle_chunk(SegmentedDownloader& owner, std::string_view data) {
+    if (!has_segment_ || write_offset_ + data.size() > segment_end_ ||
+        !owner.write_chunk(write_offset_, data)) {
+        return false;
+    }
+    write_offset_ += data.size();
+    segment_crc_ = crc32c(segment_crc_, data.data(), data.size());
+    sampled_bytes_ += data.size();
+    return true;
+}
+
+// 已收到的部分记为完成，剩余部分放回队列由其他连接下载
+void RangeConnection::fail() {
+    if (!active_) {
+        return;
+    }
+
+    auto owner = owner_.lock();
+    if (owner && has_segment_) {
+        if (write_offset_ > segment_begin_) {
+            owner->segment_done({ segment_begin_, write_offset_, segment_crc_ });
+        }
+        if (write_offset_ < segment_end_) {
+            owner->return_segment({ write_offset_, segment_end_ });
+        }
+        has_segment_ = false;
+    }
+
+    close();
+    if (owner) {
+        owner->connection_failed();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// SegmentedDownloader
+
+SegmentedDownloader::SegmentedDownloader(asio::io_context& io_context, const std::string& server_ip,
+                                         const std::string& server_port, const std::string& filename,
+                                         uint64_t filesize, uint64_t resume_offset)
+    : io_context_(io_context), sample_timer_(io_context), server_ip_(server_ip), server_port_(server_port),
+      filename_(filename), filesize_(filesize), resume_offset_(std::min(resume_offset, filesize)),
+      sink_(std::make_shared<AsyncFileSink>(io_context)), next_write_sequence_(0),
+      completed_bytes_(0), downloaded_(0), target_bytes_(filesize), failures_(0), repair_(false),
+      crc_known_(true), expected_crc_(0), has_expected_crc_(false), checksum_failed_(false), rate_before_growth_(0.0),
+      samples_since_growth_(0), growth_stopped_(false), finished_(false) {}
+
+void SegmentedDownloader::start() {
+    std::string error;
+    if (!ensure_data_directory(error)) {
+        finish(false, error);
+        return;
+    }
+
+    // 续传偏移必须有日志支持，日志记录的文件大小和服务器现在的不同时说明文件换过了，从头下载
+    PartJournal journal;
+    if (resume_offset_ > 0 &&
+        (!read_part_journal(filename_, journal) || journal.filesize != filesize_ || journal.verified < resume_offset_)) {
+        resume_offset_ = 0;
+    }
+
+    // 续传时保留已有内容，否则从头创建
+    if (!sink_->open(part_file_path(filename_), resume_offset_ == 0) || !sink_->resize(filesize_)) {
+        finish(false, "无法打开文件进行写入: " + part_file_path(filename_));
+        return;
+    }
+
+    if (resume_offset_ > 0) {
+        // 前缀的 CRC 从续传日志中取，日志没有记录时整个文件只校验大小
+        crc_known_ = (journal.flags & PART_JOURNAL_HAS_CRC) && journal.verified == resume_offset_;
+        completed_segments_.push_back({ 0, resume_offset_, crc_known_ ? journal.crc : 0 });
+    }
+    completed_bytes_ = resume_offset_;
+    downloaded_ = resume_offset_;
+
+    for (uint64_t begin = resume_offset_; begin < filesize_; begin += SEGMENT_SIZE) {
+        pending_segments_.push_back({ begin, std::min(begin + SEGMENT_SIZE, filesize_) });
+    }
+
+    connect();
+}
+
+void SegmentedDownloader::start_repair(const std::vector<std::pair<uint64_t, uint64_t>>& ranges) {
+    repair_ = true;
+
+    // 文件长度可能和服务器不同，按服务器的长度截断或扩展
+    if (!sink_->open(data_file_path(filename_), false) || !sink_->resize(filesize_)) {
+        finish(false, "无法打开文件进行写入: " + data_file_path(filename_));
+        return;
+    }
+
+    target_bytes_ = 0;
+    for (const auto& range : ranges) {
+        uint64_t end = std::min(range.second, filesize_);
+        for (uint64_t begin = range.first; begin < end; begin += SEGMENT_SIZE) {
+            Segment segment = { begin, std::min(begin + SEGMENT_SIZE, end) };
+            pending_segments_.push_back(segment);
+            target_bytes_ += segment.end - segment.begin;
+        }
+    }
+
+    connect();
+}
+
+void SegmentedDownloader::connect() {
+    if (pending_segments_.empty()) {
+        finish(true, "");
+        return;
+    }
+
+    // 主连接刚解析过同一个服务器，通常直接命中缓存
+    async_resolve_cached(io_context_, server_ip_, server_port_,
+        [self = shared_from_this()](const asio::error_code& error,
+                                    const asio::ip::tcp::resolver::results_type& results) {
+            if (error) {
+                self->finish(false, "无法解析服务器地址: " + error.message());
+                return;
+            }
+
+            self->endpoints_ = results;
+            for (size_t i = 0; i < SEGMENT_INITIAL_CONNECTIONS; ++i) {
+                self->add_connection();
+            }
+            self->last_sample_ = std::chrono::steady_clock::now();
+            self->schedule_sample();
+        });
+}
+
+bool SegmentedDownloader::next_segment(Segment& segment) {
+    if (finished_ || pending_segments_.empty()) {
+        return false;
+    }
+    segment = pending_segments_.front();
+    pending_segments_.pop_front();
+    return true;
+}
+
+void SegmentedDownloader::return_segment(const Segment& segment) {
+    pending_segments_.push_front(segment);
+}
+
+// 每个分段连接都会收到 FILE_BEGIN，CRC 是整个文件的，取第一次的值即可
+void SegmentedDownloader::expect_crc(uint32_t crc) {
+    if (!has_expected_crc_) {
+        expected_crc_ = crc;
+        has_expected_crc_ = true;
+    }
+}
+
+// 写入是异步的，数据拷贝进写缓冲区后立即返回，连接可以继续接收
+bool SegmentedDownloader::write_chunk(uint64_t offset, std::string_view data) {
+    if (finished_) {
+        return false;
+    }
+
+    if (next_write_sequence_ == 0) {
+        g_transfer_stats.file_first_byte(filename_);
+    }
+
+    uint64_t sequence = next_write_sequence_++;
+    writes_in_flight_.insert(sequence);
+    downloaded_ += data.size();
+
+    g_transfer_stats.add_file_writes(1);
+    sink_->async_write_at(offset, data,
+        [self = shared_from_this(), sequence, start = std::chrono::steady_clock::now()](bool ok) {
+            g_transfer_stats.add_file_writes(-1);
+            g_transfer_stats.record_disk_write(std::chrono::steady_clock::now() - start);
+            self->write_done(sequence, ok);
+        });
+    return true;
+}
+
+void SegmentedDownloader::write_done(uint64_t sequence, bool ok) {
+    writes_in_flight_.erase(sequence);
+    if (finished_) {
+        return;
+    }
+
+    if (!ok) {
+        finish(false, "文件写入失败: " + (repair_ ? data_file_path(filename_) : part_file_path(filename_)));
+        return;
+    }
+
+    commit_written_segments();
+
+    // 积压解除后恢复暂停的连接
+    if (!finished_ && !write_backlogged() && !paused_connections_.empty()) {
+        std::vector<std::shared_ptr<RangeConnection>> paused;
+        paused.swap(paused_connections_);
+        for (auto& connection : paused) {
+            connection->resume_read();
+        }
+    }
+}
+
+void SegmentedDownloader::segment_done(const Segment& segment) {
+    received_segments_.push_back({ segment, next_write_sequence_ });
+    commit_written_segments();
+}
+
+// 分段之前的写入全部完成后才算完成，续传日志不会记录还没落盘的数据
+void SegmentedDownloader::commit_written_segments() {
+    uint64_t lowest_pending = writes_in_flight_.empty() ? next_write_sequence_ : *writes_in_flight_.begin();
+
+    bool committed = false;
+    for (auto it = received_segments_.begin(); it != received_segments_.end();) {
+        if (it->write_mark <= lowest_pending) {
+            completed_segments_.push_back(it->segment);
+            completed_bytes_ += it->segment.end - it->segment.begin;
+            it = received_segments_.erase(it);
+            committed = true;
+        } else {
+            ++it;
+        }
+    }
+
+    if (!committed) {
+        return;
+    }
+
+    // 日志只记录连续的前缀，保证重启后从该位置续传是安全的
+    // 每个分段提交时刷新一次文件，日志不会走在数据前面
+    if (!repair_ && sink_->flush()) {
+        uint32_t crc = 0;
+        uint64_t prefix = contiguous_prefix(crc);
+        write_part_journal(filename_, filesize_, prefix, crc, crc_known_);
+    }
+
+    if (completed_bytes_ >= target_bytes_) {
+        finish(true, "");
+    }
+}
+
+bool SegmentedDownloader::write_backlogged() const {
+    return sink_->in_flight() >= SEGMENT_MAX_PENDING_WRITES;
+}
+
+void SegmentedDownloader::wait_for_writes(std::shared_ptr<RangeConnection> connection) {
+    paused_connections_.push_back(std::move(connection));
+}
+
+void SegmentedDownloader::connection_failed() {
+    if (finished_) {
+        return;
+    }
+
+    ++failures_;
+    if (failures_ > MAX_CONNECTION_FAILURES) {
+        finish(false, "连接失败次数过多: " + filename_);
+        return;
+    }
+
+    // 用新连接顶替失败的连接
+    if (!pending_segments_.empty()) {
+        add_connection();
+    }
+}
+
+void SegmentedDownloader::add_connection() {
+    auto connection = std::make_shared<RangeConnection>(io_context_, shared_from_this());
+    connections_.push_back(connection);
+    connection->start(endpoints_);
+}
+
+void SegmentedDownloader::schedule_sample() {
+    sample_timer_.expires_after(std::chrono::seconds(1));
+    sample_timer_.async_wait([self = shared_from_this()](const asio::error_code& error) {
+        if (!error && !self->finished_) {
+            self->sample();
+        }
+    });
+}
+
+void SegmentedDownloader::sample() {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - last_sample_).count();
+    last_sample_ = now;
+    if (seconds <= 0.0) {
+        seconds = 1.0;
+    }
+
+    DownloadReport report;
+    report.filename = filename_;
+    report.filesize = filesize_;
+    report.downloaded = downloaded_;
+
+    size_t active = 0;
+    for (auto& connection : connections_) {
+        double rate = connection->take_sampled_bytes() / seconds;
+        if (connection->is_active()) {
+            report.connection_rates.push_back(rate);
+            ++active;
+        }
+        report.aggregate_rate += rate;
+    }
+
+    // 清理已结束的连接
+    connections_.erase(
+        std::remove_if(connections_.begin(), connections_.end(),
+                       [](const std::shared_ptr<RangeConnection>& c) { return !c->is_active(); }),
+        connections_.end());
+
+    // 每次增加连接后观察两个采样周期，总速度没有明显提升就不再增加
+    if (!growth_stopped_ && active < SEGMENT_MAX_CONNECTIONS && !pending_segments_.empty()) {
+        if (++samples_since_growth_ >= 2) {
+            if (report.aggregate_rate > rate_before_growth_ * GROWTH_THRESHOLD) {
+                rate_before_growth_ = report.aggregate_rate;
+                samples_since_growth_ = 0;
+                add_connection();
+            } else {
+                growth_stopped_ = true;
+            }
+        }
+    }
+
+    if (on_report) {
+        on_report(report);
+    }
+    schedule_sample();
+}
+
+void SegmentedDownloader::finish(bool success, const std::string& error) {
+    if (finished_) {
+        return;
+    }
+    finished_ = true;
+
+    sample_timer_.cancel();
+    for (auto& connection : connections_) {
+        connection->close();
+    }
+    connections_.clear();
+    paused_connections_.clear();
+
+    std::string message = error;
+    // 失败时先让已完成的写入落盘，再记录续传位置；刷新失败就保留旧日志
+    bool flushed = success || repair_ || sink_->flush();
+    sink_->close();
+    uint32_t crc = 0;
+    uint64_t prefix = contiguous_prefix(crc);
+    if (repair_) {
+        // 修复模式直接写正式文件，没有 .part 和日志
+    } else if (success) {
+        if (crc_known_ && has_expected_crc_ && crc != expected_crc_) {
+            success = false;
+            message = "文件校验失败: " + filename_ + " CRC " + std::to_string(crc) +
+                      " 预期 " + std::to_string(expected_crc_);
+            checksum_failed_ = true;
+            discard_part_file(filename_);
+        } else {
+            success = commit_part_file(filename_, message);
+            if (success && crc_known_) {
+                remember_verified_hash(filename_, crc);
+            }
+        }
+    } else if (flushed) {
+        write_part_journal(filename_, filesize_, prefix, crc, crc_known_);
+    }
+
+    if (on_complete) {
+        on_complete(success, message);
+    }
+}
+
+// 同时按顺序合并前缀中各分段的 CRC
+uint64_t SegmentedDownloader::contiguous_prefix(uint32_t& crc) const {
+    std::vector<Segment> segments = completed_segments_;
+    std::sort(segments.begin(), segments.end(),
+              [](const Segment& a, const Segment& b) { return a.begin < b.begin; });
+
+    uint64_t prefix = 0;
+    crc = 0;
+    for (const auto& segment : segments) {
+        if (segment.begin > prefix) {
+            break;
+        }
+        if (segment.begin == prefix && segment.end > prefix) {
+            crc = prefix == 0 ? segment.crc : crc32c_combine(crc, segment.crc, segment.end - segment.begin);
+        }
+        prefix = std::max(prefix, segment.end);
+    }
+    return prefix;
+}
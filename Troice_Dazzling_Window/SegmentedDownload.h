@@ -0,0 +1,162 @@
+#pragma once
+
+#include <asio.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include "Protocol.h"
+#include "FileTransfer.h"
+#include "Compression.h"
+#include "FileSink.h"
+#include "TransferStats.h"
+#include "Connector.h"
+#include "HandlerMemory.h"
+#include <set>
+
+// 超过这个大小的文件使用多连接分段下载
+const uint64_t SEGMENTED_THRESHOLD = 64ull * 1024 * 1024;
+// 每个分段的大小
+const uint64_t SEGMENT_SIZE = 16ull * 1024 * 1024;
+// 初始连接数和最大连接数
+const size_t SEGMENT_INITIAL_CONNECTIONS = 2;
+const size_t SEGMENT_MAX_CONNECTIONS = 8;
+// 未完成的写入超过这个数时所有连接暂停读取，等磁盘跟上
+const size_t SEGMENT_MAX_PENDING_WRITES = FILE_SINK_QUEUE_DEPTH * 4;
+
+// 下载速度报告
+struct DownloadReport {
+    std::string filename;
+    uint64_t filesize = 0;
+    uint64_t downloaded = 0;                 // 已下载字节数（含续传前缀）
+    double aggregate_rate = 0.0;             // 总速度，字节/秒
+    std::vector<double> connection_rates;    // 每个连接的速度，字节/秒
+};
+
+class SegmentedDownloader;
+
+// 分段下载中的单个连接，一次只下载一个分段
+class RangeConnection : public std::enable_shared_from_this<RangeConnection> {
+public:
+    RangeConnection(asio::io_context& io_context, std::shared_ptr<SegmentedDownloader> owner);
+    void start(const asio::ip::tcp::resolver::results_type& endpoints);
+    void close();
+    void resume_read();              // 写盘积压解除后继续读取
+
+    uint64_t take_sampled_bytes();   // 取出上次采样以来收到的字节数
+    bool is_active() const { return active_; }
+
+private:
+    void request_next_segment();
+    void do_read();
+    void handle_read_header(const asio::error_code& error);
+    void handle_read(const asio::error_code& error, size_t bytes_transferred);
+    bool handle_chunk(SegmentedDownloader& owner, std::string_view data);
+    void fail();
+
+    HandlerMemory handler_memory_;   // 连接、收发操作的内存，必须比 socket_ 后析构
+    asio::ip::tcp::socket socket_;
+    std::weak_ptr<SegmentedDownloader> owner_;
+    PacketHeader header_;
+    std::vector<char> body_;
+    std::vector<char> inflate_buffer_;
+    std::string pending_message_;
+
+    uint64_t segment_begin_;    // 当前分段起点
+    uint64_t segment_end_;      // 当前分段终点（不含）
+    uint64_t write_offset_;     // 下一个数据块写入的位置
+    uint32_t segment_crc_;      // [segment_begin_, write_offset_) 的 CRC32C
+    uint64_t sampled_bytes_;
+    bool has_segment_;
+    bool active_;
+};
+
+// 多连接分段下载器
+// 把大文件切成若干分段，由多个连接并行下载并按偏移写入同一个 .part 文件。
+// 每秒采样一次速度，只要增加连接还能带来明显提速就继续增加连接。
+// 每个连接边收边计算所在分段的 CRC32C，全部完成后按偏移顺序合并成整个文件的 CRC，与服务器的值比较后再改名。
+class SegmentedDownloader : public std::enable_shared_from_this<SegmentedDownloader> {
+public:
+    SegmentedDownloader(asio::io_context& io_context, const std::string& server_ip,
+                        const std::string& server_port, const std::string& filename,
+                        uint64_t filesize, uint64_t resume_offset = 0);
+
+    void start();
+    // 修复模式：只重新下载给定的 [起点, 终点) 区间，直接写入已有的正式文件
+    void start_repair(const std::vector<std::pair<uint64_t, uint64_t>>& ranges);
+
+    std::function<void(const DownloadReport&)> on_report;            // 每次采样后回调
+    std::function<void(bool, const std::string&)> on_complete;       // 完成或失败时回调
+
+    bool checksum_failed() const { return checksum_failed_; }        // 失败原因是 CRC 与服务器不一致
+
+private:
+    friend class RangeConnection;
+
+    struct Segment {
+        uint64_t begin;
+        uint64_t end;
+        uint32_t crc = 0;            // 已完成分段的 CRC32C
+    };
+
+    // 数据已全部收到、但写入可能还没完成的分段
+    struct ReceivedSegment {
+        Segment segment;
+        uint64_t write_mark;         // 该分段最后一次写入之后的写入序号
+    };
+
+    void connect();
+    bool next_segment(Segment& segment);
+    void return_segment(const Segment& segment);
+    bool write_chunk(uint64_t offset, std::string_view data);
+    void expect_crc(uint32_t crc);
+    void segment_done(const Segment& segment);
+    void write_done(uint64_t sequence, bool ok);
+    void commit_written_segments();
+    bool write_backlogged() const;
+    void wait_for_writes(std::shared_ptr<RangeConnection> connection);
+    void connection_failed();
+
+    void add_connection();
+    void schedule_sample();
+    void sample();
+    void finish(bool success, const std::string& error);
+    uint64_t contiguous_prefix(uint32_t& crc) const;
+
+    asio::io_context& io_context_;
+    asio::steady_timer sample_timer_;
+    std::string server_ip_;
+    std::string server_port_;
+    std::string filename_;
+    uint64_t filesize_;
+    uint64_t resume_offset_;
+
+    asio::ip::tcp::resolver::results_type endpoints_;
+    std::shared_ptr<AsyncFileSink> sink_;
+    std::deque<Segment> pending_segments_;
+    std::vector<ReceivedSegment> received_segments_;
+    std::vector<Segment> completed_segments_;       // 数据已写入文件的分段
+    std::set<uint64_t> writes_in_flight_;           // 还没完成的写入序号
+    uint64_t next_write_sequence_;
+    std::vector<std::shared_ptr<RangeConnection>> paused_connections_;
+    std::vector<std::shared_ptr<RangeConnection>> connections_;
+    uint64_t completed_bytes_;       // 已完成分段的总字节数（含续传前缀）
+    uint64_t downloaded_;            // 已收到的字节数（含续传前缀）
+    uint64_t target_bytes_;          // 全部完成时 completed_bytes_ 应达到的值
+    uint64_t failures_;
+    bool repair_;
+    bool crc_known_;                 // 续传前缀的 CRC 未知时为 false，只校验大小
+    uint32_t expected_crc_;
+    bool has_expected_crc_;
+    bool checksum_failed_;
+
+    // 自适应连接数
+    std::chrono::steady_clock::time_point last_sample_;
+    double rate_before_growth_;      // 上次增加连接前的总速度
+    int samples_since_growth_;
+    bool growth_stopped_;
+    bool finished_;
+};
@@ -0,0 +1,252 @@
+#include "TransferStats.h"
+#include <fstream>
+#include <algorithm>
+
+TransferStats g_transfer_stats;
+
+TransferStats::TransferStats()
+    : bytes_received_(0), messages_received_(0), send_queue_depth_(0), disk_queue_depth_(0), file_writes_in_flight_(0),
+      disk_write_count_(0), disk_write_total_us_(0), disk_write_max_us_(0), hash_bytes_(0), hash_us_(0),
+      last_sample_(Clock::now()), last_sample_bytes_(0), rate_ewma_(0.0), rate_peak_(0.0) {}
+
+void TransferStats::add_received(uint64_t bytes) {
+    bytes_received_.fetch_add(bytes, std::memory_order_relaxed);
+    messages_received_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TransferStats::add_send_queue(int64_t delta) {
+    send_queue_depth_.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void TransferStats::add_disk_queue(int64_t delta) {
+    disk_queue_depth_.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void TransferStats::add_file_writes(int64_t delta) {
+    file_writes_in_flight_.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void TransferStats::record_disk_write(Clock::duration latency) {
+    uint64_t us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+    disk_write_count_.fetch_add(1, std::memory_order_relaxed);
+    disk_write_total_us_.fetch_add(us, std::memory_order_relaxed);
+
+    uint64_t max = disk_write_max_us_.load(std::memory_order_relaxed);
+    while (us > max && !disk_write_max_us_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+}
+
+void TransferStats::record_hash(uint64_t bytes, Clock::duration elapsed) {
+    hash_bytes_.store(bytes, std::memory_order_relaxed);
+    hash_us_.store(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()),
+                   std::memory_order_relaxed);
+}
+
+void TransferStats::file_requested(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    FileRecord record;
+    record.requested = Clock::now();
+    active_files_[filename] = record;
+}
+
+void TransferStats::file_first_byte(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = active_files_.find(filename);
+    if (it != active_files_.end() && !it->second.has_first_byte) {
+        it->second.first_byte = Clock::now();
+        it->second.has_first_byte = true;
+    }
+}
+
+void TransferStats::file_completed(const std::string& filename, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = active_files_.find(filename);
+    if (it == active_files_.end()) {
+        return;
+    }
+
+    Clock::time_point now = Clock::now();
+    FileTiming timing;
+    timing.filename = filename;
+    timing.bytes = bytes;
+    if (it->second.has_first_byte) {
+        timing.first_byte_ms = elapsed_ms(it->second.requested, it->second.first_byte);
+    }
+    timing.complete_ms = elapsed_ms(it->second.requested, now);
+    active_files_.erase(it);
+
+    finished_files_.push_back(timing);
+    if (finished_files_.size() > STATS_MAX_FINISHED_FILES) {
+        finished_files_.pop_front();
+    }
+}
+
+void TransferStats::file_failed(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    active_files_.erase(filename);
+}
+
+void TransferStats::update_segmented(const std::string& filename, double aggregate_rate,
+                                     const std::vector<double>& connection_rates) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    SegmentedRate& rate = segmented_[filename];
+    rate.filename = filename;
+    rate.aggregate_rate = aggregate_rate;
+    rate.connection_rates = connection_rates;
+}
+
+void TransferStats::segmented_finished(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    segmented_.erase(filename);
+}
+
+void TransferStats::sample() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    double seconds = std::chrono::duration<double>(now - last_sample_).count();
+    if (seconds < 1.0) {
+        return;
+    }
+
+    uint64_t bytes = bytes_received_.load(std::memory_order_relaxed);
+    double rate = (bytes - last_sample_bytes_) / seconds;
+    rate_ewma_ = STATS_EWMA_ALPHA * rate + (1.0 - STATS_EWMA_ALPHA) * rate_ewma_;
+    rate_peak_ = std::max(rate_peak_, rate);
+    last_sample_ = now;
+    last_sample_bytes_ = bytes;
+}
+
+StatsSnapshot TransferStats::snapshot() {
+    StatsSnapshot snap;
+    snap.bytes_received = bytes_received_.load(std::memory_order_relaxed);
+    snap.messages_received = messages_received_.load(std::memory_order_relaxed);
+    snap.send_queue_depth = send_queue_depth_.load(std::memory_order_relaxed);
+    snap.disk_queue_depth = disk_queue_depth_.load(std::memory_order_relaxed);
+    snap.file_writes_in_flight = file_writes_in_flight_.load(std::memory_order_relaxed);
+
+    snap.disk_write.count = disk_write_count_.load(std::memory_order_relaxed);
+    snap.disk_write.max_us = disk_write_max_us_.load(std::memory_order_relaxed);
+    if (snap.disk_write.count > 0) {
+        snap.disk_write.average_us =
+            static_cast<double>(disk_write_total_us_.load(std::memory_order_relaxed)) / snap.disk_write.count;
+    }
+
+    snap.hash_bytes = hash_bytes_.load(std::memory_order_relaxed);
+    uint64_t hash_us = hash_us_.load(std::memory_order_relaxed);
+    if (hash_us > 0) {
+        snap.hash_rate = snap.hash_bytes * 1e6 / hash_us;
+    }
+    snap.chunk_pool = g_chunk_pool.stats();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    snap.rate_ewma = rate_ewma_;
+    snap.rate_peak = rate_peak_;
+
+    Clock::time_point now = Clock::now();
+    for (const auto& entry : active_files_) {
+        FileTiming timing;
+        timing.filename = entry.first;
+        if (entry.second.has_first_byte) {
+            timing.first_byte_ms = elapsed_ms(entry.second.requested, entry.second.first_byte);
+        }
+        timing.elapsed_ms = elapsed_ms(entry.second.requested, now);
+        snap.active_files.push_back(timing);
+    }
+    snap.finished_files.assign(finished_files_.begin(), finished_files_.end());
+    for (const auto& entry : segmented_) {
+        snap.segmented.push_back(entry.second);
+    }
+    return snap;
+}
+
+bool TransferStats::dump_json(const std::string& path) {
+    StatsSnapshot snap = snapshot();
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file << "{\n"
+         << "  \"bytes_received\": " << snap.bytes_received << ",\n"
+         << "  \"messages_received\": " << snap.messages_received << ",\n"
+         << "  \"rate_ewma\": " << snap.rate_ewma << ",\n"
+         << "  \"rate_peak\": " << snap.rate_peak << ",\n"
+         << "  \"send_queue_depth\": " << snap.send_queue_depth << ",\n"
+         << "  \"disk_queue_depth\": " << snap.disk_queue_depth << ",\n"
+         << "  \"file_writes_in_flight\": " << snap.file_writes_in_flight << ",\n"
+         << "  \"disk_write\": { \"count\": " << snap.disk_write.count
+         << ", \"average_us\": " << snap.disk_write.average_us
+         << ", \"max_us\": " << snap.disk_write.max_us << " },\n"
+         << "  \"hash_bytes\": " << snap.hash_bytes << ",\n"
+         << "  \"hash_rate\": " << snap.hash_rate << ",\n"
+         << "  \"chunk_pool\": { \"allocated\": " << snap.chunk_pool.allocated
+         << ", \"in_use\": " << snap.chunk_pool.in_use
+         << ", \"high_water\": " << snap.chunk_pool.high_water
+         << ", \"acquires\": " << snap.chunk_pool.acquires
+         << ", \"stalls\": " << snap.chunk_pool.stalls
+         << ", \"stall_us\": " << snap.chunk_pool.stall_us << " },\n"
+         << "  \"segmented\": [";
+
+    bool first = true;
+    for (const auto& rate : snap.segmented) {
+        file << (first ? "\n" : ",\n")
+             << "    { \"filename\": \"" << rate.filename << "\", \"aggregate_rate\": " << rate.aggregate_rate
+             << ", \"connection_rates\": [";
+        for (size_t i = 0; i < rate.connection_rates.size(); ++i) {
+            file << (i == 0 ? "" : ", ") << rate.connection_rates[i];
+        }
+        file << "] }";
+        first = false;
+    }
+    file << (snap.segmented.empty() ? "],\n" : "\n  ],\n")
+         << "  \"files\": [";
+
+    // 文件名只允许出现补丁文件名，不含引号和反斜杠，这里不做转义
+    first = true;
+    for (const auto& timing : snap.finished_files) {
+        file << (first ? "\n" : ",\n")
+             << "    { \"filename\": \"" << timing.filename << "\", \"bytes\": " << timing.bytes
+             << ", \"first_byte_ms\": " << timing.first_byte_ms
+             << ", \"complete_ms\": " << timing.complete_ms << " }";
+        first = false;
+    }
+    file << "\n  ]\n}\n";
+    return file.good();
+}
+
+bool TransferStats::dump_csv(const std::string& path) {
+    StatsSnapshot snap = snapshot();
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file << "filename,bytes,first_byte_ms,complete_ms\n";
+    for (const auto& timing : snap.finished_files) {
+        file << timing.filename << "," << timing.bytes << ","
+             << timing.first_byte_ms << "," << timing.complete_ms << "\n";
+    }
+    file << "\nmetric,value\n"
+         << "bytes_received," << snap.bytes_received << "\n"
+         << "messages_received," << snap.messages_received << "\n"
+         << "rate_ewma," << snap.rate_ewma << "\n"
+         << "rate_peak," << snap.rate_peak << "\n"
+         << "send_queue_depth," << snap.send_queue_depth << "\n"
+         << "disk_queue_depth," << snap.disk_queue_depth << "\n"
+         << "file_writes_in_flight," << snap.file_writes_in_flight << "\n"
+         << "disk_write_count," << snap.disk_write.count << "\n"
+         << "disk_write_average_us," << snap.disk_write.average_us << "\n"
+         << "disk_write_max_us," << snap.disk_write.max_us << "\n"
+         << "hash_bytes," << snap.hash_bytes << "\n"
+         << "hash_rate," << snap.hash_rate << "\n"
+         << "chunk_pool_allocated," << snap.chunk_pool.allocated << "\n"
+         << "chunk_pool_high_water," << snap.chunk_pool.high_water << "\n"
+         << "chunk_pool_acquires," << snap.chunk_pool.acquires << "\n"
+         << "chunk_pool_stalls," << snap.chunk_pool.stalls << "\n"
+         << "chunk_pool_stall_us," << snap.chunk_pool.stall_us << "\n";
+    return file.good();
+}
+
+double TransferStats::elapsed_ms(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
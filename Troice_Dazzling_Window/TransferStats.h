@@ -0,0 +1,124 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "ChunkPool.h"
+
+// 速度的指数滑动平均系数，每秒采样一次
+const double STATS_EWMA_ALPHA = 0.3;
+// 保留最近完成的文件记录数
+const size_t STATS_MAX_FINISHED_FILES = 64;
+
+// 延迟统计，单位微秒
+struct LatencySnapshot {
+    uint64_t count = 0;
+    double average_us = 0.0;
+    uint64_t max_us = 0;
+};
+
+// 单个文件的传输耗时
+struct FileTiming {
+    std::string filename;
+    uint64_t bytes = 0;
+    double first_byte_ms = -1.0;     // 请求到收到第一个字节，未收到时为负
+    double complete_ms = -1.0;       // 请求到写入完成，未完成时为负
+    double elapsed_ms = 0.0;         // 进行中的文件从请求到现在的时间
+};
+
+// 一个分段下载最近一次采样的速度
+struct SegmentedRate {
+    std::string filename;
+    double aggregate_rate = 0.0;             // 总速度，字节/秒
+    std::vector<double> connection_rates;    // 每个连接的速度，字节/秒
+};
+
+// 界面显示和导出用的统计快照
+struct StatsSnapshot {
+    uint64_t bytes_received = 0;
+    uint64_t messages_received = 0;  // 收到的数据包，主连接和分段下载的连接合计
+    double rate_ewma = 0.0;          // 字节/秒
+    double rate_peak = 0.0;          // 字节/秒
+    int64_t send_queue_depth = 0;    // 等待发送的数据包
+    int64_t disk_queue_depth = 0;    // 等待执行的写盘任务
+    int64_t file_writes_in_flight = 0;  // 在途的异步文件写入
+    LatencySnapshot disk_write;
+    uint64_t hash_bytes = 0;
+    double hash_rate = 0.0;          // 最近一次校验的速度，字节/秒
+    ChunkPoolStats chunk_pool;       // 数据块缓冲池
+    std::vector<FileTiming> active_files;
+    std::vector<FileTiming> finished_files;
+    std::vector<SegmentedRate> segmented;    // 进行中的分段下载
+};
+
+// 传输统计
+// 计数器都是原子变量，网络线程、写盘线程和校验线程可以直接更新；
+// 文件耗时记录频率很低，用互斥锁保护。速度由界面线程每帧调用 sample() 计算。
+class TransferStats {
+public:
+    TransferStats();
+
+    // 每收到一个数据包调用一次，bytes 含包头
+    void add_received(uint64_t bytes);
+    void add_send_queue(int64_t delta);
+    void add_disk_queue(int64_t delta);
+    void add_file_writes(int64_t delta);
+    void record_disk_write(std::chrono::steady_clock::duration latency);
+    void record_hash(uint64_t bytes, std::chrono::steady_clock::duration elapsed);
+
+    void file_requested(const std::string& filename);
+    void file_first_byte(const std::string& filename);
+    void file_completed(const std::string& filename, uint64_t bytes);
+    // 下载失败、中止或挂起留待续传时调用，不计入已完成列表
+    void file_failed(const std::string& filename);
+
+    // 分段下载每次采样后更新，结束时移除
+    void update_segmented(const std::string& filename, double aggregate_rate,
+                          const std::vector<double>& connection_rates);
+    void segmented_finished(const std::string& filename);
+
+    // 每秒更新一次速度，调用频率更高时直接返回
+    void sample();
+    StatsSnapshot snapshot();
+
+    bool dump_json(const std::string& path);
+    bool dump_csv(const std::string& path);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct FileRecord {
+        Clock::time_point requested;
+        Clock::time_point first_byte;
+        bool has_first_byte = false;
+    };
+
+    static double elapsed_ms(Clock::time_point from, Clock::time_point to);
+
+    std::atomic<uint64_t> bytes_received_;
+    std::atomic<uint64_t> messages_received_;
+    std::atomic<int64_t> send_queue_depth_;
+    std::atomic<int64_t> disk_queue_depth_;
+    std::atomic<int64_t> file_writes_in_flight_;
+    std::atomic<uint64_t> disk_write_count_;
+    std::atomic<uint64_t> disk_write_total_us_;
+    std::atomic<uint64_t> disk_write_max_us_;
+    std::atomic<uint64_t> hash_bytes_;
+    std::atomic<uint64_t> hash_us_;
+
+    std::mutex mutex_;
+    std::map<std::string, FileRecord> active_files_;
+    std::deque<FileTiming> finished_files_;
+    std::map<std::string, SegmentedRate> segmented_;
+    Clock::time_point last_sample_;
+    uint64_t last_sample_bytes_;
+    double rate_ewma_;
+    double rate_peak_;
+};
+
+extern TransferStats g_transfer_stats;